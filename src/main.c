@@ -23,8 +23,18 @@
 #include <string.h>
 #include <signal.h>
 #include <errno.h>
+#include <ctype.h>        /* isspace() */
+#include <time.h>
+#include <pthread.h>
 
 #include "pwm.h"
+#include "pwm_trace.h"
+#include "pwm_melody.h"
+#include "pwm_pattern.h"
+#include "pwm_engine.h"
+#include "pwm_apply.h"
+#include "pwm_metrics.h"
+#include "pwm_arena.h"
 
 /* ----------------------------------------------------------------------- */
 
@@ -52,6 +62,36 @@
 #define DEFAULT_PWM_DURATION_MS  250
 #endif
 
+#ifndef DEFAULT_PWM_DUTY_PERCENT
+
+/** Default PWM duty cycle in percents */
+#define DEFAULT_PWM_DUTY_PERCENT  50
+#endif
+
+#ifndef DEFAULT_PWM_PATTERN_FILE
+
+/** Default precompiled patterns library file */
+#define DEFAULT_PWM_PATTERN_FILE  "/usr/share/pwm-tool/patterns.bin"
+#endif
+
+#ifndef DEFAULT_PWM_TRACE_EVENTS
+
+/** Number of the events in the trace ring buffer */
+#define DEFAULT_PWM_TRACE_EVENTS  4096
+#endif
+
+#ifndef DEFAULT_PWM_APPLY_LINE_MAX
+
+/** Maximum line length of the apply file (including newline) */
+#define DEFAULT_PWM_APPLY_LINE_MAX  256
+#endif
+
+#ifndef DEFAULT_PWM_METRICS_INTERVAL_MS
+
+/** Default metrics file update interval in milliseconds */
+#define DEFAULT_PWM_METRICS_INTERVAL_MS  10000
+#endif
+
 /* ----------------------------------------------------------------------- */
 
 /**
@@ -75,10 +115,88 @@ typedef struct config {
 	 *  Default value specified in @ref DEFAULT_PWM_DURATION_MS. */
 	unsigned int duration_ms;
 
+	/** PWM duty cycle in percents
+	 *  Default value specified in @ref DEFAULT_PWM_DUTY_PERCENT. */
+	unsigned int duty_percent;
+
+	/** PWM output polarity (-1 to keep current polarity) */
+	int polarity;
+
+	/** Timeout in ms for waiting of the PWM channel after exporting
+	 *  Default value specified in @ref PWM_EXPORT_TIMEOUT_MS. */
+	unsigned int export_timeout_ms;
+
 	/** If set, PWM will remain enabled on exit. */
 	int keep_enabled;
 
-	char *script;
+	/** If set, PWM channel state found at start is restored on exit. */
+	int restore;
+
+	/** If set, PWM channel is opened with @ref PWM_FLAG_LAZY flag. */
+	int fast_start;
+
+	/** Deadline overrun policy */
+	pwm_overrun_policy_t overrun_policy;
+
+	/** Deadline overrun tolerance in microseconds
+	 *  Default value specified in @ref PWM_OVERRUN_TOLERANCE_US. */
+	unsigned int overrun_tolerance_us;
+
+	/** If set, execution statistics are printed on exit. */
+	int stats;
+
+	/** If set, list available PWM chips and exit. */
+	int list;
+
+	/** PWM chip stable name. Overrides chip number if set. */
+	const char *name;
+
+	/** Sysfs PWM root folder. Library default is used if not set. */
+	const char *sysfs_root;
+
+	/** Trace output file. Tracing is disabled if not set. */
+	const char *trace_file;
+
+	const char *script;
+
+	/** Melody in RTTTL format. Overrides script if set. */
+	const char *melody;
+
+	/** Precompiled pattern name. Overrides script and melody if set. */
+	const char *pattern;
+
+	/** Precompiled patterns library file.
+	 *  Default value specified in @ref DEFAULT_PWM_PATTERN_FILE. */
+	const char *pattern_file;
+
+	/** If set, compile patterns from stdin into this file and exit. */
+	const char *compile_file;
+
+	/** Pattern engine channels ("<chip>:<channel>:<script>") */
+	const char *engine[PWM_ENGINE_CHANNELS_MAX];
+
+	/** Number of the pattern engine channels */
+	unsigned int engine_count;
+
+	/** Pattern engine coalescing tolerance in milliseconds */
+	unsigned int coalesce_ms;
+
+	/** Pattern engine timer slack in microseconds */
+	unsigned int timer_slack_us;
+
+	/** If set, apply channel states from this file and exit. */
+	const char *apply_file;
+
+	/** Metrics output file (Prometheus text format). */
+	const char *metrics_file;
+
+	/** Metrics output file update interval in milliseconds
+	 *  (0 to save only on exit).
+	 *  Default value specified in @ref DEFAULT_PWM_METRICS_INTERVAL_MS. */
+	unsigned int metrics_interval_ms;
+
+	/** Metrics shared memory file. */
+	const char *metrics_shm;
 
 } config_t;
 
@@ -87,34 +205,130 @@ typedef struct config {
 /** Global exit flag (used in script mode) */
 static int exit_flag = 0;
 
+/** Execution trace (used if trace file is specified) */
+static pwm_trace_t trace;
+
+/** Execution trace events storage */
+static pwm_trace_event_t *trace_events = NULL;
+
+/** Number of the events in the execution trace storage */
+static size_t trace_capacity = 0;
+
+/* ----------------------------------------------------------------------- */
+
+/**
+ * Resize memory block. In the zero-heap build the memory
+ * is taken from the library default arena.
+ */
+static void *mem_resize(void *ptr, size_t old_size, size_t size)
+{
+#ifdef PWM_NO_HEAP
+	return pwm_arena_resize(pwm_arena_get_default(), ptr, old_size, size);
+#else
+	(void)old_size;
+	return realloc(ptr, size);
+#endif
+}
+
+/**
+ * Free memory block allocated with @ref mem_resize
+ */
+static void mem_free(void *ptr, size_t size)
+{
+#ifdef PWM_NO_HEAP
+	pwm_arena_free(pwm_arena_get_default(), ptr, size);
+#else
+	(void)size;
+	free(ptr);
+#endif
+}
+
+/** Metrics (used if metrics file or shared memory file is specified) */
+static pwm_metrics_t *metrics = NULL;
+
+/** Metrics storage (used if shared memory file is not specified) */
+static pwm_metrics_t metrics_storage;
+
+/** Metrics file writer thread */
+static pthread_t metrics_thread;
+
+/** Non-zero if the metrics file writer thread is running */
+static int metrics_threaded = 0;
+
+/** Metrics file writer thread stop flag */
+static int metrics_stop = 0;
+
+/** Metrics file writer thread lock */
+static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Metrics file writer thread wakeup condition */
+static pthread_cond_t metrics_cond;
+
+/** Compiled melody (used in melody mode) */
+static pwm_program_t melody;
+
+/** Precompiled patterns library (used in pattern mode) */
+static pwm_pattern_lib_t patterns;
+
+/** Program of the pattern found in the library (points to the library) */
+static pwm_program_t pattern;
+
 /**
  * @brief Global configuration structure
  */
 static config_t config = {
-	.chip         = DEFAULT_PWM_CHIP,
-	.channel      = DEFAULT_PWM_CHANNEL,
-	.frequency_hz = DEFAULT_PWM_FREQUENCY_HZ,
-	.duration_ms  = DEFAULT_PWM_DURATION_MS,
-	.keep_enabled = 0,
+	.chip              = DEFAULT_PWM_CHIP,
+	.channel           = DEFAULT_PWM_CHANNEL,
+	.frequency_hz      = DEFAULT_PWM_FREQUENCY_HZ,
+	.duration_ms       = DEFAULT_PWM_DURATION_MS,
+	.duty_percent      = DEFAULT_PWM_DUTY_PERCENT,
+	.polarity          = -1,
+	.pattern_file      = DEFAULT_PWM_PATTERN_FILE,
+	.export_timeout_ms = PWM_EXPORT_TIMEOUT_MS,
+	.keep_enabled      = 0,
+	.metrics_interval_ms = DEFAULT_PWM_METRICS_INTERVAL_MS,
 };
 
 /**
  * @brief Short command line options list
  */
-static const char *opts_str = "hp:c:f:d:s:k";
+static const char *opts_str = "hp:c:n:f:d:w:s:m:klr";
 
 /**
  * @brief Long command line options list
  */
 static const struct option opts[] = {
-	{ .name = "help",         .val = 'h' },
-	{ .name = "chip",         .val = 'p', .has_arg = 1 },
-	{ .name = "channel",      .val = 'c', .has_arg = 1 },
-	{ .name = "frequency",    .val = 'f', .has_arg = 1 },
-	{ .name = "duration",     .val = 'd', .has_arg = 1 },
-	{ .name = "script",       .val = 's', .has_arg = 1 },
-	{ .name = "keep-enabled", .val = 'k' },
-	{ .name = "version",      .val = 'V' },
+	{ .name = "help",            .val = 'h' },
+	{ .name = "chip",            .val = 'p', .has_arg = 1 },
+	{ .name = "channel",         .val = 'c', .has_arg = 1 },
+	{ .name = "name",            .val = 'n', .has_arg = 1 },
+	{ .name = "frequency",       .val = 'f', .has_arg = 1 },
+	{ .name = "duration",        .val = 'd', .has_arg = 1 },
+	{ .name = "duty",            .val = 'w', .has_arg = 1 },
+	{ .name = "polarity",        .val = 'P', .has_arg = 1 },
+	{ .name = "script",          .val = 's', .has_arg = 1 },
+	{ .name = "melody",          .val = 'm', .has_arg = 1 },
+	{ .name = "pattern",         .val = 'A', .has_arg = 1 },
+	{ .name = "pattern-file",    .val = 'F', .has_arg = 1 },
+	{ .name = "compile",         .val = 'C', .has_arg = 1 },
+	{ .name = "keep-enabled",    .val = 'k' },
+	{ .name = "list",            .val = 'l' },
+	{ .name = "export-timeout",  .val = 'E', .has_arg = 1 },
+	{ .name = "sysfs-root",      .val = 'R', .has_arg = 1 },
+	{ .name = "trace",           .val = 'T', .has_arg = 1 },
+	{ .name = "restore",         .val = 'r' },
+	{ .name = "fast-start",      .val = 'S' },
+	{ .name = "overrun",         .val = 'O', .has_arg = 1 },
+	{ .name = "overrun-tolerance", .val = 'o', .has_arg = 1 },
+	{ .name = "stats",           .val = 'I' },
+	{ .name = "engine",          .val = 'e', .has_arg = 1 },
+	{ .name = "coalesce",        .val = 'W', .has_arg = 1 },
+	{ .name = "timer-slack",     .val = 'L', .has_arg = 1 },
+	{ .name = "apply",           .val = 'Y', .has_arg = 1 },
+	{ .name = "metrics",         .val = 'M', .has_arg = 1 },
+	{ .name = "metrics-interval", .val = 'N', .has_arg = 1 },
+	{ .name = "metrics-shm",     .val = 'H', .has_arg = 1 },
+	{ .name = "version",         .val = 'V' },
 	{ 0 }
 };
 
@@ -142,6 +356,11 @@ static void display_usage(void)
 		"        Select PWM chip channel number.\n"
 		"        Default: %u\n"
 		"\n"
+		"  -n, --name <name>\n"
+		"        Select PWM chip by the backing device label,\n"
+		"        sysfs path or trailing part of this path.\n"
+		"        Overrides --chip option.\n"
+		"\n"
 		"  -f, --frequency <frequency_in_hz>\n"
 		"        Set PWM frequency in Hz.\n"
 		"        Default: %u\n"
@@ -150,6 +369,14 @@ static void display_usage(void)
 		"        Set PWM duration in milliseconds.\n"
 		"        Default: %u\n"
 		"\n"
+		"  -w, --duty <duty_in_percents>\n"
+		"        Set PWM duty cycle in percents (0-100).\n"
+		"        Default: %u\n"
+		"\n"
+		"  --polarity <normal|inversed>\n"
+		"        Set PWM output polarity.\n"
+		"        Default: keep current polarity\n"
+		"\n"
 		"  -k, --keep-enabled\n"
 		"        If specified, PWM will remain enabled on exit.\n"
 		"        Default: disable PWM on exit\n"
@@ -157,13 +384,121 @@ static void display_usage(void)
 		"  -s, --script <script>\n"
 		"        Run PWM commands script.\n"
 		"\n"
+		"  -m, --melody <rtttl>\n"
+		"        Play melody in RTTTL format\n"
+		"        (e.g. \"Beep:d=8,o=6,b=120:c,e,g,2c7\").\n"
+		"\n"
+		"  --pattern <name>\n"
+		"        Play pattern from the precompiled patterns library.\n"
+		"\n"
+		"  --pattern-file <file>\n"
+		"        Set precompiled patterns library file.\n"
+		"        Default: %s\n"
+		"\n"
+		"  --compile <file>\n"
+		"        Compile patterns read from stdin into the patterns\n"
+		"        library file and exit. Each line is a pattern name\n"
+		"        followed by the script or by the melody prefixed\n"
+		"        with \"melody:\". Empty lines and lines starting\n"
+		"        with '#' are ignored.\n"
+		"\n"
+		"  -r, --restore\n"
+		"        Restore PWM channel state found at start on exit\n"
+		"        (also on interruption by SIGINT, SIGTERM, SIGHUP).\n"
+		"        Overrides --keep-enabled option.\n"
+		"\n"
+		"  --fast-start\n"
+		"        Open only the PWM channel control files used by\n"
+		"        the script, on first use, and read the current\n"
+		"        PWM channel state only when it is needed.\n"
+		"        Ignored with --restore option.\n"
+		"\n"
+		"  --overrun <catch-up|skip|stretch|abort>\n"
+		"        Set policy for the commands started late (e.g.\n"
+		"        after a stalled sysfs write): shorten them to catch\n"
+		"        up, skip the commands which time is over, shift the\n"
+		"        following commands or abort execution.\n"
+		"        Default: catch-up\n"
+		"\n"
+		"  --overrun-tolerance <delay_in_us>\n"
+		"        Set command start delay in microseconds which is\n"
+		"        not considered as a missed deadline.\n"
+		"        Default: %u\n"
+		"\n"
+		"  --stats\n"
+		"        Print number of the missed deadlines and total\n"
+		"        drift on exit (number of the wakeups per second\n"
+		"        with --engine option).\n"
+		"\n"
+		"  --engine <chip>:<channel>:<script>\n"
+		"        Play the script in endless loop on the PWM channel\n"
+		"        until interrupted by SIGINT, SIGTERM or SIGHUP.\n"
+		"        Can be specified up to %u times, the scripts of\n"
+		"        all channels are played in a single thread.\n"
+		"\n"
+		"  --coalesce <tolerance_in_ms>\n"
+		"        Start the --engine commands which are due within\n"
+		"        the tolerance with a single wakeup.\n"
+		"        Default: 0\n"
+		"\n"
+		"  --timer-slack <slack_in_us>\n"
+		"        Allow the kernel to delay the --engine wakeups by\n"
+		"        up to the slack to merge them with other timers.\n"
+		"        Default: keep current timer slack\n"
+		"\n"
+		"  --apply <file>\n"
+		"        Set the states of the PWM channels listed in the\n"
+		"        file and exit. Channels of different chips are\n"
+		"        configured in parallel. Each line is a channel\n"
+		"        (\"<chip>:<channel>\", chip can be a name) followed\n"
+		"        by the space-separated attributes: enable=<0|1>,\n"
+		"        frequency=<hz>, period=<ns>, duty=<percent>,\n"
+		"        duty_ns=<ns>, polarity=<normal|inversed>.\n"
+		"        Empty lines and lines starting with '#' are ignored.\n"
+		"\n"
+		"  -l, --list\n"
+		"        List available PWM chips and exit.\n"
+		"\n"
+		"  --export-timeout <timeout_in_ms>\n"
+		"        Set timeout in milliseconds for waiting of the\n"
+		"        PWM channel after exporting.\n"
+		"        Default: %u\n"
+		"\n"
+		"  --sysfs-root <path>\n"
+		"        Set sysfs PWM root folder.\n"
+		"        Default: $" PWM_ENV_SYSFS_ROOT " or /sys/class/pwm\n"
+		"\n"
+		"  --trace <file>\n"
+		"        Save execution trace (PWM writes, sleeps and\n"
+		"        signals) to the file in Chrome trace format.\n"
+		"\n"
+		"  --metrics <file>\n"
+		"        Save metrics (scripts, PWM writes and write errors,\n"
+		"        sleeps lateness, engine wakeups) to the file in\n"
+		"        Prometheus text format periodically and on exit.\n"
+		"\n"
+		"  --metrics-interval <interval_in_ms>\n"
+		"        Set --metrics file update interval in milliseconds\n"
+		"        (0 to save only on exit).\n"
+		"        Default: %u\n"
+		"\n"
+		"  --metrics-shm <file>\n"
+		"        Keep metrics in the shared memory file (e.g. in\n"
+		"        /dev/shm) which can be read by other processes.\n"
+		"\n"
 		"  --version\n"
 		"        Display PWM tool version.\n"
 		"\n",
 		DEFAULT_PWM_CHIP,
 		DEFAULT_PWM_CHANNEL,
 		DEFAULT_PWM_FREQUENCY_HZ,
-		DEFAULT_PWM_DURATION_MS
+		DEFAULT_PWM_DURATION_MS,
+		DEFAULT_PWM_DUTY_PERCENT,
+		DEFAULT_PWM_PATTERN_FILE,
+		PWM_OVERRUN_TOLERANCE_US,
+		PWM_ENGINE_CHANNELS_MAX,
+		PWM_EXPORT_TIMEOUT_MS,
+		DEFAULT_PWM_METRICS_INTERVAL_MS
 	);
 }
 
@@ -199,6 +534,10 @@ static int parse_cli_args(int argc, char *argv[])
 					(unsigned int)strtoul(optarg, NULL, 0);
 				break;
 
+			case 'n': /* --name */
+				config.name = optarg;
+				break;
+
 			case 'f': /* --frequency */
 				config.frequency_hz =
 					(unsigned int)strtoul(optarg, NULL, 0);
@@ -209,18 +548,128 @@ static int parse_cli_args(int argc, char *argv[])
 					(unsigned int)strtoul(optarg, NULL, 0);
 				break;
 
+			case 'w': /* --duty */
+				config.duty_percent =
+					(unsigned int)strtoul(optarg, NULL, 0);
+
+				if (config.duty_percent > 100)
+					return -EINVAL;
+				break;
+
+			case 'P': /* --polarity */
+				if (!strcmp(optarg, "normal"))
+					config.polarity = PWM_POLARITY_NORMAL;
+				else if (!strcmp(optarg, "inversed"))
+					config.polarity = PWM_POLARITY_INVERSED;
+				else
+					return -EINVAL;
+				break;
+
 			case 's': /* --script */
-				config.script = strdup(optarg);
-				if (!config.script) {
-					fprintf(stderr, "ERROR: Out of memory");
-					exit(-ENOMEM);
-				}
+				config.script = optarg;
+				break;
+
+			case 'm': /* --melody */
+				config.melody = optarg;
+				break;
+
+			case 'A': /* --pattern */
+				config.pattern = optarg;
+				break;
+
+			case 'F': /* --pattern-file */
+				config.pattern_file = optarg;
+				break;
+
+			case 'C': /* --compile */
+				config.compile_file = optarg;
 				break;
 
 			case 'k': /* --keep-enabled */
 				config.keep_enabled = 1;
 				break;
 
+			case 'r': /* --restore */
+				config.restore = 1;
+				break;
+
+			case 'S': /* --fast-start */
+				config.fast_start = 1;
+				break;
+
+			case 'O': /* --overrun */
+				if (!strcmp(optarg, "catch-up"))
+					config.overrun_policy = PWM_OVERRUN_CATCH_UP;
+				else if (!strcmp(optarg, "skip"))
+					config.overrun_policy = PWM_OVERRUN_SKIP;
+				else if (!strcmp(optarg, "stretch"))
+					config.overrun_policy = PWM_OVERRUN_STRETCH;
+				else if (!strcmp(optarg, "abort"))
+					config.overrun_policy = PWM_OVERRUN_ABORT;
+				else
+					return -EINVAL;
+				break;
+
+			case 'o': /* --overrun-tolerance */
+				config.overrun_tolerance_us =
+					(unsigned int)strtoul(optarg, NULL, 0);
+				break;
+
+			case 'I': /* --stats */
+				config.stats = 1;
+				break;
+
+			case 'e': /* --engine */
+				if (config.engine_count >= PWM_ENGINE_CHANNELS_MAX)
+					return -EINVAL;
+
+				config.engine[config.engine_count++] = optarg;
+				break;
+
+			case 'W': /* --coalesce */
+				config.coalesce_ms =
+					(unsigned int)strtoul(optarg, NULL, 0);
+				break;
+
+			case 'L': /* --timer-slack */
+				config.timer_slack_us =
+					(unsigned int)strtoul(optarg, NULL, 0);
+				break;
+
+			case 'Y': /* --apply */
+				config.apply_file = optarg;
+				break;
+
+			case 'l': /* --list */
+				config.list = 1;
+				break;
+
+			case 'E': /* --export-timeout */
+				config.export_timeout_ms =
+					(unsigned int)strtoul(optarg, NULL, 0);
+				break;
+
+			case 'R': /* --sysfs-root */
+				config.sysfs_root = optarg;
+				break;
+
+			case 'T': /* --trace */
+				config.trace_file = optarg;
+				break;
+
+			case 'M': /* --metrics */
+				config.metrics_file = optarg;
+				break;
+
+			case 'N': /* --metrics-interval */
+				config.metrics_interval_ms =
+					(unsigned int)strtoul(optarg, NULL, 0);
+				break;
+
+			case 'H': /* --metrics-shm */
+				config.metrics_shm = optarg;
+				break;
+
 			case 'V': /* --version */
 				fprintf(stdout, "%s\n", PWM_VERSION);
 				exit(0);
@@ -238,16 +687,702 @@ static int parse_cli_args(int argc, char *argv[])
  */
 static void handle_signal(int signal)
 {
+	if (trace_events)
+		pwm_trace_signal(&trace, signal);
+
 	exit_flag = 1;
 }
 
+/**
+ * Metrics file writer thread
+ */
+static void *metrics_writer(void *arg)
+{
+	struct timespec ts;
+
+	(void)arg;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	pthread_mutex_lock(&metrics_lock);
+
+	while (!metrics_stop) {
+		ts.tv_sec  += config.metrics_interval_ms / 1000;
+		ts.tv_nsec += (config.metrics_interval_ms % 1000) * 1000000L;
+		if (ts.tv_nsec >= 1000000000L) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000L;
+		}
+
+		while (!metrics_stop &&
+		       (pthread_cond_timedwait(&metrics_cond, &metrics_lock, &ts) == 0));
+
+		if (metrics_stop)
+			break;
+
+		pthread_mutex_unlock(&metrics_lock);
+
+		if (pwm_metrics_save(metrics, config.metrics_file) != PWM_E_OK) {
+			fprintf(stderr, "ERROR: Can't save metrics to '%s'\n",
+				config.metrics_file);
+		}
+
+		pthread_mutex_lock(&metrics_lock);
+	}
+
+	pthread_mutex_unlock(&metrics_lock);
+	return NULL;
+}
+
+/**
+ * Set up metrics (if metrics file or shared memory file is specified)
+ *
+ * @return PWM_E_OK on success
+ * @return PWM_E_IO Can't map shared memory file
+ */
+static pwm_status_t start_metrics(void)
+{
+	pthread_condattr_t attr;
+	sigset_t mask;
+	sigset_t old;
+	pwm_status_t ret;
+
+	if (config.metrics_shm) {
+		ret = pwm_metrics_map(config.metrics_shm, &metrics);
+		if (ret != PWM_E_OK) {
+			fprintf(stderr, "ERROR: Can't map metrics to '%s': %s\n",
+				config.metrics_shm, pwm_strstatus(ret));
+			return ret;
+		}
+	}
+	else if (config.metrics_file) {
+		pwm_metrics_init(&metrics_storage);
+		metrics = &metrics_storage;
+	}
+
+	if (!config.metrics_file || !config.metrics_interval_ms)
+		return PWM_E_OK;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&metrics_cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	/* Signals are handled by the main thread to interrupt the sleeps */
+	sigfillset(&mask);
+	pthread_sigmask(SIG_BLOCK, &mask, &old);
+	metrics_threaded = !pthread_create(&metrics_thread, NULL,
+		metrics_writer, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	return PWM_E_OK;
+}
+
+/**
+ * Allocate execution trace storage (if trace file is specified).
+ * In the zero-heap build the storage takes at most a quarter of
+ * the free arena space, the rest is left for the script.
+ *
+ * @return PWM_E_OK on success
+ * @return PWM_E_NO_MEMORY Out of memory
+ */
+static pwm_status_t start_trace(void)
+{
+	size_t capacity = DEFAULT_PWM_TRACE_EVENTS;
+	pwm_trace_event_t *events;
+#ifdef PWM_NO_HEAP
+	pwm_arena_stats_t stats;
+	size_t max;
+
+	pwm_arena_get_stats(pwm_arena_get_default(), &stats);
+	max = (stats.size - stats.used) / 4 / sizeof(pwm_trace_event_t);
+
+	if (capacity > max)
+		capacity = max;
+#endif
+
+	if (!config.trace_file)
+		return PWM_E_OK;
+
+	/* Storage is touched in advance to avoid page faults in tracing */
+	events = capacity
+		? mem_resize(NULL, 0, capacity * sizeof(pwm_trace_event_t))
+		: NULL;
+
+	if (!events) {
+		fprintf(stderr, "ERROR: Can't allocate trace buffer: %s\n",
+			pwm_strstatus(PWM_E_NO_MEMORY));
+		return PWM_E_NO_MEMORY;
+	}
+
+	memset(events, 0, capacity * sizeof(pwm_trace_event_t));
+	pwm_trace_init(&trace, events, capacity);
+
+	trace_events = events;
+	trace_capacity = capacity;
+
+	return PWM_E_OK;
+}
+
 /**
  * Cleanup
  */
 void cleanup(void)
 {
-	if (config.script)
-		free(config.script);
+	if (metrics_threaded) {
+		pthread_mutex_lock(&metrics_lock);
+		metrics_stop = 1;
+		pthread_cond_signal(&metrics_cond);
+		pthread_mutex_unlock(&metrics_lock);
+
+		pthread_join(metrics_thread, NULL);
+		metrics_threaded = 0;
+	}
+
+	if (metrics) {
+		if (config.metrics_file &&
+		    (pwm_metrics_save(metrics, config.metrics_file) != PWM_E_OK)) {
+			fprintf(stderr, "ERROR: Can't save metrics to '%s'\n",
+				config.metrics_file);
+		}
+
+		if (config.metrics_shm)
+			pwm_metrics_unmap(metrics);
+
+		metrics = NULL;
+	}
+
+	if (trace_events) {
+		if (pwm_trace_save(&trace, config.trace_file) != PWM_E_OK) {
+			fprintf(stderr, "ERROR: Can't save trace to '%s'\n",
+				config.trace_file);
+		}
+
+		mem_free(trace_events, trace_capacity * sizeof(pwm_trace_event_t));
+		trace_events = NULL;
+	}
+
+	pwm_program_free(&melody);
+	pwm_pattern_close(&patterns);
+
+	if (config.stats && pwm_arena_get_default()) {
+		pwm_arena_stats_t stats;
+
+		pwm_arena_get_stats(pwm_arena_get_default(), &stats);
+
+		fprintf(stdout,
+			"arena_size=%zu arena_used=%zu arena_high_water=%zu "
+			"arena_failures=%lu\n",
+			stats.size, stats.used, stats.high_water, stats.failures);
+	}
+}
+
+/**
+ * Print information about single PWM chip (used in list mode)
+ */
+static int list_chip(const pwm_chip_info_t *info, void *arg)
+{
+	unsigned int ch;
+	int n = 0;
+
+	(void)arg;
+
+	fprintf(stdout, "pwmchip%u npwm=%u exported=", info->chip, info->npwm);
+
+	for (ch = 0; ch < 64; ch++) {
+		if (info->exported & (1ULL << ch))
+			fprintf(stdout, "%s%u", n++ ? "," : "", ch);
+	}
+
+	fprintf(stdout, "%s device=%s label=%s\n",
+		n ? "" : "-",
+		info->device[0] ? info->device : "-",
+		info->label[0] ? info->label : "-");
+
+	return 0;
+}
+
+/**
+ * Print library error to stderr
+ */
+static void print_error(const pwm_error_t *error, void *arg)
+{
+	(void)arg;
+
+	if (error->status == PWM_E_INVALID_COMMAND) {
+		fprintf(stderr,
+			"ERROR: %s: '%c' at position %u\n",
+			error->message, error->op, (unsigned int)error->position);
+	}
+	else if (error->status == PWM_E_NO_MEMORY) {
+		fprintf(stderr, "ERROR: %s", error->message);
+
+		if (error->position)
+			fprintf(stderr, " at position %u", (unsigned int)error->position);
+
+		fprintf(stderr, "\n");
+	}
+	else if (error->position) {
+		/* Invalid operand of the script operation */
+		fprintf(stderr, "ERROR: %s", error->message);
+
+		if (error->op)
+			fprintf(stderr, ": '%c'", error->op);
+
+		fprintf(stderr, " at position %u: %s\n",
+			(unsigned int)error->position, pwm_strstatus(error->status));
+	}
+	else {
+		fprintf(stderr,
+			"ERROR: %s %u of chip %u: %s\n",
+			error->message, error->channel, error->chip,
+			pwm_strstatus(error->status));
+	}
+}
+
+#ifndef PWM_NO_HEAP
+
+/**
+ * Compile patterns read from stdin into the patterns library file
+ * (used in compile mode)
+ *
+ * @return PWM_E_OK on success, error status otherwise
+ */
+static pwm_status_t compile_patterns(void)
+{
+	pwm_pattern_t *list = NULL;
+	pwm_program_t *programs = NULL;
+	size_t capacity = 0;
+	size_t count = 0;
+	size_t size = 0;
+	unsigned int lineno = 0;
+	pwm_status_t ret = PWM_E_OK;
+	char *line = NULL;
+	size_t i;
+
+	while (getline(&line, &size, stdin) >= 0) {
+		char *name = line;
+		char *body;
+
+		lineno++;
+		line[strcspn(line, "\r\n")] = 0;
+
+		while (isspace((unsigned char)*name))
+			name++;
+
+		if (!*name || (*name == '#'))
+			continue;
+
+		body = name + strcspn(name, " \t");
+		if (*body)
+			*body++ = 0;
+
+		while (isspace((unsigned char)*body))
+			body++;
+
+		if (count == capacity) {
+			size_t n = capacity ? capacity * 2 : 16;
+			void *p;
+
+			p = realloc(list, n * sizeof(pwm_pattern_t));
+			if (p)
+				list = p;
+
+			p = p ? realloc(programs, n * sizeof(pwm_program_t)) : NULL;
+			if (!p) {
+				fprintf(stderr, "ERROR: Out of memory\n");
+				ret = PWM_E_FAILED;
+				break;
+			}
+
+			programs = p;
+			capacity = n;
+		}
+
+		if (!strncmp(body, "melody:", 7)) {
+			ret = pwm_melody_compile(&programs[count], body + 7,
+				print_error, NULL);
+		}
+		else {
+			pwm_execute_config_t compile_config = {
+				.script               = body,
+				.default_frequency_hz = config.frequency_hz,
+				.default_duration_ms  = config.duration_ms,
+				.error_cb             = print_error,
+			};
+
+			ret = pwm_compile(&programs[count], &compile_config);
+		}
+
+		if (ret != PWM_E_OK) {
+			fprintf(stderr, "ERROR: Can't compile pattern '%s' (line %u)\n",
+				name, lineno);
+			break;
+		}
+
+		list[count].program = &programs[count];
+		list[count].name = strdup(name);
+		count++;
+
+		if (!list[count - 1].name) {
+			fprintf(stderr, "ERROR: Out of memory\n");
+			ret = PWM_E_FAILED;
+			break;
+		}
+	}
+
+	if (ret == PWM_E_OK) {
+		ret = pwm_pattern_write(config.compile_file, list, count);
+		if (ret != PWM_E_OK) {
+			fprintf(stderr,
+				"ERROR: Can't write patterns library '%s': %s\n",
+				config.compile_file, ret == PWM_E_FAILED
+					? "Invalid or duplicate pattern name"
+					: pwm_strstatus(ret));
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		free((char *)list[i].name);
+		pwm_program_free(&programs[i]);
+	}
+
+	free(programs);
+	free(list);
+	free(line);
+
+	return ret;
+}
+
+#endif /* PWM_NO_HEAP */
+
+/**
+ * Parse channel state line of the apply file
+ *
+ * @return 0 on success
+ * @return <0 on error
+ */
+static int parse_apply_line(char *line, pwm_apply_entry_t *entry)
+{
+	unsigned int duty_percent = config.duty_percent;
+	int has_duty_ns = 0;
+	int has_duty = 0;
+	char *token;
+	char *value;
+	char *end;
+
+	memset(entry, 0, sizeof(pwm_apply_entry_t));
+	entry->state.enabled = 1;
+
+	token = strtok(line, " \t");
+
+	/* Chip name may contain ':', channel is after the last one */
+	value = strrchr(token, ':');
+	if (!value)
+		return -EINVAL;
+
+	*value++ = 0;
+
+	entry->channel = (unsigned int)strtoul(value, &end, 0);
+	if ((end == value) || *end)
+		return -EINVAL;
+
+	entry->chip = (unsigned int)strtoul(token, &end, 0);
+	if ((end == token) || *end) {
+		if (pwm_chip_lookup(token, &entry->chip) != PWM_E_OK)
+			return -ENODEV;
+	}
+
+	while ((token = strtok(NULL, " \t")) != NULL) {
+		value = strchr(token, '=');
+		if (!value)
+			return -EINVAL;
+
+		*value++ = 0;
+
+		if (!strcmp(token, "polarity")) {
+			if (!strcmp(value, "normal"))
+				entry->state.polarity = PWM_POLARITY_NORMAL;
+			else if (!strcmp(value, "inversed"))
+				entry->state.polarity = PWM_POLARITY_INVERSED;
+			else
+				return -EINVAL;
+
+			entry->flags |= PWM_APPLY_FLAG_POLARITY;
+			continue;
+		}
+
+		unsigned long number = strtoul(value, &end, 0);
+		if ((end == value) || *end)
+			return -EINVAL;
+
+		if (!strcmp(token, "enable")) {
+			entry->state.enabled = !!number;
+		}
+		else if (!strcmp(token, "frequency")) {
+			if ((number < 1) || (number > 500000000))
+				return -EINVAL;
+
+			entry->state.period = (unsigned int)
+				((1000000000UL + number / 2) / number);
+			entry->flags |= PWM_APPLY_FLAG_PERIOD;
+		}
+		else if (!strcmp(token, "period")) {
+			entry->state.period = (unsigned int)number;
+			entry->flags |= PWM_APPLY_FLAG_PERIOD;
+		}
+		else if (!strcmp(token, "duty")) {
+			if (number > 100)
+				return -EINVAL;
+
+			duty_percent = (unsigned int)number;
+			has_duty_ns = 0;
+			has_duty = 1;
+		}
+		else if (!strcmp(token, "duty_ns")) {
+			entry->state.duty_cycle = (unsigned int)number;
+			has_duty_ns = 1;
+			has_duty = 1;
+		}
+		else {
+			return -EINVAL;
+		}
+	}
+
+	if (entry->flags & PWM_APPLY_FLAG_PERIOD) {
+		if (!has_duty_ns) {
+			entry->state.duty_cycle = (unsigned int)
+				(((unsigned long long)entry->state.period *
+					duty_percent + 50) / 100);
+		}
+
+		if (entry->state.duty_cycle > entry->state.period)
+			return -EINVAL;
+	}
+	else if (has_duty) {
+		/* Duty cycle requires the period */
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/**
+ * Set the states of the PWM channels listed in the file
+ * (used in apply mode)
+ *
+ * @return PWM_E_OK on success, error status otherwise
+ */
+static pwm_status_t apply_states(void)
+{
+	pwm_apply_entry_t *entries = NULL;
+	size_t capacity = 0;
+	size_t count = 0;
+	unsigned int lineno = 0;
+	unsigned int failed = 0;
+	struct timespec start;
+	struct timespec end;
+	pwm_status_t ret = PWM_E_OK;
+	char line[DEFAULT_PWM_APPLY_LINE_MAX];
+	char *p;
+	FILE *file;
+	size_t i;
+
+	file = fopen(config.apply_file, "r");
+	if (!file) {
+		fprintf(stderr, "ERROR: Can't open '%s'\n", config.apply_file);
+		return PWM_E_IO;
+	}
+
+	while (fgets(line, sizeof(line), file)) {
+		lineno++;
+
+		if (!strchr(line, '\n') && !feof(file)) {
+			fprintf(stderr, "ERROR: Line is too long (line %u)\n", lineno);
+			ret = PWM_E_FAILED;
+			break;
+		}
+
+		line[strcspn(line, "\r\n#")] = 0;
+
+		p = line;
+		while (isspace((unsigned char)*p))
+			p++;
+
+		if (!*p)
+			continue;
+
+		if (count == capacity) {
+			size_t n = capacity ? capacity * 2 : 32;
+			void *e = mem_resize(entries,
+				capacity * sizeof(pwm_apply_entry_t),
+				n * sizeof(pwm_apply_entry_t));
+
+			if (!e) {
+				fprintf(stderr, "ERROR: Out of memory\n");
+				ret = PWM_E_FAILED;
+				break;
+			}
+
+			entries = e;
+			capacity = n;
+		}
+
+		if (parse_apply_line(p, &entries[count])) {
+			fprintf(stderr, "ERROR: Invalid channel state (line %u)\n",
+				lineno);
+			ret = PWM_E_FAILED;
+			break;
+		}
+
+		count++;
+	}
+
+	fclose(file);
+
+	if (ret == PWM_E_OK) {
+		pwm_apply_config_t apply_config = {
+			.export_timeout_ms = config.export_timeout_ms,
+			.error_cb          = print_error,
+		};
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		ret = pwm_apply(entries, count, &apply_config);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		for (i = 0; i < count; i++) {
+			fprintf(stdout, "pwmchip%u/pwm%u elapsed_us=%llu status=%u\n",
+				entries[i].chip, entries[i].channel,
+				entries[i].elapsed_ns / 1000, entries[i].status);
+
+			if (entries[i].status != PWM_E_OK)
+				failed++;
+		}
+
+		fprintf(stdout, "channels=%u failed=%u total_us=%llu\n",
+			(unsigned int)count, failed,
+			((unsigned long long)(end.tv_sec - start.tv_sec) * 1000000000ULL +
+				end.tv_nsec - start.tv_nsec) / 1000);
+	}
+
+	mem_free(entries, capacity * sizeof(pwm_apply_entry_t));
+	return ret;
+}
+
+/**
+ * Play scripts on several PWM channels with the pattern engine
+ * (used in engine mode)
+ *
+ * @return Engine status (PWM_E_INTR if interrupted by signal)
+ */
+static pwm_status_t run_engine(void)
+{
+	pwm_engine_channel_t channels[PWM_ENGINE_CHANNELS_MAX];
+	pwm_program_t programs[PWM_ENGINE_CHANNELS_MAX];
+	pwm_t pwms[PWM_ENGINE_CHANNELS_MAX];
+	pwm_engine_stats_t stats;
+	pwm_status_t ret = PWM_E_OK;
+	unsigned int compiled = 0;
+	unsigned int opened = 0;
+	unsigned int chip[PWM_ENGINE_CHANNELS_MAX];
+	unsigned int channel[PWM_ENGINE_CHANNELS_MAX];
+	unsigned long long rate;
+	unsigned int i;
+	char *end;
+
+	/* Syntax errors are reported before any PWM changes */
+	for (; compiled < config.engine_count; compiled++) {
+		const char *spec = config.engine[compiled];
+
+		chip[compiled] = (unsigned int)strtoul(spec, &end, 0);
+		if ((end != spec) && (*end == ':')) {
+			spec = end + 1;
+			channel[compiled] = (unsigned int)strtoul(spec, &end, 0);
+		}
+
+		if ((end == spec) || (*end != ':')) {
+			fprintf(stderr, "ERROR: Invalid engine channel '%s'\n",
+				config.engine[compiled]);
+			ret = PWM_E_FAILED;
+			goto out;
+		}
+
+		pwm_execute_config_t compile_config = {
+			.script               = end + 1,
+			.default_frequency_hz = config.frequency_hz,
+			.default_duration_ms  = config.duration_ms,
+			.error_cb             = print_error,
+		};
+
+		ret = pwm_compile(&programs[compiled], &compile_config);
+		if (ret != PWM_E_OK)
+			goto out;
+	}
+
+	for (; opened < config.engine_count; opened++) {
+		pwm_open_config_t pwm_open_config = {
+			.chip              = chip[opened],
+			.channel           = channel[opened],
+			.flags             = PWM_FLAG_EXPORT |
+			                     (config.restore ? PWM_FLAG_RESTORE : 0) |
+			                     (config.fast_start ? PWM_FLAG_LAZY : 0),
+			.export_timeout_ms = config.export_timeout_ms,
+		};
+
+		ret = pwm_open_ext(&pwms[opened], &pwm_open_config);
+		if (ret != PWM_E_OK) {
+			fprintf(stderr,
+				"ERROR: Can't open PWM channel %u of chip %u: %s\n",
+				channel[opened], chip[opened], pwm_strstatus(ret));
+			goto out;
+		}
+
+		pwm_metrics_attach(&pwms[opened], metrics);
+
+		channels[opened].pwm     = &pwms[opened];
+		channels[opened].program = &programs[opened];
+	}
+
+	pwm_engine_config_t engine_config = {
+		.channels     =  channels,
+		.count        =  config.engine_count,
+		.tolerance_ms =  config.coalesce_ms,
+		.slack_us     =  config.timer_slack_us,
+		.stop_flag    = &exit_flag,
+		.error_cb     =  print_error,
+		.stats        = &stats,
+		.metrics      =  metrics,
+	};
+
+	ret = pwm_engine_run(&engine_config);
+
+	if ((ret == PWM_E_INVALID_DURATION) || (ret == PWM_E_FAILED)) {
+		fprintf(stderr, "ERROR: Can't run pattern engine: %s\n",
+			pwm_strstatus(ret));
+	}
+	else if (config.stats) {
+		rate = stats.elapsed_ns
+			? stats.wakeups * 100000000000ULL / stats.elapsed_ns : 0;
+
+		fprintf(stdout,
+			"wakeups=%llu events=%llu coalesced=%llu "
+			"wakeups_per_sec=%llu.%02llu max_late_us=%llu\n",
+			stats.wakeups, stats.events, stats.coalesced,
+			rate / 100, rate % 100, stats.max_late_ns / 1000);
+	}
+
+out:
+	for (i = 0; i < opened; i++) {
+		if ((pwm_close(&pwms[i]) != PWM_E_OK) && config.restore) {
+			fprintf(stderr,
+				"ERROR: Can't restore PWM channel %u of chip %u state\n",
+				channel[i], chip[i]);
+		}
+	}
+
+	for (i = 0; i < compiled; i++)
+		pwm_program_free(&programs[i]);
+
+	return ret;
 }
 
 /**
@@ -262,6 +1397,8 @@ void cleanup(void)
 int main(int argc, char *argv[])
 {
 	pwm_status_t ret = 0;
+	pwm_execute_stats_t stats;
+	char script[32];
 	pwm_t pwm;
 
 	if (parse_cli_args(argc, argv)) {
@@ -272,8 +1409,90 @@ int main(int argc, char *argv[])
 	atexit(cleanup);
 
 	signal(SIGINT, handle_signal);
+	signal(SIGTERM, handle_signal);
+	signal(SIGHUP, handle_signal);
+
+	if (config.sysfs_root)
+		pwm_set_sysfs_root(config.sysfs_root);
+
+	if (config.list) {
+		ret = pwm_chip_list(list_chip, NULL);
+		if (ret != PWM_E_OK) {
+			fprintf(stderr, "ERROR: Can't list PWM chips: %s\n",
+				pwm_strstatus(ret));
+		}
+
+		exit(ret);
+	}
+
+	if (config.compile_file) {
+#ifdef PWM_NO_HEAP
+		/* Patterns libraries are compiled on the host */
+		fprintf(stderr, "ERROR: Can't compile patterns: %s\n",
+			pwm_strstatus(PWM_E_NOT_SUPPORTED));
+		exit(PWM_E_NOT_SUPPORTED);
+#else
+		exit(compile_patterns());
+#endif
+	}
+
+	ret = start_metrics();
+	if (ret != PWM_E_OK)
+		exit(ret);
 
-	ret = pwm_open(&pwm, config.chip, config.channel, PWM_FLAG_EXPORT);
+	if (config.engine_count)
+		exit(run_engine());
+
+	if (config.apply_file)
+		exit(apply_states());
+
+	/* Syntax errors are reported before any PWM changes */
+	if (config.pattern) {
+		ret = pwm_pattern_open(&patterns, config.pattern_file);
+		if (ret != PWM_E_OK) {
+			fprintf(stderr,
+				"ERROR: Can't open patterns library '%s': %s\n",
+				config.pattern_file, pwm_strstatus(ret));
+			exit(ret);
+		}
+
+		ret = pwm_pattern_find(&patterns, config.pattern, &pattern);
+		if (ret != PWM_E_OK) {
+			fprintf(stderr, "ERROR: Can't find pattern '%s': %s\n",
+				config.pattern, pwm_strstatus(ret));
+			exit(ret);
+		}
+	}
+	else if (config.melody) {
+		ret = pwm_melody_compile(&melody, config.melody, print_error, NULL);
+		if (ret != PWM_E_OK)
+			exit(ret);
+	}
+
+	if (config.name) {
+		ret = pwm_chip_lookup(config.name, &config.chip);
+		if (ret != PWM_E_OK) {
+			fprintf(stderr,
+				"ERROR: Can't find PWM chip '%s': %s\n",
+				config.name, pwm_strstatus(ret));
+			exit(ret);
+		}
+	}
+
+	ret = start_trace();
+	if (ret != PWM_E_OK)
+		exit(ret);
+
+	pwm_open_config_t pwm_open_config = {
+		.chip              = config.chip,
+		.channel           = config.channel,
+		.flags             = PWM_FLAG_EXPORT |
+		                     (config.restore ? PWM_FLAG_RESTORE : 0) |
+		                     (config.fast_start ? PWM_FLAG_LAZY : 0),
+		.export_timeout_ms = config.export_timeout_ms,
+	};
+
+	ret = pwm_open_ext(&pwm, &pwm_open_config);
 	if (ret != PWM_E_OK) {
 		fprintf(stderr,
 			"ERROR: Can't open PWM channel %u of chip %u: %s\n",
@@ -281,23 +1500,59 @@ int main(int argc, char *argv[])
 		exit(ret);
 	}
 
+	if (config.polarity >= 0) {
+		ret = pwm_set_polarity(&pwm, (pwm_polarity_t)config.polarity);
+		if (ret != PWM_E_OK) {
+			fprintf(stderr,
+				"ERROR: Can't set PWM channel %u of chip %u polarity: %s\n",
+				config.channel, config.chip, pwm_strstatus(ret));
+			pwm_close(&pwm);
+			exit(ret);
+		}
+	}
+
+	if (trace_events)
+		pwm_trace_attach(&pwm, &trace);
+
+	pwm_metrics_attach(&pwm, metrics);
+
 	pwm_execute_config_t pwm_execute_config = {
 		.script               =  config.script,
 		.default_frequency_hz =  config.frequency_hz,
 		.default_duration_ms  =  config.duration_ms,
 		.stop_flag            = &exit_flag,
+		.error_cb             =  print_error,
+		.overrun_policy       =  config.overrun_policy,
+		.overrun_tolerance_us =  config.overrun_tolerance_us,
+		.stats                = &stats,
 	};
 
-	if (!config.script) {
-		if (config.keep_enabled)
-			pwm_execute_config.script = "fdk";
-		else
-			pwm_execute_config.script = "fd";
+	if (config.pattern) {
+		pwm_execute_config.program = &pattern;
+	}
+	else if (config.melody) {
+		pwm_execute_config.program = &melody;
+	}
+	else if (!config.script) {
+		snprintf(script, sizeof(script), "fw%ud%s",
+			config.duty_percent, config.keep_enabled ? "k" : "");
+		pwm_execute_config.script = script;
 	}
 
 	ret = pwm_execute(&pwm, &pwm_execute_config);
 
-	pwm_close(&pwm);
+	if (config.stats) {
+		fprintf(stdout,
+			"missed=%u skipped=%u drift_us=%llu max_delay_us=%llu\n",
+			stats.missed, stats.skipped,
+			stats.drift_ns / 1000, stats.max_delay_ns / 1000);
+	}
+
+	if ((pwm_close(&pwm) != PWM_E_OK) && config.restore) {
+		fprintf(stderr,
+			"ERROR: Can't restore PWM channel %u of chip %u state\n",
+			config.channel, config.chip);
+	}
 
 	exit(ret);
 }
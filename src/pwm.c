@@ -26,66 +26,41 @@
 #include <errno.h>        /* EINTR */
 #include <time.h>         /* clock_nanosleep() */
 #include <fcntl.h>        /* openat() */
-#include <math.h>         /* roundf() */
+#include <poll.h>         /* poll() */
+#include <stdint.h>       /* uint64_t */
+#include <sys/timerfd.h>  /* timerfd_create() */
+#include <sys/inotify.h>  /* inotify_init1() */
 #include <linux/limits.h> /* NAME_MAX */
 
 #include "pwm.h"
+#include "pwm_private.h"
 
 /* ----------------------------------------------------------------------- */
 
-#ifndef SYSFS_PWM_ROOT
+/** Sysfs PWM root folder set by @ref pwm_set_sysfs_root */
+static char pwm_sysfs_root[PATH_MAX];
 
-/**
- * Root in sysfs for PWM control
- *
- * Full sysfs path for specified PWM channel is:
- * <code>
- * sprintf(path, SYSFS_PWM_ROOT"/"
- *               SYSFS_PWM_CHIP_FOLDER_FMT"/"
- *               SYSFS_PWM_CH_FOLDER_FMT,
- *               chip, ch);
- * </code>
- */
-#define SYSFS_PWM_ROOT  "/sys/class/pwm"
-#endif
-
-#ifndef SYSFS_PWM_CHIP_FOLDER_FMT
-
-/**
- * Format for PWM chip number subfolder in sysfs
- *
- * @see SYSFS_PWM_ROOT
- */
-#define SYSFS_PWM_CHIP_FOLDER_FMT  "pwmchip%u"
-#endif
-
-#ifndef SYSFS_PWM_CH_FOLDER_FMT
-
-/**
- * Format for PWM channel number subfolder in sysfs
- *
- * @see SYSFS_PWM_ROOT
- */
-#define SYSFS_PWM_CH_FOLDER_FMT  "pwm%u"
-#endif
-
-#ifndef SYSFS_PWM_FILE_ENABLE
-
-/** File name in sysfs for control enabled state of the PWM */
-#define SYSFS_PWM_FILE_ENABLE  "enable"
-#endif
+void pwm_set_sysfs_root(const char *path)
+{
+	if (path)
+		snprintf(pwm_sysfs_root, sizeof(pwm_sysfs_root), "%s", path);
+	else
+		pwm_sysfs_root[0] = '\0';
+}
 
-#ifndef SYSFS_PWM_FILE_PERIOD
+const char *pwm_get_sysfs_root(void)
+{
+	const char *root;
 
-/** File name in sysfs for control period of the PWM */
-#define SYSFS_PWM_FILE_PERIOD  "period"
-#endif
+	if (pwm_sysfs_root[0])
+		return pwm_sysfs_root;
 
-#ifndef SYSFS_PWM_FILE_DUTY_CYCLE
+	root = secure_getenv(PWM_ENV_SYSFS_ROOT);
+	if (root && *root)
+		return root;
 
-/** File name in sysfs for control duty-cycle of the PWM */
-#define SYSFS_PWM_FILE_DUTY_CYCLE  "duty_cycle"
-#endif
+	return SYSFS_PWM_ROOT;
+}
 
 /* ----------------------------------------------------------------------- */
 
@@ -94,7 +69,7 @@ static pwm_status_t pwm_export(
 	unsigned int channel
 )
 {
-	int fd_export = openat(chip_fd, "export", O_WRONLY);
+	int fd_export = openat(chip_fd, SYSFS_PWM_FILE_EXPORT, O_WRONLY);
 	if (fd_export < 0)
 		return PWM_E_EXPORT_FAILED;
 
@@ -111,59 +86,350 @@ static pwm_status_t pwm_export(
 	return PWM_E_OK;
 }
 
-static pwm_status_t pwm_state_read(pwm_t *pwm)
+/**
+ * Read PWM attribute value. The file offset is not changed.
+ */
+static int pwm_attr_read(int fd, unsigned int *value)
 {
 	char buffer[16];
 	ssize_t size;
 
-	size = read(pwm->fd_enable, buffer, sizeof(buffer));
+	size = pread(fd, buffer, sizeof(buffer) - 1, 0);
 	if (size <= 0)
-		return PWM_E_IO;
+		return -1;
 
 	buffer[size] = '\0';
-	pwm->enabled = !!strtoul(buffer, NULL, 10);
+	*value = (unsigned int)strtoul(buffer, NULL, 10);
+
+	return 0;
+}
+
+/**
+ * Read PWM polarity attribute value. The file offset is not changed.
+ */
+static int pwm_polarity_read(int fd, pwm_polarity_t *polarity)
+{
+	char buffer[16];
+	ssize_t size;
 
-	size = read(pwm->fd_period, buffer, sizeof(buffer));
+	size = pread(fd, buffer, sizeof(buffer) - 1, 0);
 	if (size <= 0)
-		return PWM_E_IO;
+		return -1;
 
 	buffer[size] = '\0';
-	pwm->period = (unsigned int)strtoul(buffer, NULL, 10);
+	*polarity = strncmp(buffer, "inversed", 8)
+		? PWM_POLARITY_NORMAL : PWM_POLARITY_INVERSED;
 
-	size = read(pwm->fd_dutycycle, buffer, sizeof(buffer));
-	if (size <= 0)
+	return 0;
+}
+
+/**
+ * Get PWM attribute file handle. The control file is opened
+ * on first use if the PWM channel folder is kept open.
+ *
+ * @return File handle or -1 if the file can't be opened
+ */
+static int pwm_attr_fd(pwm_t *pwm, pwm_attr_t attr)
+{
+	static const char *files[] = {
+		[PWM_ATTR_ENABLE]     = SYSFS_PWM_FILE_ENABLE,
+		[PWM_ATTR_PERIOD]     = SYSFS_PWM_FILE_PERIOD,
+		[PWM_ATTR_DUTY_CYCLE] = SYSFS_PWM_FILE_DUTY_CYCLE,
+		[PWM_ATTR_POLARITY]   = SYSFS_PWM_FILE_POLARITY,
+	};
+
+	int *fd;
+
+	switch (attr) {
+		case PWM_ATTR_ENABLE:
+			fd = &pwm->fd_enable;
+			break;
+
+		case PWM_ATTR_PERIOD:
+			fd = &pwm->fd_period;
+			break;
+
+		case PWM_ATTR_POLARITY:
+			fd = &pwm->fd_polarity;
+			break;
+
+		default:
+			fd = &pwm->fd_dutycycle;
+			break;
+	}
+
+	if ((*fd < 0) && (pwm->fd_channel >= 0))
+		*fd = openat(pwm->fd_channel, files[attr], O_RDWR);
+
+	return *fd;
+}
+
+/**
+ * Read PWM attributes which values are not known yet
+ *
+ * @param[in] pwm  Pointer to the PWM handle structure
+ * @param[in] mask Mask of the needed attributes
+ */
+static pwm_status_t pwm_state_sync(pwm_t *pwm, unsigned int mask)
+{
+	mask &= pwm->unknown;
+
+	if ((mask & PWM_ATTR_BIT(PWM_ATTR_ENABLE)) &&
+	    pwm_attr_read(pwm_attr_fd(pwm, PWM_ATTR_ENABLE), &pwm->enabled))
 		return PWM_E_IO;
 
-	buffer[size] = '\0';
-	pwm->duty_cycle = (unsigned int)strtoul(buffer, NULL, 10);
+	if ((mask & PWM_ATTR_BIT(PWM_ATTR_PERIOD)) &&
+	    pwm_attr_read(pwm_attr_fd(pwm, PWM_ATTR_PERIOD), &pwm->period))
+		return PWM_E_IO;
+
+	if ((mask & PWM_ATTR_BIT(PWM_ATTR_DUTY_CYCLE)) &&
+	    pwm_attr_read(pwm_attr_fd(pwm, PWM_ATTR_DUTY_CYCLE),
+	        &pwm->duty_cycle))
+		return PWM_E_IO;
+
+	pwm->enabled = !!pwm->enabled;
+
+	/* Polarity control is optional */
+	if (mask & PWM_ATTR_BIT(PWM_ATTR_POLARITY)) {
+		int fd = pwm_attr_fd(pwm, PWM_ATTR_POLARITY);
+
+		pwm->polarity = PWM_POLARITY_NORMAL;
+
+		if ((fd >= 0) && pwm_polarity_read(fd, &pwm->polarity))
+			return PWM_E_IO;
+	}
+
+	pwm->unknown &= ~mask;
+
+	return PWM_E_OK;
+}
+
+/**
+ * Read PWM channel state and save it as the snapshot
+ */
+static pwm_status_t pwm_state_read(pwm_t *pwm)
+{
+	if (pwm_state_sync(pwm, PWM_ATTR_ALL) != PWM_E_OK)
+		return PWM_E_IO;
+
+	pwm->saved.enabled    = pwm->enabled;
+	pwm->saved.period     = pwm->period;
+	pwm->saved.duty_cycle = pwm->duty_cycle;
+	pwm->saved.polarity   = pwm->polarity;
 
 	return PWM_E_OK;
 }
 
 /* ----------------------------------------------------------------------- */
 
+/**
+ * Get remaining time in milliseconds (rounded up)
+ * until the specified deadline
+ */
+static int pwm_remaining_ms(const struct timespec *deadline)
+{
+	struct timespec now;
+	long long ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	ns = (long long)(deadline->tv_sec - now.tv_sec) * 1000000000LL +
+		(deadline->tv_nsec - now.tv_nsec);
+
+	if (ns <= 0)
+		return 0;
+
+	return (int)((ns + 999999LL) / 1000000LL);
+}
+
+/**
+ * Wait for inotify events until the specified deadline.
+ *
+ * Kernel does not generate inotify events for the sysfs nodes
+ * it creates by itself, so the waiting is also limited by the
+ * @ref PWM_EXPORT_RECHECK_MS interval.
+ *
+ * @return 0 Events received or recheck interval expired
+ * @return <0 Deadline expired
+ */
+static int pwm_inotify_wait(int inotify_fd, const struct timespec *deadline)
+{
+	char buffer[sizeof(struct inotify_event) + NAME_MAX + 1]
+		__attribute__((aligned(__alignof__(struct inotify_event))));
+
+	struct pollfd pfd = { .fd = inotify_fd, .events = POLLIN };
+	int timeout = pwm_remaining_ms(deadline);
+
+	if (timeout <= 0)
+		return -1;
+
+	if (timeout > PWM_EXPORT_RECHECK_MS)
+		timeout = PWM_EXPORT_RECHECK_MS;
+
+	if (poll(&pfd, 1, timeout) > 0) {
+		/* Only the fact of changes is important */
+		while (read(inotify_fd, buffer, sizeof(buffer)) > 0);
+	}
+
+	return 0;
+}
+
+/**
+ * Check that all PWM channel control files are
+ * created and accessible for reading and writing
+ */
+static int pwm_channel_ready(int channel_fd)
+{
+	static const char *files[] = {
+		SYSFS_PWM_FILE_ENABLE,
+		SYSFS_PWM_FILE_PERIOD,
+		SYSFS_PWM_FILE_DUTY_CYCLE,
+	};
+
+	unsigned int i;
+
+	for (i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+		if (faccessat(channel_fd, files[i], R_OK | W_OK, AT_EACCESS))
+			return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Export PWM channel and wait for its folder and control files
+ *
+ * @return PWM channel folder file descriptor
+ * @return <0 on failure
+ */
+static int pwm_channel_export(
+	int chip_fd,
+	const char *chip_path,
+	const char *channel_folder,
+	const pwm_open_config_t *config
+)
+{
+	int inotify_fd = -1;
+	int channel_fd = -1;
+	struct timespec deadline;
+	char path[PATH_MAX + NAME_MAX + 1];
+
+	/* Watch must be added before exporting to not miss events */
+	if (config->export_timeout_ms) {
+		inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (inotify_fd >= 0) {
+			if (inotify_add_watch(inotify_fd, chip_path,
+					IN_CREATE | IN_MOVED_TO) < 0) {
+				close(inotify_fd);
+				inotify_fd = -1;
+			}
+		}
+	}
+
+	/* Channel may be already exported and still being set up */
+	if ((pwm_export(chip_fd, config->channel) != PWM_E_OK) &&
+	    (errno != EBUSY))
+		goto out;
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec  += config->export_timeout_ms / 1000;
+	deadline.tv_nsec += (config->export_timeout_ms % 1000) * 1000000L;
+
+	if (deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_nsec -= 1000000000L;
+		deadline.tv_sec++;
+	}
+
+	/* Wait for channel folder */
+	while ((channel_fd = openat(chip_fd, channel_folder,
+			O_PATH | O_DIRECTORY)) < 0) {
+		if ((inotify_fd < 0) || pwm_inotify_wait(inotify_fd, &deadline))
+			goto out;
+	}
+
+	if (inotify_fd < 0)
+		goto out;
+
+	/* Wait for control files (udev may still be fixing permissions) */
+	snprintf(path, sizeof(path), "%s/%s", chip_path, channel_folder);
+	inotify_add_watch(inotify_fd, path,
+		IN_CREATE | IN_MOVED_TO | IN_ATTRIB);
+
+	while (!pwm_channel_ready(channel_fd)) {
+		if (pwm_inotify_wait(inotify_fd, &deadline))
+			break;
+	}
+
+out:
+	if (inotify_fd >= 0)
+		close(inotify_fd);
+
+	return channel_fd;
+}
+
+/* ----------------------------------------------------------------------- */
+
 pwm_status_t pwm_open(
 	pwm_t *pwm,
 	unsigned int chip,
 	unsigned int channel,
 	unsigned int flags
 )
+{
+	pwm_open_config_t config = {
+		.chip              = chip,
+		.channel           = channel,
+		.flags             = flags,
+		.export_timeout_ms = PWM_EXPORT_TIMEOUT_MS,
+	};
+
+	return pwm_open_ext(pwm, &config);
+}
+
+pwm_status_t pwm_open_ext(
+	pwm_t *pwm,
+	const pwm_open_config_t *config
+)
 {
 	int pwm_root_fd;
 	int pwm_chip_fd;
 	int pwm_channel_fd;
 	pwm_status_t ret;
 
+	char chip_path[PATH_MAX];
 	char filename[NAME_MAX];
 
 	memset(pwm, 0, sizeof(pwm_t));
 
-	pwm->chip = chip;
-	pwm->channel = channel;
-	pwm->flags = flags;
+	pwm->chip = config->chip;
+	pwm->channel = config->channel;
+	pwm->flags = config->flags;
+
+	pwm->fd_enable    = -1;
+	pwm->fd_dutycycle = -1;
+	pwm->fd_period    = -1;
+	pwm->fd_polarity  = -1;
+	pwm->fd_unexport  = -1;
+	pwm->fd_channel   = -1;
+
+	if (pwm->flags & PWM_FLAG_RESTORE)
+		pwm->flags &= ~PWM_FLAG_LAZY;
+
+	/* Fast path: exported channel folder is opened with one call */
+	if (pwm->flags & PWM_FLAG_LAZY) {
+		snprintf(chip_path, sizeof(chip_path),
+			"%s/" SYSFS_PWM_CHIP_FOLDER_FMT "/" SYSFS_PWM_CH_FOLDER_FMT,
+			pwm_get_sysfs_root(), pwm->chip, pwm->channel);
+
+		pwm->fd_channel = open(chip_path, O_PATH | O_DIRECTORY);
+		if (pwm->fd_channel >= 0) {
+			pwm->unknown = PWM_ATTR_ALL;
+			return PWM_E_OK;
+		}
+	}
 
 	/* Open sysfs root */
-	pwm_root_fd = open(SYSFS_PWM_ROOT,
+	pwm_root_fd = open(pwm_get_sysfs_root(),
 		O_PATH | O_DIRECTORY);
 
 	if (pwm_root_fd < 0)
@@ -171,7 +437,7 @@ pwm_status_t pwm_open(
 
 	/* Open PWM chip folder */
 	snprintf(filename, sizeof(filename),
-		SYSFS_PWM_CHIP_FOLDER_FMT, chip);
+		SYSFS_PWM_CHIP_FOLDER_FMT, pwm->chip);
 	pwm_chip_fd = openat(pwm_root_fd, filename,
 		O_PATH | O_DIRECTORY);
 
@@ -182,190 +448,480 @@ pwm_status_t pwm_open(
 
 	close(pwm_root_fd);
 
+	snprintf(chip_path, sizeof(chip_path), "%s/%s",
+		pwm_get_sysfs_root(), filename);
+
 	/* Open PWM channel folder */
 	snprintf(filename, sizeof(filename),
-		SYSFS_PWM_CH_FOLDER_FMT, channel);
+		SYSFS_PWM_CH_FOLDER_FMT, pwm->channel);
 	pwm_channel_fd = openat(pwm_chip_fd, filename,
 		O_PATH | O_DIRECTORY);
 
 	if (pwm_channel_fd < 0) {
 		if (pwm->flags & PWM_FLAG_EXPORT) {
-			ret = pwm_export(
-				pwm_chip_fd, pwm->channel);
-
-			if (ret == PWM_E_OK) {
-				/* Try to open channel again after exporting */
-				pwm_channel_fd = openat(pwm_chip_fd, filename,
-					O_PATH | O_DIRECTORY);
-			}
+			pwm_channel_fd = pwm_channel_export(
+				pwm_chip_fd, chip_path, filename, config);
 		}
 
 		if (pwm_channel_fd < 0) {
 			close(pwm_chip_fd);
 			return PWM_E_NO_CHANNEL;
 		}
+
+		/* Channel is unexported on close */
+		if (pwm->flags & PWM_FLAG_RESTORE) {
+			pwm->fd_unexport = openat(pwm_chip_fd,
+				SYSFS_PWM_FILE_UNEXPORT, O_WRONLY);
+		}
 	}
 
 	close(pwm_chip_fd);
 
-	/* Open control files */
-	pwm->fd_enable = openat(pwm_channel_fd,
-		SYSFS_PWM_FILE_ENABLE, O_RDWR);
-
-	if (pwm->fd_enable < 0)
-		goto failed;
+	pwm->fd_channel = pwm_channel_fd;
+	pwm->unknown = PWM_ATTR_ALL;
 
-	pwm->fd_dutycycle = openat(pwm_channel_fd,
-		SYSFS_PWM_FILE_DUTY_CYCLE, O_RDWR);
+	if (pwm->flags & PWM_FLAG_LAZY)
+		return PWM_E_OK;
 
-	if (pwm->fd_dutycycle < 0)
+	/* Open control files, polarity control is optional */
+	if ((pwm_attr_fd(pwm, PWM_ATTR_ENABLE) < 0) ||
+	    (pwm_attr_fd(pwm, PWM_ATTR_DUTY_CYCLE) < 0) ||
+	    (pwm_attr_fd(pwm, PWM_ATTR_PERIOD) < 0))
 		goto failed;
 
-	pwm->fd_period = openat(pwm_channel_fd,
-		SYSFS_PWM_FILE_PERIOD, O_RDWR);
-
-	if (pwm->fd_period < 0)
-		goto failed;
+	pwm_attr_fd(pwm, PWM_ATTR_POLARITY);
 
 	ret = pwm_state_read(pwm);
 	if (ret != PWM_E_OK)
 		goto failed;
 
 	close(pwm_channel_fd);
+	pwm->fd_channel = -1;
+
 	return ret;
 
 failed:
-	if (pwm_channel_fd > 0)
-		close(pwm_channel_fd);
+	close(pwm_channel_fd);
 
-	if (pwm->fd_enable > 0)
+	if (pwm->fd_enable >= 0)
 		close(pwm->fd_enable);
 
-	if (pwm->fd_dutycycle > 0)
+	if (pwm->fd_dutycycle >= 0)
 		close(pwm->fd_dutycycle);
 
-	if (pwm->fd_period > 0)
+	if (pwm->fd_period >= 0)
 		close(pwm->fd_period);
 
+	if (pwm->fd_polarity >= 0)
+		close(pwm->fd_polarity);
+
+	if (pwm->fd_unexport >= 0)
+		close(pwm->fd_unexport);
+
 	return PWM_E_IO;
 }
 
-static pwm_status_t pwm_enable_ext(
+/**
+ * Write PWM attribute value. All PWM attributes
+ * writes are performed (and traced) here.
+ */
+static pwm_status_t pwm_attr_write(
+	pwm_t *pwm,
+	pwm_attr_t attr,
+	unsigned int value)
+{
+	pwm_trace_event_t *ev;
+	uint64_t ts = 0;
+	ssize_t len;
+	ssize_t ret;
+	char buf[16];
+	int fd;
+	int error;
+
+	fd = pwm_attr_fd(pwm, attr);
+
+	if (attr == PWM_ATTR_POLARITY) {
+		len = snprintf(buf, sizeof(buf), "%s",
+			(value == PWM_POLARITY_INVERSED) ? "inversed" : "normal");
+	}
+	else
+		len = snprintf(buf, sizeof(buf), "%u", value);
+
+	if (pwm->trace)
+		ts = pwm_time_ns();
+
+	ret = write(fd, buf, len);
+	error = (ret == len) ? 0 : ((ret < 0) ? errno : EIO);
+
+	if (!error)
+		pwm->unknown &= ~PWM_ATTR_BIT(attr);
+
+	if (pwm->metrics)
+		pwm_metrics_write(pwm->metrics, attr, error);
+
+	if (pwm->trace) {
+		ev = pwm_trace_next(pwm->trace);
+		ev->type        = PWM_TRACE_WRITE;
+		ev->ts_ns       = ts;
+		ev->dur_ns      = pwm_time_ns() - ts;
+		ev->chip        = pwm->chip;
+		ev->channel     = pwm->channel;
+		ev->write.attr  = attr;
+		ev->write.value = value;
+		ev->write.error = error;
+	}
+
+	return error ? PWM_E_IO : PWM_E_OK;
+}
+
+/**
+ * Set period and duty-cycle. Only changed attributes are written,
+ * in the order which never makes the duty-cycle exceed the period.
+ */
+static pwm_status_t pwm_config_write(
 	pwm_t *pwm,
 	unsigned int period,
 	unsigned int duty)
 {
-	ssize_t len;
-	char buf[32];
+	if (pwm_state_sync(pwm, PWM_ATTR_BIT(PWM_ATTR_PERIOD) |
+			PWM_ATTR_BIT(PWM_ATTR_DUTY_CYCLE)) != PWM_E_OK)
+		return PWM_E_IO;
 
-	/*
-	 * Temporarily set a minimum duty-cycle to be able
-	 * to set any period, even one that is larger than
-	 * the current set duty-cycle.
-	 */
-	if (pwm->period > 0) {
-		if (write(pwm->fd_dutycycle, "0", 1) != 1)
+	/* Period goes first unless it is less than the current duty-cycle */
+	if ((period != pwm->period) && (period >= pwm->duty_cycle)) {
+		if (pwm_attr_write(pwm, PWM_ATTR_PERIOD, period) != PWM_E_OK)
 			return PWM_E_IO;
+
+		pwm->period = period;
 	}
 
-	len = snprintf(buf, sizeof(buf), "%u", period);
-	if (write(pwm->fd_period, buf, len) != len)
-		return PWM_E_IO;
+	if (duty != pwm->duty_cycle) {
+		if (pwm_attr_write(pwm, PWM_ATTR_DUTY_CYCLE, duty) != PWM_E_OK)
+			return PWM_E_IO;
+
+		pwm->duty_cycle = duty;
+	}
 
-	pwm->period = period;
+	if (period != pwm->period) {
+		if (pwm_attr_write(pwm, PWM_ATTR_PERIOD, period) != PWM_E_OK)
+			return PWM_E_IO;
 
-	/* Set specified duty-cycle */
-	len = snprintf(buf, sizeof(buf), "%u", duty);
-	if (write(pwm->fd_dutycycle, buf, len) != len)
-		return PWM_E_IO;
+		pwm->period = period;
+	}
 
-	pwm->period = duty;
+	return PWM_E_OK;
+}
 
-	if (write(pwm->fd_enable, "1", 1) != 1)
+static pwm_status_t pwm_enable_ext(
+	pwm_t *pwm,
+	unsigned int period,
+	unsigned int duty)
+{
+	if (pwm_config_write(pwm, period, duty) != PWM_E_OK)
 		return PWM_E_IO;
 
-	pwm->enabled = 1;
+	if (!pwm->enabled || (pwm->unknown & PWM_ATTR_BIT(PWM_ATTR_ENABLE))) {
+		if (pwm_attr_write(pwm, PWM_ATTR_ENABLE, 1) != PWM_E_OK)
+			return PWM_E_IO;
+
+		pwm->enabled = 1;
+	}
 
 	return PWM_E_OK;
 }
 
-pwm_status_t pwm_enable(pwm_t *pwm, unsigned int freq)
+/**
+ * Convert frequency to the period
+ */
+static pwm_status_t pwm_freq_to_period(
+	unsigned int freq,
+	unsigned int *period)
 {
-	float fresult;
-	unsigned int period;
-	unsigned int duty;
-
 	if ((freq < 1) || (freq > 500000000))
 		return PWM_E_INVALID_FREQ;
 
-	fresult = 1000000000 / (float)freq;
-	period  = (unsigned int)(roundf(fresult));
-	duty    = (unsigned int)(roundf(period / 2.0f));
+	*period = (1000000000U + freq / 2) / freq;
 
-	return pwm_enable_ext(pwm, period, duty);
+	return PWM_E_OK;
 }
 
-pwm_status_t pwm_disable(pwm_t *pwm)
+/**
+ * Convert percentage of the period to the duty-cycle (rounded)
+ */
+static unsigned int pwm_percent_to_duty(
+	unsigned int period,
+	unsigned int percent)
 {
-	if (write(pwm->fd_enable, "0", 1) != 1)
-		return PWM_E_IO;
+	return (unsigned int)(((unsigned long long)period * percent + 50) / 100);
+}
 
-	pwm->enabled = 0;
+pwm_status_t pwm_enable(pwm_t *pwm, unsigned int freq)
+{
+	unsigned int period;
+	pwm_status_t ret;
 
-	return PWM_E_OK;
+	ret = pwm_freq_to_period(freq, &period);
+	if (ret != PWM_E_OK)
+		return ret;
+
+	return pwm_enable_ext(pwm, period, pwm_percent_to_duty(period, 50));
 }
 
-pwm_status_t pwm_close(pwm_t *pwm)
+pwm_status_t pwm_set_duty_cycle(pwm_t *pwm, unsigned int duty)
 {
-	if (pwm->fd_enable > 0)
-		close(pwm->fd_enable);
+	if (pwm_state_sync(pwm, PWM_ATTR_BIT(PWM_ATTR_PERIOD) |
+			PWM_ATTR_BIT(PWM_ATTR_DUTY_CYCLE)) != PWM_E_OK)
+		return PWM_E_IO;
 
-	if (pwm->fd_dutycycle > 0)
-		close(pwm->fd_dutycycle);
+	if (duty > pwm->period)
+		return PWM_E_INVALID_DUTY;
 
-	if (pwm->fd_period > 0)
-		close(pwm->fd_period);
+	if (duty == pwm->duty_cycle)
+		return PWM_E_OK;
+
+	if (pwm_attr_write(pwm, PWM_ATTR_DUTY_CYCLE, duty) != PWM_E_OK)
+		return PWM_E_IO;
+
+	pwm->duty_cycle = duty;
 
 	return PWM_E_OK;
 }
 
-static pwm_status_t pwm_delay_abs_time(
-	pwm_t *pwm,
-	const struct timespec *ts,
-	struct timespec *remain
-)
+pwm_status_t pwm_set_duty_percent(pwm_t *pwm, unsigned int percent)
 {
-	int ret;
+	if (percent > 100)
+		return PWM_E_INVALID_DUTY;
 
-	ret = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, ts, remain);
-	if (ret == 0)
-		return PWM_E_OK;
+	if (pwm_state_sync(pwm, PWM_ATTR_BIT(PWM_ATTR_PERIOD)) != PWM_E_OK)
+		return PWM_E_IO;
 
-	if (ret == EINTR)
-		return PWM_E_INTR;
-	else
-		return PWM_E_FAILED;
+	return pwm_set_duty_cycle(pwm,
+		pwm_percent_to_duty(pwm->period, percent));
 }
 
-const char *pwm_strstatus(const pwm_status_t status)
+pwm_status_t pwm_set_polarity(pwm_t *pwm, pwm_polarity_t polarity)
 {
-	switch (status) {
-		case PWM_E_OK:
-			return "Ok";
+	unsigned int enabled;
 
-		case PWM_E_NO_SYSFS:
-			return "PWM sysfs interface is not available";
+	if (pwm_state_sync(pwm, PWM_ATTR_BIT(PWM_ATTR_ENABLE) |
+			PWM_ATTR_BIT(PWM_ATTR_POLARITY)) != PWM_E_OK)
+		return PWM_E_IO;
 
-		case PWM_E_NO_CHIP:
-			return "PWM chip is not available";
+	enabled = pwm->enabled;
 
-		case PWM_E_NO_CHANNEL:
-			return "PWM channel is not available";
+	if (polarity == pwm->polarity)
+		return PWM_E_OK;
 
-		case PWM_E_INVALID_FREQ:
-			return "Invalid frequency";
+	if (pwm_attr_fd(pwm, PWM_ATTR_POLARITY) < 0)
+		return PWM_E_NOT_SUPPORTED;
 
-		case PWM_E_INVALID_DURATION:
+	/* Kernel rejects polarity change of the enabled PWM */
+	if (pwm_disable(pwm) != PWM_E_OK)
+		return PWM_E_IO;
+
+	if (pwm_attr_write(pwm, PWM_ATTR_POLARITY, polarity) != PWM_E_OK)
+		return PWM_E_IO;
+
+	pwm->polarity = polarity;
+
+	if (enabled) {
+		if (pwm_attr_write(pwm, PWM_ATTR_ENABLE, 1) != PWM_E_OK)
+			return PWM_E_IO;
+
+		pwm->enabled = 1;
+	}
+
+	return PWM_E_OK;
+}
+
+pwm_status_t pwm_disable(pwm_t *pwm)
+{
+	if (!pwm->enabled && !(pwm->unknown & PWM_ATTR_BIT(PWM_ATTR_ENABLE)))
+		return PWM_E_OK;
+
+	if (pwm_attr_write(pwm, PWM_ATTR_ENABLE, 0) != PWM_E_OK)
+		return PWM_E_IO;
+
+	pwm->enabled = 0;
+
+	return PWM_E_OK;
+}
+
+pwm_status_t pwm_set_state(pwm_t *pwm, const pwm_state_t *state)
+{
+	pwm_status_t ret;
+
+	/* Disable first to not produce intermediate waveforms */
+	if (!state->enabled || (state->polarity != pwm->polarity)) {
+		if (pwm_disable(pwm) != PWM_E_OK)
+			return PWM_E_IO;
+	}
+
+	ret = pwm_set_polarity(pwm, state->polarity);
+	if (ret != PWM_E_OK)
+		return ret;
+
+	if (pwm_config_write(pwm, state->period,
+			state->duty_cycle) != PWM_E_OK)
+		return PWM_E_IO;
+
+	if (state->enabled && !pwm->enabled) {
+		if (pwm_attr_write(pwm, PWM_ATTR_ENABLE, 1) != PWM_E_OK)
+			return PWM_E_IO;
+
+		pwm->enabled = 1;
+	}
+
+	return PWM_E_OK;
+}
+
+pwm_status_t pwm_restore(pwm_t *pwm)
+{
+	if (pwm_set_state(pwm, &pwm->saved) != PWM_E_OK)
+		return PWM_E_IO;
+
+	return PWM_E_OK;
+}
+
+pwm_status_t pwm_close(pwm_t *pwm)
+{
+	pwm_status_t ret = PWM_E_OK;
+	char chnum[16];
+	ssize_t size;
+
+	if (pwm->flags & PWM_FLAG_RESTORE)
+		ret = pwm_restore(pwm);
+
+	if (pwm->fd_enable >= 0)
+		close(pwm->fd_enable);
+
+	if (pwm->fd_dutycycle >= 0)
+		close(pwm->fd_dutycycle);
+
+	if (pwm->fd_period >= 0)
+		close(pwm->fd_period);
+
+	if (pwm->fd_polarity >= 0)
+		close(pwm->fd_polarity);
+
+	if (pwm->fd_channel >= 0)
+		close(pwm->fd_channel);
+
+	if (pwm->fd_unexport >= 0) {
+		size = snprintf(chnum, sizeof(chnum), "%u", pwm->channel);
+
+		if (write(pwm->fd_unexport, chnum, size) != size)
+			ret = PWM_E_IO;
+
+		close(pwm->fd_unexport);
+	}
+
+	return ret;
+}
+
+static pwm_status_t pwm_delay_abs_time(
+	pwm_t *pwm,
+	const struct timespec *ts,
+	struct timespec *remain
+)
+{
+	pwm_trace_event_t *ev;
+	uint64_t start = 0;
+	int ret;
+
+	if (pwm->trace)
+		start = pwm_time_ns();
+
+	ret = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, ts, remain);
+
+	if (pwm->metrics && !ret) {
+		uint64_t now = pwm_time_ns();
+		uint64_t deadline =
+			(uint64_t)ts->tv_sec * 1000000000ULL + (uint64_t)ts->tv_nsec;
+
+		pwm_metrics_sleep(pwm->metrics, (now > deadline) ? now - deadline : 0);
+	}
+
+	if (pwm->trace) {
+		ev = pwm_trace_next(pwm->trace);
+		ev->type              = PWM_TRACE_SLEEP;
+		ev->ts_ns             = start;
+		ev->dur_ns            = pwm_time_ns() - start;
+		ev->chip              = pwm->chip;
+		ev->channel           = pwm->channel;
+		ev->sleep.error       = ret;
+		ev->sleep.deadline_ns =
+			(uint64_t)ts->tv_sec * 1000000000ULL + (uint64_t)ts->tv_nsec;
+	}
+
+	if (ret == 0)
+		return PWM_E_OK;
+
+	if (ret == EINTR)
+		return PWM_E_INTR;
+	else
+		return PWM_E_FAILED;
+}
+
+pwm_status_t pwm_delay(pwm_t *pwm, unsigned int duration,
+	unsigned int *remain)
+{
+	struct timespec deadline;
+	struct timespec now;
+	pwm_status_t ret;
+	long long ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+	deadline.tv_sec  += duration / 1000;
+	deadline.tv_nsec += (duration % 1000) * 1000000L;
+
+	if (deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_nsec -= 1000000000L;
+		deadline.tv_sec++;
+	}
+
+	ret = pwm_delay_abs_time(pwm, &deadline, NULL);
+
+	if (remain) {
+		*remain = 0;
+
+		if (ret == PWM_E_INTR) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+
+			ns = (long long)(deadline.tv_sec - now.tv_sec) * 1000000000LL +
+				(deadline.tv_nsec - now.tv_nsec);
+
+			if (ns > 0)
+				*remain = (unsigned int)((ns + 999999) / 1000000);
+		}
+	}
+
+	return ret;
+}
+
+const char *pwm_strstatus(const pwm_status_t status)
+{
+	switch (status) {
+		case PWM_E_OK:
+			return "Ok";
+
+		case PWM_E_IO:
+			return "I/O error";
+
+		case PWM_E_NO_SYSFS:
+			return "PWM sysfs interface is not available";
+
+		case PWM_E_NO_CHIP:
+			return "PWM chip is not available";
+
+		case PWM_E_NO_CHANNEL:
+			return "PWM channel is not available";
+
+		case PWM_E_INVALID_FREQ:
+			return "Invalid frequency";
+
+		case PWM_E_INVALID_DURATION:
 			return "Invalid duration";
 
 		case PWM_E_INTR:
@@ -377,30 +933,33 @@ const char *pwm_strstatus(const pwm_status_t status)
 		case PWM_E_EXPORT_FAILED:
 			return "Exporting failure";
 
-		default:
-			return "Unknown";
-	}
-}
+		case PWM_E_AGAIN:
+			return "Operation in progress";
 
-/* ----------------------------------------------------------------------- */
+		case PWM_E_QUEUE_FULL:
+			return "Queue is full";
 
-/**
- * PWM command data structure
- */
-typedef struct {
-	/** Frequency */
-	unsigned int frequency_hz;
+		case PWM_E_INVALID_DUTY:
+			return "Invalid duty cycle";
 
-	/** Duration */
-	unsigned int duration_ms;
+		case PWM_E_NOT_SUPPORTED:
+			return "Not supported";
 
-	/** Keep enabled after command executed */
-	int keep_enabled;
+		case PWM_E_NO_PATTERN:
+			return "Pattern is not found";
 
-	/** Timestamp when command must be finished */
-	struct timespec ts_end;
+		case PWM_E_OVERRUN:
+			return "Deadline is missed";
+
+		case PWM_E_NO_MEMORY:
+			return "Out of memory";
+
+		default:
+			return "Unknown";
+	}
+}
 
-} pwm_cmd_t;
+/* ----------------------------------------------------------------------- */
 
 /**
  * PWM commands fetcher data structure
@@ -415,6 +974,45 @@ typedef struct {
 	/** Default duration (used if not specified in command) */
 	unsigned int duration_ms;
 
+	/** Default duty cycle in percents */
+	unsigned int duty_percent;
+
+	/** Sweep and fade update interval */
+	unsigned int interval_ms;
+
+	/** Output polarity (-1 if not specified yet) */
+	int polarity;
+
+	/** Sweep start frequency of the fetched command (0 if no sweep) */
+	unsigned int sweep_from_hz;
+
+	/** Sweep end frequency of the fetched command */
+	unsigned int sweep_to_hz;
+
+	/** Exponential sweep of the fetched command */
+	int sweep_exp;
+
+	/** Duty cycle of the fetched command in percents */
+	unsigned int cmd_duty_percent;
+
+	/** Duty cycle of the fetched command in ns (if cmd_duty_ns_set) */
+	unsigned int cmd_duty_ns;
+
+	/** Duty cycle of the fetched command is specified in ns */
+	int cmd_duty_ns_set;
+
+	/** Fade end duty cycle of the fetched command in percents */
+	unsigned int fade_to_percent;
+
+	/** Fetched command has duty cycle fade */
+	int fade;
+
+	/** Operand error status (PWM_E_OK for syntax errors) */
+	pwm_status_t error_status;
+
+	/** Operand error description */
+	const char *error_message;
+
 } pwm_cmd_fetcher_t;
 
 /**
@@ -424,19 +1022,128 @@ static void pwm_cmd_fetch_init(
 	pwm_cmd_fetcher_t *f,
 	const char *script,
 	unsigned int frequency_hz,
-	unsigned int duration_ms
+	unsigned int duration_ms,
+	unsigned int interval_ms
 )
 {
 	f->script = f->pos = script;
 
 	f->frequency_hz = frequency_hz;
 	f->duration_ms  = duration_ms;
+	f->duty_percent = 50;
+	f->interval_ms  = interval_ms ? interval_ms : PWM_SWEEP_INTERVAL_MS;
+	f->polarity     = -1;
+
+	f->error_status  = PWM_E_OK;
+	f->error_message = NULL;
+}
+
+/**
+ * Set operand error of the operation at the current position
+ *
+ * @return -1
+ */
+static int pwm_cmd_fetch_error(
+	pwm_cmd_fetcher_t *f,
+	pwm_status_t status,
+	const char *message
+)
+{
+	f->error_status  = status;
+	f->error_message = message;
+	return -1;
+}
+
+/**
+ * Parse sweep operation arguments (`<from>-<to>[/<ms>]`)
+ *
+ * @return 0 on success, -1 on syntax error
+ */
+static int pwm_cmd_fetch_sweep(pwm_cmd_fetcher_t *f, pwm_cmd_t *cmd)
+{
+	const char *p = f->pos + 1;
+	char *end;
+
+	if (!isdigit(p[0]))
+		return -1;
+
+	f->sweep_from_hz = (unsigned int)strtoul(p, &end, 10);
+	p = end;
+
+	if ((p[0] != '-') || !isdigit(p[1]))
+		return -1;
+
+	f->sweep_to_hz = (unsigned int)strtoul(p + 1, &end, 10);
+	p = end;
+
+	if ((p[0] == '/') && isdigit(p[1])) {
+		cmd->duration_ms = (unsigned int)strtoul(p + 1, &end, 10);
+		p = end;
+	}
+
+	if (!f->sweep_from_hz || !f->sweep_to_hz)
+		return -1;
+
+	f->sweep_exp = (f->pos[0] == 'G');
+	f->pos = p;
+
+	return 0;
+}
+
+/**
+ * Parse duty cycle operation arguments (`<percent>` or
+ * `<from>-<to>[/<ms>]` for `w`, `<percent>` for `W`)
+ *
+ * @return 0 on success, -1 on syntax error
+ */
+static int pwm_cmd_fetch_duty(pwm_cmd_fetcher_t *f, pwm_cmd_t *cmd)
+{
+	const char *p = f->pos + 1;
+	unsigned long from;
+	unsigned long to;
+	char *end;
+
+	if (!isdigit(p[0]))
+		return -1;
+
+	from = strtoul(p, &end, 10);
+	p = end;
+
+	if (from > 100)
+		return -1;
+
+	f->cmd_duty_percent = (unsigned int)from;
+	f->cmd_duty_ns_set  = 0;
+	f->fade             = 0;
+
+	if (f->pos[0] == 'W') {
+		f->duty_percent = (unsigned int)from;
+	}
+	else if ((p[0] == '-') && isdigit(p[1])) {
+		to = strtoul(p + 1, &end, 10);
+		p = end;
+
+		if (to > 100)
+			return -1;
+
+		if ((p[0] == '/') && isdigit(p[1])) {
+			cmd->duration_ms = (unsigned int)strtoul(p + 1, &end, 10);
+			p = end;
+		}
+
+		f->fade_to_percent = (unsigned int)to;
+		f->fade = 1;
+	}
+
+	f->pos = p;
+
+	return 0;
 }
 
 /**
  * Fetch single PWM command
  *
- * @return -1 Command successufully fetched.
+ * @return  1 Command successufully fetched.
  * @return  0 All commands are fetched, no more commands available.
  * @return <0 Syntax error or invalid command.
  */
@@ -449,16 +1156,21 @@ static int pwm_cmd_fetch(pwm_cmd_fetcher_t *f, pwm_cmd_t *cmd)
 	if (!*(f->pos))
 		return 0;
 
-	cmd->keep_enabled = 0;
+	cmd->flags        = 0;
 	cmd->frequency_hz = 0;
 	cmd->duration_ms  = f->duration_ms;
 
+	f->sweep_from_hz    = 0;
+	f->cmd_duty_percent = f->duty_percent;
+	f->cmd_duty_ns_set  = 0;
+	f->fade             = 0;
+
 	/* Parse operations */
 	while (f->pos[0] && !isspace(f->pos[0])) {
 		char op = f->pos[0];
 		switch(op) {
 			case 'k':
-				cmd->keep_enabled = 1;
+				cmd->flags |= PWM_CMD_FLAG_KEEP_ENABLED;
 				f->pos++;
 				break;
 
@@ -492,92 +1204,848 @@ static int pwm_cmd_fetch(pwm_cmd_fetcher_t *f, pwm_cmd_t *cmd)
 				}
 				break;
 
-			default:
-				fprintf(stderr,
-					"ERROR: Unknown command '%c' in script at position %u\n",
-					f->pos[0],
-					(unsigned int)(f->pos - f->script) + 1);
+			case 'g': /* fallthrough */
+			case 'G':
+				if (pwm_cmd_fetch_sweep(f, cmd))
+					return pwm_cmd_fetch_error(f, PWM_E_INVALID_FREQ,
+						"Invalid sweep frequency");
+				break;
+
+			case 'u':
+				if (!isdigit(f->pos[1]))
+					return pwm_cmd_fetch_error(f, PWM_E_INVALID_DURATION,
+						"Invalid update interval");
+
+				f->interval_ms =
+					(unsigned int)strtoul(f->pos + 1, (char **)&f->pos, 10);
 
+				if (!f->interval_ms)
+					f->interval_ms = PWM_SWEEP_INTERVAL_MS;
+				break;
+
+			case 'w': /* fallthrough */
+			case 'W':
+				if (pwm_cmd_fetch_duty(f, cmd))
+					return pwm_cmd_fetch_error(f, PWM_E_INVALID_DUTY,
+						"Invalid duty cycle");
+				break;
+
+			case 'n':
+				if (!isdigit(f->pos[1]))
+					return pwm_cmd_fetch_error(f, PWM_E_INVALID_DUTY,
+						"Invalid duty cycle");
+
+				f->cmd_duty_ns =
+					(unsigned int)strtoul(f->pos + 1, (char **)&f->pos, 10);
+
+				f->cmd_duty_ns_set = 1;
+				f->fade = 0;
+				break;
+
+			case 'i':
+				if ((f->pos[1] == '0') || (f->pos[1] == '1')) {
+					f->polarity = (f->pos[1] == '1')
+						? PWM_POLARITY_INVERSED : PWM_POLARITY_NORMAL;
+					f->pos += 2;
+				}
+				else {
+					f->polarity = PWM_POLARITY_INVERSED;
+					f->pos++;
+				}
+				break;
+
+			default:
+				/* f->pos points to the invalid operation */
 				return -1;
 		}
 	}
 
+	if (f->polarity >= 0) {
+		cmd->flags   |= PWM_CMD_FLAG_POLARITY;
+		cmd->polarity = (pwm_polarity_t)f->polarity;
+	}
+
 	return 1;
 }
 
 /**
- * Execute single PWM command
+ * Reserve space for the specified number of commands
+ * in the PWM commands program
+ *
+ * @return PWM_E_INVALID_DURATION Program exceeds @ref PWM_PROGRAM_STEPS_MAX
+ * @return PWM_E_NO_MEMORY Out of memory
  */
-static int pwm_cmd_execute(pwm_t *pwm, pwm_cmd_t *cmd)
+static pwm_status_t pwm_program_reserve(
+	pwm_program_t *program,
+	size_t count
+)
 {
-	pwm_status_t ret = PWM_E_OK;
+	size_t capacity = program->capacity ? program->capacity : 16;
+	pwm_cmd_t *cmds;
 
-	if (cmd->frequency_hz) {
-		ret = pwm_enable(pwm, cmd->frequency_hz);
-		if (ret != PWM_E_OK) {
-			fprintf(stderr,
-				"ERROR: Can't enable PWM channel %u of chip %u: %s\n",
-				pwm->channel, pwm->chip, pwm_strstatus(ret));
-			return ret;
-		}
-	}
-	else {
-		ret = pwm_disable(pwm);
+	if (count > PWM_PROGRAM_STEPS_MAX - program->count)
+		return PWM_E_INVALID_DURATION;
+
+	if (program->count + count <= program->capacity)
+		return PWM_E_OK;
+
+	while (capacity < program->count + count) {
+		if (capacity > SIZE_MAX / 2 / sizeof(*cmds))
+			return PWM_E_INVALID_DURATION;
+
+		capacity *= 2;
 	}
 
-	/* Sleep for specified duration */
-	if (cmd->duration_ms)
-		ret = pwm_delay_abs_time(pwm, &cmd->ts_end, NULL);
+	cmds = pwm_mem_resize(program->arena, program->cmds,
+		program->capacity * sizeof(pwm_cmd_t), capacity * sizeof(pwm_cmd_t));
+	if (!cmds)
+		return PWM_E_NO_MEMORY;
 
-	if (!cmd->keep_enabled && cmd->frequency_hz)
-		ret = pwm_disable(pwm);
+	program->cmds = cmds;
+	program->capacity = capacity;
 
-	return ret;
+	return PWM_E_OK;
 }
 
-pwm_status_t pwm_execute(
-	pwm_t *pwm,
-	const pwm_execute_config_t *config)
+/**
+ * Raise to the power of non-negative integer
+ */
+static double pwm_ipow(double x, unsigned int n)
 {
-	pwm_status_t ret = PWM_E_OK;
-	pwm_cmd_t cmd;
-	pwm_cmd_fetcher_t fetcher;
-	int fetched;
+	double result = 1.0;
 
-	pwm_cmd_fetch_init(
-		&fetcher,
-		config->script,
-		config->default_frequency_hz,
-		config->default_duration_ms
-	);
+	for (; n; n >>= 1, x *= x) {
+		if (n & 1)
+			result *= x;
+	}
 
-	clock_gettime(CLOCK_MONOTONIC, &cmd.ts_end);
+	return result;
+}
 
-	while (1) {
-		if (config->stop_flag && *(config->stop_flag))
-			break;
+/**
+ * Get n-th root of the positive value (Newton's method). The
+ * initial value is not less than the root (Bernoulli's inequality),
+ * so the iterations decrease monotonically until the precision limit.
+ */
+static double pwm_nth_root(double value, unsigned int n)
+{
+	double root = 1.0 + (value - 1.0) / n;
+	double next;
+	unsigned int i;
 
-		fetched = pwm_cmd_fetch(&fetcher, &cmd);
-		if (fetched < 0) {
-			pwm_disable(pwm);
-			return PWM_E_FAILED;
-		}
-		
-		if (!fetched)
-			return PWM_E_OK;
+	for (i = 0; i < 256; i++) {
+		next = root - (pwm_ipow(root, n) - value) /
+			(n * pwm_ipow(root, n - 1));
+
+		if (next >= root)
+			break;
+
+		root = next;
+	}
+
+	return root;
+}
+
+/**
+ * Append fetched command to the PWM commands program with
+ * precomputed period and duty cycle. Invalid frequency and duty
+ * cycle are reported at execution.
+ *
+ * Frequency sweeps and duty cycle fades are expanded into the
+ * table of the commands. Each step lasts for the update interval,
+ * step end times are rounded so the total duration of the steps
+ * is exactly the command duration.
+ *
+ * Error information is stored to the error structure on failure.
+ */
+static pwm_status_t pwm_program_append_fetched(
+	pwm_program_t *program,
+	const pwm_cmd_fetcher_t *f,
+	const pwm_cmd_t *cmd,
+	pwm_error_t *error
+)
+{
+	unsigned int steps = 1;
+	double from = f->sweep_from_hz;
+	double to = f->sweep_to_hz;
+	double factor = 1.0;
+	unsigned long long elapsed = 0;
+	unsigned int last;
+	unsigned int i;
+	pwm_status_t ret;
+
+	if (f->sweep_from_hz || f->fade)
+		steps = cmd->duration_ms / f->interval_ms;
 
-		cmd.ts_end.tv_sec  += cmd.duration_ms / 1000;
-		cmd.ts_end.tv_nsec += (cmd.duration_ms % 1000) * 1000000L;
+	if (steps < 1)
+		steps = 1;
 
-		if (cmd.ts_end.tv_nsec >= 1000000000L) {
-			cmd.ts_end.tv_nsec -= 1000000000L;
-			cmd.ts_end.tv_sec++;
+	/* Single step goes to the end value */
+	last = (steps > 1) ? steps - 1 : 1;
+
+	/* Exponential sweep is a geometric progression */
+	if (f->sweep_from_hz && f->sweep_exp)
+		factor = pwm_nth_root(to / from, last);
+
+	ret = pwm_program_reserve(program, steps);
+	if (ret != PWM_E_OK) {
+		error->status   = ret;
+		error->message  = (ret == PWM_E_INVALID_DURATION)
+			? "Too many sweep or fade steps"
+			: (program->arena ? "Arena capacity is exceeded" : "Out of memory");
+		error->position = (size_t)(f->pos - f->script);
+		return ret;
+	}
+
+	for (i = 0; i < steps; i++) {
+		pwm_cmd_t *step = &program->cmds[program->count++];
+		unsigned long long end =
+			(unsigned long long)cmd->duration_ms * (i + 1) / steps;
+		unsigned int k = (steps > 1) ? i : 1;
+		double x = (double)k / last;
+
+		*step = *cmd;
+
+		if (!f->sweep_from_hz)
+			step->frequency_hz = cmd->frequency_hz;
+		else if (f->sweep_exp)
+			step->frequency_hz = (unsigned int)(from * pwm_ipow(factor, k) + 0.5);
+		else
+			step->frequency_hz = (unsigned int)(from + (to - from) * x + 0.5);
+
+		step->period = 0;
+
+		if (step->frequency_hz)
+			pwm_freq_to_period(step->frequency_hz, &step->period);
+
+		if (f->cmd_duty_ns_set) {
+			step->duty_cycle = f->cmd_duty_ns;
+		}
+		else if (f->fade) {
+			double percent = f->cmd_duty_percent +
+				((double)f->fade_to_percent - f->cmd_duty_percent) * x;
+
+			step->duty_cycle = (unsigned int)(
+				step->period * percent / 100.0 + 0.5);
+		}
+		else {
+			step->duty_cycle = pwm_percent_to_duty(
+				step->period, f->cmd_duty_percent);
 		}
 
-		ret = pwm_cmd_execute(pwm, &cmd);
+		step->duration_ms = (unsigned int)(end - elapsed);
+
+		if (i + 1 < steps)
+			step->flags |= PWM_CMD_FLAG_KEEP_ENABLED;
+
+		elapsed = end;
+	}
+
+	return PWM_E_OK;
+}
+
+pwm_status_t pwm_compile(
+	pwm_program_t *program,
+	const pwm_execute_config_t *config
+)
+{
+	pwm_cmd_fetcher_t fetcher;
+	pwm_error_t error;
+	pwm_cmd_t cmd;
+	pwm_status_t ret = PWM_E_OK;
+	int fetched;
+
+	memset(program, 0, sizeof(pwm_program_t));
+	program->arena = config->arena ? config->arena : pwm_arena_get_default();
+
+	if (!config->script)
+		return PWM_E_FAILED;
+
+	pwm_cmd_fetch_init(
+		&fetcher,
+		config->script,
+		config->default_frequency_hz,
+		config->default_duration_ms,
+		config->sweep_interval_ms
+	);
+
+	memset(&error, 0, sizeof(error));
+
+	while ((fetched = pwm_cmd_fetch(&fetcher, &cmd)) > 0) {
+		ret = pwm_program_append_fetched(program, &fetcher, &cmd, &error);
 		if (ret != PWM_E_OK)
 			break;
 	}
 
+	if (fetched < 0) {
+		/* Operand errors have own status, other are syntax errors */
+		error.status   = fetcher.error_message
+			? fetcher.error_status : PWM_E_INVALID_COMMAND;
+		error.message  = fetcher.error_message
+			? fetcher.error_message : "Unknown command in script";
+		error.op       = fetcher.pos[0];
+		error.position = (size_t)(fetcher.pos - fetcher.script) + 1;
+
+		ret = fetcher.error_message ? fetcher.error_status : PWM_E_FAILED;
+	}
+
+	if (ret != PWM_E_OK) {
+		if (config->error_cb)
+			config->error_cb(&error, config->error_arg);
+
+		pwm_program_free(program);
+		return ret;
+	}
+
+	/* Unused capacity is returned to the arena */
+	if (program->arena && program->count < program->capacity) {
+		program->cmds = pwm_arena_resize(program->arena, program->cmds,
+			program->capacity * sizeof(pwm_cmd_t),
+			program->count * sizeof(pwm_cmd_t));
+		program->capacity = program->count;
+	}
+
+	return PWM_E_OK;
+}
+
+void pwm_program_free(pwm_program_t *program)
+{
+	pwm_mem_free(program->arena, program->cmds,
+		program->capacity * sizeof(pwm_cmd_t));
+	memset(program, 0, sizeof(pwm_program_t));
+}
+
+/* ----------------------------------------------------------------------- */
+
+/**
+ * Prepare script execution state machine
+ */
+static pwm_status_t pwm_exec_init(
+	pwm_execute_t *ex,
+	pwm_t *pwm,
+	const pwm_execute_config_t *config
+)
+{
+	pwm_status_t ret;
+
+	memset(ex, 0, sizeof(pwm_execute_t));
+
+	ex->pwm = pwm;
+	ex->timer_fd = -1;
+	ex->error_cb = config->error_cb;
+	ex->error_arg = config->error_arg;
+	ex->overrun_policy = config->overrun_policy;
+	ex->overrun_tolerance_ns = (config->overrun_tolerance_us
+		? config->overrun_tolerance_us : PWM_OVERRUN_TOLERANCE_US) * 1000LL;
+	ex->stats_out = config->stats;
+
+	if (ex->stats_out)
+		memset(ex->stats_out, 0, sizeof(pwm_execute_stats_t));
+
+	/* Context may be moved, so compiled program is not referenced */
+	if (config->program) {
+		ex->program = config->program;
+	}
+	else {
+		ret = pwm_compile(&ex->compiled, config);
+		if (ret != PWM_E_OK)
+			return ret;
+	}
+
+	ex->status = PWM_E_AGAIN;
+	clock_gettime(CLOCK_MONOTONIC, &ex->deadline);
+
+	return PWM_E_OK;
+}
+
+/**
+ * Get the executed program
+ */
+static const pwm_program_t *pwm_exec_program(const pwm_execute_t *ex)
+{
+	return ex->program ? ex->program : &ex->compiled;
+}
+
+/**
+ * Complete the current command of the script
+ */
+static pwm_status_t pwm_exec_cmd_finish(pwm_execute_t *ex)
+{
+	const pwm_cmd_t *cmd = &pwm_exec_program(ex)->cmds[ex->index - 1];
+
+	ex->active = 0;
+
+	if (!(cmd->flags & PWM_CMD_FLAG_KEEP_ENABLED) && cmd->frequency_hz)
+		return pwm_disable(ex->pwm);
+
+	return PWM_E_OK;
+}
+
+/**
+ * Apply PWM state of the command
+ */
+static pwm_status_t pwm_exec_cmd_apply(pwm_execute_t *ex, const pwm_cmd_t *cmd)
+{
+	const char *message = "Can't set PWM channel polarity";
+	pwm_status_t ret = PWM_E_OK;
+
+	if (cmd->flags & PWM_CMD_FLAG_POLARITY)
+		ret = pwm_state_sync(ex->pwm, PWM_ATTR_BIT(PWM_ATTR_POLARITY));
+
+	/* Polarity is changed while disabled, re-enabling is done below */
+	if ((ret == PWM_E_OK) && (cmd->flags & PWM_CMD_FLAG_POLARITY) &&
+	    (cmd->polarity != ex->pwm->polarity)) {
+		ret = pwm_disable(ex->pwm);
+
+		if (ret == PWM_E_OK)
+			ret = pwm_set_polarity(ex->pwm, cmd->polarity);
+	}
+
+	if (ret == PWM_E_OK) {
+		message = "Can't enable PWM channel";
+
+		if (!cmd->frequency_hz)
+			return pwm_disable(ex->pwm);
+
+		if (!cmd->period)
+			ret = PWM_E_INVALID_FREQ;
+		else if (cmd->duty_cycle > cmd->period)
+			ret = PWM_E_INVALID_DUTY;
+		else
+			ret = pwm_enable_ext(ex->pwm, cmd->period, cmd->duty_cycle);
+	}
+
+	if ((ret != PWM_E_OK) && ex->error_cb) {
+		pwm_error_t error = {
+			.status  = ret,
+			.message = message,
+			.chip    = ex->pwm->chip,
+			.channel = ex->pwm->channel,
+		};
+
+		ex->error_cb(&error, ex->error_arg);
+	}
+
 	return ret;
 }
+
+/**
+ * Record command fetch event in the trace
+ */
+static void pwm_exec_trace_fetch(pwm_execute_t *ex, const pwm_cmd_t *cmd)
+{
+	pwm_trace_event_t *ev = pwm_trace_next(ex->pwm->trace);
+
+	ev->type               = PWM_TRACE_FETCH;
+	ev->ts_ns              = pwm_time_ns();
+	ev->dur_ns             = 0;
+	ev->chip               = ex->pwm->chip;
+	ev->channel            = ex->pwm->channel;
+	ev->fetch.index        = (unsigned int)(ex->index - 1);
+	ev->fetch.frequency_hz = cmd->frequency_hz;
+	ev->fetch.duration_ms  = cmd->duration_ms;
+	ev->fetch.flags        = cmd->flags;
+}
+
+/**
+ * Check the start time of the command against its scheduled start
+ * time (the current deadline) and apply the deadline overrun policy
+ *
+ * @return PWM_E_OK Command must be started
+ * @return PWM_E_AGAIN Command must be skipped
+ * @return PWM_E_OVERRUN Execution must be aborted
+ */
+static pwm_status_t pwm_exec_overrun(pwm_execute_t *ex, const pwm_cmd_t *cmd)
+{
+	pwm_status_t ret = PWM_E_OK;
+	struct timespec now;
+	long long delay_ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	delay_ns = (long long)(now.tv_sec - ex->deadline.tv_sec) * 1000000000LL +
+		(now.tv_nsec - ex->deadline.tv_nsec);
+
+	if (delay_ns <= ex->overrun_tolerance_ns) {
+		ex->late_ns = 0;
+		return PWM_E_OK;
+	}
+
+	ex->stats.missed++;
+
+	switch (ex->overrun_policy) {
+		case PWM_OVERRUN_SKIP:
+			/*
+			 * Command is over before it is started. Commands
+			 * with zero duration only change the PWM state
+			 * for the following commands and are applied.
+			 */
+			if (cmd->duration_ms &&
+			    (delay_ns >= cmd->duration_ms * 1000000LL)) {
+				ex->stats.skipped++;
+				ret = PWM_E_AGAIN;
+			}
+			break;
+
+		case PWM_OVERRUN_STRETCH:
+			ex->deadline = now;
+			break;
+
+		case PWM_OVERRUN_ABORT:
+			ret = PWM_E_OVERRUN;
+			break;
+
+		default:
+			break;
+	}
+
+	if (ret != PWM_E_AGAIN) {
+		/* Stall is counted once by the late commands caught up after it */
+		if (delay_ns > ex->late_ns)
+			ex->stats.drift_ns += (unsigned long long)(delay_ns - ex->late_ns);
+
+		ex->late_ns = delay_ns;
+
+		if ((unsigned long long)delay_ns > ex->stats.max_delay_ns)
+			ex->stats.max_delay_ns = (unsigned long long)delay_ns;
+	}
+
+	if (ex->stats_out)
+		*ex->stats_out = ex->stats;
+
+	if ((ret == PWM_E_OVERRUN) && ex->error_cb) {
+		pwm_error_t error = {
+			.status  = ret,
+			.message = "Deadline is missed on PWM channel",
+			.chip    = ex->pwm->chip,
+			.channel = ex->pwm->channel,
+		};
+
+		ex->error_cb(&error, ex->error_arg);
+	}
+
+	return ret;
+}
+
+/**
+ * Advance script execution state machine.
+ *
+ * Completes the current command (if any) and starts the next
+ * commands until a command with non-zero duration is started.
+ *
+ * @return PWM_E_AGAIN Command is started, wait for the deadline
+ * @return PWM_E_OK Script is completed
+ * @return PWM_E_IO Execution failure (sysfs I/O error)
+ */
+static pwm_status_t pwm_exec_advance(pwm_execute_t *ex)
+{
+	pwm_status_t ret;
+	const pwm_program_t *program = pwm_exec_program(ex);
+	const pwm_cmd_t *cmd;
+
+	if (ex->active) {
+		ret = pwm_exec_cmd_finish(ex);
+		if (ret != PWM_E_OK)
+			return ret;
+	}
+
+	while (ex->index < program->count) {
+		cmd = &program->cmds[ex->index++];
+
+		if (ex->pwm->trace)
+			pwm_exec_trace_fetch(ex, cmd);
+
+		ret = pwm_exec_overrun(ex, cmd);
+		if (ret == PWM_E_OVERRUN) {
+			pwm_disable(ex->pwm);
+			return ret;
+		}
+
+		ex->deadline.tv_sec  += cmd->duration_ms / 1000;
+		ex->deadline.tv_nsec += (cmd->duration_ms % 1000) * 1000000L;
+
+		if (ex->deadline.tv_nsec >= 1000000000L) {
+			ex->deadline.tv_nsec -= 1000000000L;
+			ex->deadline.tv_sec++;
+		}
+
+		if (ret == PWM_E_AGAIN)
+			continue;
+
+		ret = pwm_exec_cmd_apply(ex, cmd);
+		if (ret != PWM_E_OK)
+			return ret;
+
+		ex->active = 1;
+
+		if (cmd->duration_ms)
+			return PWM_E_AGAIN;
+
+		ret = pwm_exec_cmd_finish(ex);
+		if (ret != PWM_E_OK)
+			return ret;
+	}
+
+	return PWM_E_OK;
+}
+
+/**
+ * Stop script execution and release resources
+ */
+static pwm_status_t pwm_exec_release(pwm_execute_t *ex, pwm_status_t status)
+{
+	/*
+	 * Interrupted command is completed as usual, unless
+	 * execution is suspended and PWM is owned by other script
+	 */
+	if (ex->active && !ex->suspended)
+		pwm_exec_cmd_finish(ex);
+
+	if (ex->timer_fd >= 0) {
+		close(ex->timer_fd);
+		ex->timer_fd = -1;
+	}
+
+	pwm_program_free(&ex->compiled);
+
+	if (ex->pwm->metrics && (status < PWM_METRICS_STATUSES))
+		pwm_metrics_inc(&ex->pwm->metrics->scripts[status], 1);
+
+	ex->status = status;
+	return status;
+}
+
+pwm_status_t pwm_execute(
+	pwm_t *pwm,
+	const pwm_execute_config_t *config)
+{
+	pwm_status_t ret;
+	pwm_execute_t ex;
+
+	ret = pwm_exec_init(&ex, pwm, config);
+	if (ret != PWM_E_OK) {
+		pwm_disable(pwm);
+		return ret;
+	}
+
+	while ((ret = pwm_exec_advance(&ex)) == PWM_E_AGAIN) {
+		do {
+			if (config->stop_flag && *(config->stop_flag)) {
+				ret = PWM_E_INTR;
+				break;
+			}
+
+			/* Sleep is resumed if interrupted by unrelated signal */
+			ret = pwm_delay_abs_time(pwm, &ex.deadline, NULL);
+		} while (ret == PWM_E_INTR);
+
+		if (ret != PWM_E_OK)
+			break;
+	}
+
+	return pwm_exec_release(&ex, ret);
+}
+
+/* ----------------------------------------------------------------------- */
+
+/**
+ * Arm the script execution timer at the deadline
+ */
+static pwm_status_t pwm_exec_timer_arm(pwm_execute_t *ex)
+{
+	struct itimerspec its = {
+		.it_interval = { 0, 0 },
+		.it_value    = ex->deadline,
+	};
+
+	/* Execution is driven by the caller (see pwm_execute_prepare) */
+	if (ex->timer_fd < 0)
+		return PWM_E_OK;
+
+	/* Zero value disarms the timer */
+	if (!its.it_value.tv_sec && !its.it_value.tv_nsec)
+		its.it_value.tv_nsec = 1;
+
+	if (timerfd_settime(ex->timer_fd, TFD_TIMER_ABSTIME, &its, NULL))
+		return PWM_E_FAILED;
+
+	return PWM_E_OK;
+}
+
+pwm_status_t pwm_execute_start(
+	pwm_execute_t *ex,
+	pwm_t *pwm,
+	const pwm_execute_config_t *config,
+	int *fd
+)
+{
+	pwm_status_t ret;
+
+	ret = pwm_exec_init(ex, pwm, config);
+	if (ret != PWM_E_OK)
+		return ret;
+
+	ex->timer_fd = timerfd_create(CLOCK_MONOTONIC,
+		TFD_NONBLOCK | TFD_CLOEXEC);
+
+	if (ex->timer_fd < 0)
+		return pwm_exec_release(ex, PWM_E_FAILED);
+
+	/* First command is started on the first dispatch */
+	ret = pwm_exec_timer_arm(ex);
+	if (ret != PWM_E_OK)
+		return pwm_exec_release(ex, ret);
+
+	if (fd)
+		*fd = ex->timer_fd;
+
+	return PWM_E_OK;
+}
+
+pwm_status_t pwm_execute_dispatch(pwm_execute_t *ex)
+{
+	uint64_t expirations;
+
+	if (ex->status != PWM_E_AGAIN)
+		return ex->status;
+
+	if (ex->suspended)
+		return PWM_E_AGAIN;
+
+	if (read(ex->timer_fd, &expirations, sizeof(expirations)) < 0) {
+		/*
+		 * Timer is not expired yet. This is a spurious wakeup,
+		 * unless no command is in progress (execution is just
+		 * started or resumed), so the next one can be started
+		 * right away.
+		 */
+		if (ex->active)
+			return PWM_E_AGAIN;
+	}
+
+	return pwm_execute_step(ex);
+}
+
+pwm_status_t pwm_execute_prepare(
+	pwm_execute_t *ex,
+	pwm_t *pwm,
+	const pwm_execute_config_t *config
+)
+{
+	pwm_status_t ret;
+
+	ret = pwm_exec_init(ex, pwm, config);
+	if (ret != PWM_E_OK)
+		return ret;
+
+	/* No timer, first command is started on the first step */
+	return PWM_E_OK;
+}
+
+pwm_status_t pwm_execute_step(pwm_execute_t *ex)
+{
+	pwm_status_t ret;
+
+	if (ex->status != PWM_E_AGAIN)
+		return ex->status;
+
+	if (ex->suspended)
+		return PWM_E_AGAIN;
+
+	ret = pwm_exec_advance(ex);
+	if (ret == PWM_E_AGAIN) {
+		ret = pwm_exec_timer_arm(ex);
+		if (ret == PWM_E_OK)
+			return PWM_E_AGAIN;
+	}
+
+	return pwm_exec_release(ex, ret);
+}
+
+pwm_status_t pwm_execute_cancel(pwm_execute_t *ex)
+{
+	if (ex->status != PWM_E_AGAIN)
+		return ex->status;
+
+	return pwm_exec_release(ex, PWM_E_INTR);
+}
+
+pwm_status_t pwm_execute_suspend(pwm_execute_t *ex)
+{
+	struct itimerspec its;
+	struct timespec now;
+	long long ns;
+
+	if (ex->status != PWM_E_AGAIN)
+		return ex->status;
+
+	if (ex->suspended)
+		return PWM_E_OK;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	ns = (long long)(ex->deadline.tv_sec - now.tv_sec) * 1000000000LL +
+		(ex->deadline.tv_nsec - now.tv_nsec);
+
+	/*
+	 * Command is over, it is completed without any PWM
+	 * changes as the preempting script takes over the PWM
+	 */
+	if (ns <= 0) {
+		ns = 0;
+		ex->active = 0;
+	}
+
+	ex->remaining_ns = ns;
+
+	/* Disarm timer */
+	memset(&its, 0, sizeof(its));
+	if ((ex->timer_fd >= 0) && timerfd_settime(ex->timer_fd, 0, &its, NULL))
+		return pwm_exec_release(ex, PWM_E_FAILED);
+
+	ex->suspended = 1;
+	return PWM_E_OK;
+}
+
+pwm_status_t pwm_execute_resume(pwm_execute_t *ex)
+{
+	const pwm_program_t *program = pwm_exec_program(ex);
+	pwm_status_t ret;
+
+	if (ex->status != PWM_E_AGAIN)
+		return ex->status;
+
+	if (!ex->suspended)
+		return PWM_E_OK;
+
+	ex->suspended = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &ex->deadline);
+	ex->deadline.tv_sec  += ex->remaining_ns / 1000000000LL;
+	ex->deadline.tv_nsec += ex->remaining_ns % 1000000000LL;
+
+	if (ex->deadline.tv_nsec >= 1000000000L) {
+		ex->deadline.tv_nsec -= 1000000000L;
+		ex->deadline.tv_sec++;
+	}
+
+	/* Restore PWM state of the interrupted command */
+	if (ex->active) {
+		ret = pwm_exec_cmd_apply(ex, &program->cmds[ex->index - 1]);
+		if (ret != PWM_E_OK) {
+			ex->active = 0;
+			return pwm_exec_release(ex, ret);
+		}
+	}
+
+	ret = pwm_exec_timer_arm(ex);
+	if (ret != PWM_E_OK)
+		return pwm_exec_release(ex, ret);
+
+	return PWM_E_OK;
+}
+
+pwm_status_t pwm_execute_status(const pwm_execute_t *ex)
+{
+	return ex->status;
+}
@@ -20,8 +20,18 @@
 #ifndef PWM_H_INCLUDED
 #define PWM_H_INCLUDED
 
+#include <stddef.h>       /* size_t */
+#include <time.h>         /* struct timespec */
+#include <linux/limits.h> /* PATH_MAX */
+
 /* ----------------------------------------------------------------------- */
 
+/** Environment variable overriding the sysfs PWM root folder */
+#define PWM_ENV_SYSFS_ROOT  "PWM_SYSFS_ROOT"
+
+/** Environment variable overriding the PWM chips index cache file */
+#define PWM_ENV_INDEX_FILE  "PWM_INDEX_FILE"
+
 /**
  * PWM status codes
  */
@@ -37,8 +47,44 @@ typedef enum {
 	PWM_E_INTR,
 	PWM_E_FAILED,
 	PWM_E_EXPORT_FAILED,
+	PWM_E_AGAIN,
+	PWM_E_QUEUE_FULL,
+	PWM_E_INVALID_DUTY,
+	PWM_E_NOT_SUPPORTED,
+	PWM_E_NO_PATTERN,
+	PWM_E_OVERRUN,
+	PWM_E_NO_MEMORY,
 } pwm_status_t;
 
+/**
+ * PWM output polarity
+ */
+typedef enum {
+	/** Output is high during the duty cycle */
+	PWM_POLARITY_NORMAL = 0,
+
+	/** Output is low during the duty cycle */
+	PWM_POLARITY_INVERSED,
+} pwm_polarity_t;
+
+/**
+ * PWM channel state
+ */
+typedef struct {
+	/** Enabled state */
+	unsigned int enabled;
+
+	/** Period in nanoseconds */
+	unsigned int period;
+
+	/** Duty cycle in nanoseconds */
+	unsigned int duty_cycle;
+
+	/** Output polarity */
+	pwm_polarity_t polarity;
+
+} pwm_state_t;
+
 /**
  * PWM handle structure
  */
@@ -55,12 +101,21 @@ typedef struct {
 	/** File handle to control period */
 	int fd_period;
 
+	/**
+	 * File handle to control polarity (-1 if the PWM
+	 * driver does not support polarity control)
+	 */
+	int fd_polarity;
+
 	/** Current period value */
 	unsigned int period;
 
 	/** Current duty-cycle value */
 	unsigned int duty_cycle;
 
+	/** Current polarity */
+	pwm_polarity_t polarity;
+
 	/** Current enabled state */
 	unsigned int enabled;
 
@@ -70,6 +125,33 @@ typedef struct {
 	/** PWM channel number */
 	unsigned int channel;
 
+	/** Attached trace (see pwm_trace.h) */
+	struct pwm_trace *trace;
+
+	/** PWM channel state snapshot taken at open */
+	pwm_state_t saved;
+
+	/**
+	 * File handle to unexport PWM channel (opened if the channel
+	 * has been exported at open with @ref PWM_FLAG_RESTORE flag)
+	 */
+	int fd_unexport;
+
+	/**
+	 * PWM channel folder handle (kept open with @ref PWM_FLAG_LAZY
+	 * flag to open the control files on first use)
+	 */
+	int fd_channel;
+
+	/**
+	 * Mask of the attributes (1 << @ref pwm_attr_t) which current
+	 * values are not read yet (with @ref PWM_FLAG_LAZY flag)
+	 */
+	unsigned int unknown;
+
+	/** Attached metrics (see pwm_metrics.h) */
+	struct pwm_metrics *metrics;
+
 } pwm_t;
 
 /**
@@ -77,9 +159,84 @@ typedef struct {
  */
 #define PWM_FLAG_EXPORT  0x01
 
+/**
+ * Restore PWM channel state found at open when the
+ * PWM channel is closed. PWM channel exported at open
+ * is unexported.
+ */
+#define PWM_FLAG_RESTORE  0x02
+
+/**
+ * Fast start. The PWM channel folder is opened with a single
+ * system call, control files are opened on first use and the
+ * attribute values are read only when they are needed (e.g. the
+ * current period and duty cycle are not read if the script only
+ * disables the PWM). The channel state snapshot is not taken.
+ *
+ * Ignored with @ref PWM_FLAG_RESTORE flag.
+ */
+#define PWM_FLAG_LAZY  0x04
+
+#ifndef PWM_EXPORT_TIMEOUT_MS
+
+/**
+ * Default timeout in milliseconds for waiting
+ * of the PWM channel after exporting
+ */
+#define PWM_EXPORT_TIMEOUT_MS  1000
+#endif
+
+/**
+ * PWM channel open configuration structure
+ */
+typedef struct {
+	/** PWM chip number */
+	unsigned int chip;
+
+	/** PWM channel number */
+	unsigned int channel;
+
+	/** PWM channel flags */
+	unsigned int flags;
+
+	/**
+	 * Timeout in milliseconds for waiting of the PWM channel
+	 * folder and control files after exporting (see
+	 * @ref PWM_FLAG_EXPORT). Waiting is event-driven (inotify),
+	 * so the channel is opened as soon as it becomes available.
+	 * If 0, PWM channel is opened right after exporting
+	 * without any waiting.
+	 */
+	unsigned int export_timeout_ms;
+
+} pwm_open_config_t;
+
+/**
+ * Set the sysfs PWM root folder for the whole process.
+ *
+ * Must be called before any PWM channel is opened. The
+ * path is copied.
+ *
+ * @param[in] path Sysfs PWM root folder path. NULL restores
+ *                 the default root (@ref PWM_ENV_SYSFS_ROOT
+ *                 environment variable if set or the built-in
+ *                 default otherwise).
+ */
+void pwm_set_sysfs_root(const char *path);
+
+/**
+ * Get the sysfs PWM root folder used by the library.
+ *
+ * @return Pointer to the null-terminated string with the path
+ */
+const char *pwm_get_sysfs_root(void);
+
 /**
  * Try to open PWM channel.
  *
+ * Same as @ref pwm_open_ext with @ref PWM_EXPORT_TIMEOUT_MS
+ * export timeout.
+ *
  * @param[out] pwm     Pointer to the PWM handle structure
  * @param[in]  chip    PWM chip number
  * @param[in]  channel PWM channel number
@@ -94,6 +251,97 @@ typedef struct {
 pwm_status_t pwm_open(pwm_t *pwm, unsigned int chip,
 	unsigned int channel, unsigned int flags);
 
+/**
+ * Try to open PWM channel with extended configuration.
+ *
+ * @param[out] pwm    Pointer to the PWM handle structure
+ * @param[in]  config Pointer to the PWM channel open
+ *                    configuration structure
+ *
+ * @return PWM_E_OK Success
+ * @return PWM_E_NO_SYSFS No access to sysfs
+ * @return PWM_E_NO_CHIP Specified chip number is not exits
+ * @return PWM_E_NO_CHANNEL Specified channel number is not exits
+ *     or has not appeared in time after exporting
+ * @return PWM_E_IO Can't open channel
+ */
+pwm_status_t pwm_open_ext(pwm_t *pwm, const pwm_open_config_t *config);
+
+/** Maximum length of the PWM chip label (including terminating null) */
+#define PWM_CHIP_LABEL_MAX  64
+
+/**
+ * PWM chip information structure
+ */
+typedef struct {
+	/** PWM chip number */
+	unsigned int chip;
+
+	/** Number of the PWM chip channels */
+	unsigned int npwm;
+
+	/**
+	 * Exported channels bitmask. Only the first 64
+	 * channels of the chip are represented.
+	 */
+	unsigned long long exported;
+
+	/** Resolved sysfs path of the backing device (can be empty) */
+	char device[PATH_MAX];
+
+	/** Backing device label (can be empty) */
+	char label[PWM_CHIP_LABEL_MAX];
+
+} pwm_chip_info_t;
+
+/**
+ * PWM chips enumeration callback
+ *
+ * @param[in] info Pointer to the PWM chip information structure
+ * @param[in] arg  User argument passed to @ref pwm_chip_list
+ *
+ * @return 0 Continue enumeration
+ * @return Non-zero value to stop enumeration
+ */
+typedef int (*pwm_chip_cb_t)(const pwm_chip_info_t *info, void *arg);
+
+/**
+ * Enumerate all available PWM chips in order of their numbers.
+ *
+ * @param[in] cb  Callback called for each found PWM chip
+ * @param[in] arg User argument passed to the callback
+ *
+ * @return PWM_E_OK Success
+ * @return PWM_E_NO_SYSFS No access to sysfs
+ * @return PWM_E_NO_MEMORY Out of memory
+ */
+pwm_status_t pwm_chip_list(pwm_chip_cb_t cb, void *arg);
+
+/**
+ * Find PWM chip number by the stable name.
+ *
+ * The name is matched against the backing device label, the
+ * backing device sysfs path or any trailing part of this path
+ * consisting of whole path components (e.g. "ff680000.pwm" or
+ * "platform/ff680000.pwm").
+ *
+ * Lookup is served from the index cache file. A cached entry
+ * is checked against the backing device path and label of the
+ * cached chip only. The sysfs PWM root folder is scanned and
+ * the index is rebuilt if the name is not found in the index,
+ * the cached chip is changed or the index has been built for
+ * another sysfs root.
+ *
+ * @param[in]  name Name of the PWM chip
+ * @param[out] chip Found PWM chip number
+ *
+ * @return PWM_E_OK Success
+ * @return PWM_E_NO_SYSFS No access to sysfs
+ * @return PWM_E_NO_MEMORY Out of memory
+ * @return PWM_E_NO_CHIP PWM chip with specified name is not found
+ */
+pwm_status_t pwm_chip_lookup(const char *name, unsigned int *chip);
+
 /**
  * Enable PWM with specified frequency
  *
@@ -106,6 +354,49 @@ pwm_status_t pwm_open(pwm_t *pwm, unsigned int chip,
  */
 pwm_status_t pwm_enable(pwm_t *pwm, unsigned int freq);
 
+/**
+ * Set PWM duty cycle. Period and enabled state are not changed,
+ * so the change costs a single write (or none if the duty cycle
+ * is already set).
+ *
+ * @param[in] pwm  Pointer to the PWM handle structure
+ * @param[in] duty Duty cycle in nanoseconds
+ *
+ * @return PWM_E_OK Success
+ * @return PWM_E_INVALID_DUTY Duty cycle exceeds the current period
+ * @return PWM_E_IO Can't set duty cycle
+ */
+pwm_status_t pwm_set_duty_cycle(pwm_t *pwm, unsigned int duty);
+
+/**
+ * Set PWM duty cycle as a percentage of the current period
+ *
+ * @param[in] pwm     Pointer to the PWM handle structure
+ * @param[in] percent Duty cycle in percents (0-100)
+ *
+ * @return PWM_E_OK Success
+ * @return PWM_E_INVALID_DUTY Invalid percentage
+ * @return PWM_E_IO Can't set duty cycle
+ */
+pwm_status_t pwm_set_duty_percent(pwm_t *pwm, unsigned int percent);
+
+/**
+ * Set PWM output polarity.
+ *
+ * The kernel accepts polarity changes only while the PWM is
+ * disabled, so the enabled PWM is disabled for the time of
+ * the change. Nothing is written if the polarity is already set.
+ *
+ * @param[in] pwm      Pointer to the PWM handle structure
+ * @param[in] polarity Output polarity
+ *
+ * @return PWM_E_OK Success
+ * @return PWM_E_NOT_SUPPORTED PWM driver does not support
+ *     polarity control
+ * @return PWM_E_IO Can't set polarity
+ */
+pwm_status_t pwm_set_polarity(pwm_t *pwm, pwm_polarity_t polarity);
+
 /**
  * Delay for specified duration
  *
@@ -132,6 +423,21 @@ pwm_status_t pwm_delay(pwm_t *pwm, unsigned int duration,
  */
 pwm_status_t pwm_disable(pwm_t *pwm);
 
+/**
+ * Set PWM channel state (including polarity). Only the differing
+ * attributes are written, in the order accepted by the kernel
+ * and without intermediate waveforms on the output.
+ *
+ * @param[in] pwm   Pointer to the PWM handle structure
+ * @param[in] state Pointer to the PWM channel state structure
+ *
+ * @return PWM_E_OK Success
+ * @return PWM_E_NOT_SUPPORTED PWM driver does not support
+ *     polarity control
+ * @return PWM_E_IO Can't write PWM channel attributes
+ */
+pwm_status_t pwm_set_state(pwm_t *pwm, const pwm_state_t *state);
+
 /**
  * Close PWM channel
  *
@@ -142,6 +448,18 @@ pwm_status_t pwm_disable(pwm_t *pwm);
  */
 pwm_status_t pwm_close(pwm_t *pwm);
 
+/**
+ * Restore PWM channel state (including polarity) found at open.
+ * Only the differing attributes are written, in the order
+ * accepted by the kernel.
+ *
+ * @param[in] pwm Pointer to the PWM handle structure
+ *
+ * @return PWM_E_OK Success
+ * @return PWM_E_IO Can't write PWM channel attributes
+ */
+pwm_status_t pwm_restore(pwm_t *pwm);
+
 /**
  * Get description for specified PWM status.
  *
@@ -152,6 +470,114 @@ pwm_status_t pwm_close(pwm_t *pwm);
  */
 const char *pwm_strstatus(const pwm_status_t status);
 
+/**
+ * Error information passed to the error callback
+ */
+typedef struct {
+	/**
+	 * Error status. PWM_E_INVALID_COMMAND is reported for script
+	 * syntax errors. PWM_E_INVALID_FREQ, PWM_E_INVALID_DUTY and
+	 * PWM_E_INVALID_DURATION are reported with the position for
+	 * invalid operands of script operations and for too many
+	 * sweep or fade steps. Other values are reported for PWM
+	 * channel configuration errors during execution.
+	 */
+	pwm_status_t status;
+
+	/** Short error description */
+	const char *message;
+
+	/** PWM chip number (execution errors only) */
+	unsigned int chip;
+
+	/** PWM channel number (execution errors only) */
+	unsigned int channel;
+
+	/** Invalid operation character (syntax and operand errors only) */
+	char op;
+
+	/** 1-based position in the script (script and out of memory errors) */
+	size_t position;
+
+} pwm_error_t;
+
+/**
+ * Error callback. Library never prints errors by itself,
+ * detailed error information is passed to this callback.
+ *
+ * @param[in] error Pointer to the error information structure
+ * @param[in] arg   User argument
+ */
+typedef void (*pwm_error_cb_t)(const pwm_error_t *error, void *arg);
+
+/**
+ * Deadline overrun policy. Applied when a command is started later
+ * than its scheduled start time (the deadline of the previous
+ * command) by more than the tolerance, e.g. when a sysfs write
+ * or a wakeup has stalled.
+ */
+typedef enum {
+	/**
+	 * Late command is shortened, so the following commands
+	 * start on time (the late commands may be executed
+	 * back-to-back). Keeps the total duration.
+	 */
+	PWM_OVERRUN_CATCH_UP = 0,
+
+	/**
+	 * Commands which scheduled end time has already passed
+	 * are skipped, the late command which is still in its time
+	 * slot is shortened. Commands with zero duration are never
+	 * skipped. Keeps the rhythm of the pattern.
+	 */
+	PWM_OVERRUN_SKIP,
+
+	/**
+	 * Deadlines of the late command and all the following
+	 * commands are shifted by the delay. Keeps the durations
+	 * of the commands.
+	 */
+	PWM_OVERRUN_STRETCH,
+
+	/**
+	 * Execution is aborted with PWM_E_OVERRUN status and
+	 * the PWM is disabled.
+	 */
+	PWM_OVERRUN_ABORT,
+} pwm_overrun_policy_t;
+
+#ifndef PWM_OVERRUN_TOLERANCE_US
+
+/**
+ * Default start delay in microseconds which is not
+ * considered as a deadline overrun
+ */
+#define PWM_OVERRUN_TOLERANCE_US  1000
+#endif
+
+/**
+ * Script execution statistics
+ */
+typedef struct {
+	/** Number of the commands started late or skipped */
+	unsigned int missed;
+
+	/** Number of the skipped commands (@ref PWM_OVERRUN_SKIP) */
+	unsigned int skipped;
+
+	/**
+	 * Total start delay of the late started commands in nanoseconds.
+	 * Each stall is counted once: for the following late commands
+	 * only the growth of the delay since the previous late command
+	 * is added.
+	 */
+	unsigned long long drift_ns;
+
+	/** Maximum start delay of a command in nanoseconds */
+	unsigned long long max_delay_ns;
+
+} pwm_execute_stats_t;
+
 /**
  * PWM commands script execution configuration
  * structure
@@ -190,6 +616,45 @@ typedef struct {
 	 * - `k`:
 	 *   Keep the PWM enabled when the command is completed.
 	 *
+	 * - `g<from>-<to>[/<ms>]`:
+	 *   Sweep frequency linearly from `from` Hz to `to` Hz. The
+	 *   optional argument sets the sweep duration, otherwise
+	 *   the command duration is used. The sweep is expanded at
+	 *   compile time into the steps of the update interval
+	 *   length, so no calculations are performed at runtime.
+	 *   PWM is kept enabled between the steps.
+	 *
+	 * - `G<from>-<to>[/<ms>]`:
+	 *   Same as `g<from>-<to>[/<ms>]`, but frequency is changed
+	 *   exponentially (equal musical intervals per step).
+	 *
+	 * - `u<ms>`:
+	 *   Set sweep update interval for the current and
+	 *   subsequent commands.
+	 *
+	 * - `w<percent>`:
+	 *   Set duty cycle in percents of the period (default 50).
+	 *
+	 * - `W<percent>`:
+	 *   Same as `w<percent>`, but the value will then be used
+	 *   as the default duty cycle for subsequent commands.
+	 *
+	 * - `w<from>-<to>[/<ms>]`:
+	 *   Fade duty cycle linearly from `from` to `to` percents.
+	 *   The optional argument sets the fade duration, otherwise
+	 *   the command duration is used. The fade is expanded at
+	 *   compile time into the steps of the update interval
+	 *   length like the sweeps and can be combined with a sweep
+	 *   in the same command.
+	 *
+	 * - `n<ns>`:
+	 *   Set duty cycle in nanoseconds.
+	 *
+	 * - `i[0|1]`:
+	 *   Set output polarity (1 or no argument for inversed,
+	 *   0 for normal) for the current and subsequent commands.
+	 *   The polarity is changed while the PWM is disabled.
+	 *
 	 * If no `f` or `F` operation is specified in a command, then
 	 * a frequency of 0 will be used for that command, i.e. such
 	 * commands can be used to delay script execution.
@@ -207,6 +672,17 @@ typedef struct {
 	 * <code>
 	 *     F1000D100 d50 f d50 f
 	 * </code>
+	 *
+	 * Siren sweeping up and down between 600 and 1200 Hz with
+	 * 20 ms update interval:
+	 * <code>
+	 *     u20 G600-1200/500k G1200-600/500
+	 * </code>
+	 *
+	 * LED fading in and out within 2 seconds:
+	 * <code>
+	 *     F1000u20w0-100/1000k fw100-0/1000
+	 * </code>
 	 */
 	const char *script;
 
@@ -216,11 +692,147 @@ typedef struct {
 	/** Default duration in milliseconds */
 	unsigned int default_duration_ms;
 
+	/**
+	 * Default sweep update interval in milliseconds. If 0,
+	 * @ref PWM_SWEEP_INTERVAL_MS is used.
+	 */
+	unsigned int sweep_interval_ms;
+
 	/** Pointer to the external stop flag */
 	volatile int *stop_flag;
 
+	/**
+	 * Precompiled program (see @ref pwm_compile). If set, the
+	 * script and default values are ignored. The program is not
+	 * copied and must remain valid until execution is finished.
+	 */
+	const struct pwm_program *program;
+
+	/** Error callback (optional) */
+	pwm_error_cb_t error_cb;
+
+	/** Error callback user argument */
+	void *error_arg;
+
+	/** Deadline overrun policy */
+	pwm_overrun_policy_t overrun_policy;
+
+	/**
+	 * Start delay in microseconds which is not considered as
+	 * a deadline overrun. If 0, @ref PWM_OVERRUN_TOLERANCE_US
+	 * is used.
+	 */
+	unsigned int overrun_tolerance_us;
+
+	/**
+	 * Execution statistics (optional). Reset at start and
+	 * updated during the execution.
+	 */
+	pwm_execute_stats_t *stats;
+
+	/**
+	 * Arena of the program compiled from the script (optional).
+	 * If NULL, the default arena is used (see pwm_arena.h).
+	 */
+	struct pwm_arena *arena;
+
 } pwm_execute_config_t;
 
+/**
+ * Default sweep update interval in milliseconds
+ */
+#define PWM_SWEEP_INTERVAL_MS  10
+
+/**
+ * Maximum number of the commands in the compiled program
+ * (including the expanded sweep and fade steps)
+ */
+#define PWM_PROGRAM_STEPS_MAX  65536
+
+/**
+ * Keep the PWM enabled when the command is completed
+ */
+#define PWM_CMD_FLAG_KEEP_ENABLED  0x01
+
+/**
+ * Set output polarity of the command before the PWM is enabled
+ */
+#define PWM_CMD_FLAG_POLARITY  0x02
+
+/**
+ * Compiled PWM command structure
+ */
+typedef struct {
+	/** Frequency in Hz (0 if PWM is disabled during the command) */
+	unsigned int frequency_hz;
+
+	/** Precomputed period in nanoseconds (0 if frequency is invalid) */
+	unsigned int period;
+
+	/** Precomputed duty cycle in nanoseconds */
+	unsigned int duty_cycle;
+
+	/** Output polarity (if @ref PWM_CMD_FLAG_POLARITY is set) */
+	pwm_polarity_t polarity;
+
+	/** Duration in milliseconds */
+	unsigned int duration_ms;
+
+	/** Command flags (PWM_CMD_FLAG_*) */
+	unsigned int flags;
+
+} pwm_cmd_t;
+
+/**
+ * Compiled PWM commands program
+ */
+typedef struct pwm_program {
+	/** Array of the compiled commands */
+	pwm_cmd_t *cmds;
+
+	/** Number of the compiled commands */
+	size_t count;
+
+	/** Allocated size of the commands array */
+	size_t capacity;
+
+	/** Arena of the commands array (NULL if allocated from the heap) */
+	struct pwm_arena *arena;
+
+} pwm_program_t;
+
+/**
+ * Compile commands script into the program.
+ *
+ * The program must be freed with @ref pwm_program_free.
+ * Commands are allocated from the configured arena or from
+ * the default arena if it is set (see pwm_arena.h).
+ *
+ * @param[out] program Pointer to the program structure
+ * @param[in]  config  Pointer to the PWM commands script execution
+ *                     configuration structure (only script, default
+ *                     values and arena are used)
+ *
+ * @return PWM_E_OK Script successfully compiled
+ * @return PWM_E_NO_MEMORY Out of memory (arena capacity is exceeded)
+ * @return PWM_E_INVALID_FREQ Invalid sweep operand
+ * @return PWM_E_INVALID_DUTY Invalid duty cycle operand
+ * @return PWM_E_INVALID_DURATION Invalid update interval operand
+ *     or more than @ref PWM_PROGRAM_STEPS_MAX commands
+ * @return PWM_E_FAILED Syntax error or unknown command
+ */
+pwm_status_t pwm_compile(
+	pwm_program_t *program,
+	const pwm_execute_config_t *config
+);
+
+/**
+ * Free compiled program
+ *
+ * @param[in] program Pointer to the program structure
+ */
+void pwm_program_free(pwm_program_t *program);
+
 /**
  * Execute commands script for specified PWM.
  *
@@ -231,6 +843,8 @@ typedef struct {
  * @return PWM_E_OK Script successfully executed
  * @return PWM_E_INTR Script execution has been
  *     interrupted by signal
+ * @return PWM_E_OVERRUN Deadline is missed
+ *     (with @ref PWM_OVERRUN_ABORT policy)
  * @return PWM_E_IO Execution failure (sysfs I/O error).
  * @return PWM_E_FAILED Execution failure (syntax error,
  *     unknown command, invalid config, etc).
@@ -240,6 +854,206 @@ pwm_status_t pwm_execute(
 	const pwm_execute_config_t *config
 );
 
+/**
+ * Asynchronous script execution context
+ *
+ * All fields are private and must not be accessed directly.
+ */
+typedef struct {
+	/** PWM handle */
+	pwm_t *pwm;
+
+	/** Executed precompiled program (NULL if compiled from script) */
+	const pwm_program_t *program;
+
+	/** Program compiled from the script */
+	pwm_program_t compiled;
+
+	/** Index of the next command in the program */
+	size_t index;
+
+	/** Non-zero if the current command is in progress */
+	int active;
+
+	/** Deadline of the current command (CLOCK_MONOTONIC) */
+	struct timespec deadline;
+
+	/** Timer file descriptor */
+	int timer_fd;
+
+	/** Execution status */
+	pwm_status_t status;
+
+	/** Non-zero if execution is suspended */
+	int suspended;
+
+	/** Remaining duration of the suspended command in nanoseconds */
+	long long remaining_ns;
+
+	/** Error callback */
+	pwm_error_cb_t error_cb;
+
+	/** Error callback user argument */
+	void *error_arg;
+
+	/** Deadline overrun policy */
+	pwm_overrun_policy_t overrun_policy;
+
+	/** Deadline overrun tolerance in nanoseconds */
+	long long overrun_tolerance_ns;
+
+	/** Start delay of the previous late started command (0 if on time) */
+	long long late_ns;
+
+	/** Execution statistics */
+	pwm_execute_stats_t stats;
+
+	/** User execution statistics storage (optional) */
+	pwm_execute_stats_t *stats_out;
+
+} pwm_execute_t;
+
+/**
+ * Start asynchronous commands script execution for specified PWM.
+ *
+ * The function does not block. The returned file descriptor
+ * (timerfd) becomes readable when the execution must be
+ * advanced with @ref pwm_execute_dispatch. It can be added
+ * to any poll/epoll based event loop, so scripts for many
+ * PWM channels can be executed concurrently in a single
+ * thread.
+ *
+ * The file descriptor is closed by the library when the
+ * execution is completed, failed or cancelled. The
+ * stop_flag field of the configuration is not used.
+ *
+ * @param[out] ex     Pointer to the execution context
+ * @param[in]  pwm    Pointer to the PWM handle structure
+ * @param[in]  config Pointer to the PWM commands script execution
+ *                    configuration structure
+ * @param[out] fd     Pollable file descriptor. Can be NULL.
+ *
+ * @return PWM_E_OK Execution is started
+ * @return PWM_E_FAILED Syntax error, unknown command, etc.
+ */
+pwm_status_t pwm_execute_start(
+	pwm_execute_t *ex,
+	pwm_t *pwm,
+	const pwm_execute_config_t *config,
+	int *fd
+);
+
+/**
+ * Advance asynchronous script execution. Must be called
+ * when the execution file descriptor becomes readable.
+ *
+ * @param[in] ex Pointer to the execution context
+ *
+ * @return PWM_E_AGAIN Execution is in progress
+ * @return PWM_E_OK Script successfully executed
+ * @return PWM_E_OVERRUN Deadline is missed
+ *     (with @ref PWM_OVERRUN_ABORT policy)
+ * @return PWM_E_IO Execution failure (sysfs I/O error).
+ * @return PWM_E_FAILED Execution failure
+ */
+pwm_status_t pwm_execute_dispatch(pwm_execute_t *ex);
+
+/**
+ * Prepare asynchronous commands script execution for specified
+ * PWM without a timer.
+ *
+ * The execution is driven by the caller, which keeps its own
+ * timeline and calls @ref pwm_execute_step when the deadline of
+ * the current command is reached (or slightly earlier). This allows
+ * to serve the commands of many PWM channels with a single wakeup
+ * (see @ref pwm_engine_run). The stop_flag field of the
+ * configuration is not used.
+ *
+ * @param[out] ex     Pointer to the execution context
+ * @param[in]  pwm    Pointer to the PWM handle structure
+ * @param[in]  config Pointer to the PWM commands script execution
+ *                    configuration structure
+ *
+ * @return PWM_E_OK Execution is prepared, the first command
+ *     is started on the first step
+ * @return PWM_E_FAILED Syntax error, unknown command, etc.
+ */
+pwm_status_t pwm_execute_prepare(
+	pwm_execute_t *ex,
+	pwm_t *pwm,
+	const pwm_execute_config_t *config
+);
+
+/**
+ * Complete the current command of asynchronous script execution
+ * regardless of its deadline and start the next command. The
+ * deadlines of the following commands are not shifted.
+ *
+ * @param[in] ex Pointer to the execution context
+ *
+ * @return PWM_E_AGAIN Execution is in progress
+ * @return PWM_E_OK Script successfully executed
+ * @return PWM_E_OVERRUN Deadline is missed
+ *     (with @ref PWM_OVERRUN_ABORT policy)
+ * @return PWM_E_IO Execution failure (sysfs I/O error).
+ * @return PWM_E_FAILED Execution failure
+ */
+pwm_status_t pwm_execute_step(pwm_execute_t *ex);
+
+/**
+ * Cancel asynchronous script execution.
+ *
+ * The current command is completed immediately as usual
+ * (i.e. PWM is disabled unless the command has `k` operation).
+ * Does nothing if execution is already finished.
+ *
+ * @param[in] ex Pointer to the execution context
+ *
+ * @return Final execution status (PWM_E_INTR if cancelled)
+ */
+pwm_status_t pwm_execute_cancel(pwm_execute_t *ex);
+
+/**
+ * Suspend asynchronous script execution.
+ *
+ * The timer is disarmed and the remaining duration of the
+ * current command is saved. PWM state is not changed, so
+ * other script can take over the PWM. Suspended execution
+ * can be cancelled without any PWM changes.
+ *
+ * @param[in] ex Pointer to the execution context
+ *
+ * @return PWM_E_OK Execution is suspended
+ * @return Final execution status if execution is already finished
+ */
+pwm_status_t pwm_execute_suspend(pwm_execute_t *ex);
+
+/**
+ * Resume suspended asynchronous script execution.
+ *
+ * PWM state of the interrupted command is restored and
+ * the command is continued for its remaining duration.
+ * Deadlines of all subsequent commands are shifted by
+ * the time spent in suspended state.
+ *
+ * @param[in] ex Pointer to the execution context
+ *
+ * @return PWM_E_OK Execution is resumed
+ * @return PWM_E_IO Can't restore PWM state
+ * @return Final execution status if execution is already finished
+ */
+pwm_status_t pwm_execute_resume(pwm_execute_t *ex);
+
+/**
+ * Get asynchronous script execution status
+ *
+ * @param[in] ex Pointer to the execution context
+ *
+ * @return PWM_E_AGAIN Execution is in progress
+ * @return Final execution status otherwise
+ */
+pwm_status_t pwm_execute_status(const pwm_execute_t *ex);
+
 /* ----------------------------------------------------------------------- */
 
 #endif /* PWM_H_INCLUDED */
@@ -0,0 +1,248 @@
+/*
+ * SPDX-License-Identifier: WTFPL
+ * SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * PWM tool
+ * Copyright © 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file for more details.
+ */
+
+/**
+ * @file
+ * @brief PWM channels bulk configuration
+ *
+ * @author Anton Kikin <a.kikin@tano-systems.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>        /* openat() */
+#include <pthread.h>
+#include <linux/limits.h> /* PATH_MAX */
+
+#include "pwm.h"
+#include "pwm_apply.h"
+#include "pwm_private.h"
+
+/* ----------------------------------------------------------------------- */
+
+/**
+ * Chip job
+ */
+typedef struct {
+	/** PWM chip number */
+	unsigned int chip;
+
+	/** Entries (only the entries of the chip are handled) */
+	pwm_apply_entry_t *entries;
+
+	/** Number of the entries */
+	size_t count;
+
+	/** Configuration */
+	const pwm_apply_config_t *config;
+
+	/** Start timestamp in nanoseconds (CLOCK_MONOTONIC) */
+	uint64_t start;
+
+	/** Chip thread */
+	pthread_t thread;
+
+	/** Non-zero if the chip thread is created */
+	int threaded;
+
+} pwm_apply_chip_t;
+
+/**
+ * Export all missing channels of the chip without waiting,
+ * so the driver sets up all of them while the first one
+ * is awaited. Failures are reported at open.
+ */
+static void pwm_apply_export(pwm_apply_chip_t *job)
+{
+	char path[PATH_MAX];
+	char name[NAME_MAX];
+	char chnum[16];
+	int export_fd = -1;
+	int chip_fd;
+	ssize_t size;
+	size_t i;
+
+	snprintf(path, sizeof(path), "%s/" SYSFS_PWM_CHIP_FOLDER_FMT,
+		pwm_get_sysfs_root(), job->chip);
+
+	chip_fd = open(path, O_PATH | O_DIRECTORY);
+	if (chip_fd < 0)
+		return;
+
+	for (i = 0; i < job->count; i++) {
+		const pwm_apply_entry_t *entry = &job->entries[i];
+
+		if (entry->chip != job->chip)
+			continue;
+
+		snprintf(name, sizeof(name), SYSFS_PWM_CH_FOLDER_FMT, entry->channel);
+		if (!faccessat(chip_fd, name, F_OK, 0))
+			continue;
+
+		if (export_fd < 0) {
+			export_fd = openat(chip_fd, SYSFS_PWM_FILE_EXPORT, O_WRONLY);
+			if (export_fd < 0)
+				break;
+		}
+
+		size = snprintf(chnum, sizeof(chnum), "%u", entry->channel);
+
+		if (pwrite(export_fd, chnum, size, 0) != size) {
+			/* Channel is exported at open */
+		}
+	}
+
+	if (export_fd >= 0)
+		close(export_fd);
+
+	close(chip_fd);
+}
+
+/**
+ * Set the state of the single channel
+ */
+static pwm_status_t pwm_apply_channel(
+	const pwm_apply_config_t *config,
+	const pwm_apply_entry_t *entry
+)
+{
+	pwm_status_t ret;
+	pwm_state_t state;
+	pwm_t pwm;
+
+	pwm_open_config_t open_config = {
+		.chip              = entry->chip,
+		.channel           = entry->channel,
+		.flags             = PWM_FLAG_EXPORT,
+		.export_timeout_ms = config->export_timeout_ms,
+	};
+
+	ret = pwm_open_ext(&pwm, &open_config);
+	if (ret != PWM_E_OK)
+		return ret;
+
+	state = entry->state;
+
+	if (!(entry->flags & PWM_APPLY_FLAG_PERIOD)) {
+		state.period     = pwm.period;
+		state.duty_cycle = pwm.duty_cycle;
+	}
+
+	if (!(entry->flags & PWM_APPLY_FLAG_POLARITY))
+		state.polarity = pwm.polarity;
+
+	ret = pwm_set_state(&pwm, &state);
+
+	pwm_close(&pwm);
+	return ret;
+}
+
+static void *pwm_apply_thread(void *arg)
+{
+	pwm_apply_chip_t *job = (pwm_apply_chip_t *)arg;
+	pwm_apply_entry_t *entry;
+	size_t i;
+
+	pwm_apply_export(job);
+
+	for (i = 0; i < job->count; i++) {
+		entry = &job->entries[i];
+
+		if (entry->chip != job->chip)
+			continue;
+
+		entry->status = pwm_apply_channel(job->config, entry);
+		entry->elapsed_ns = pwm_time_ns() - job->start;
+
+		if ((entry->status != PWM_E_OK) && job->config->error_cb) {
+			pwm_error_t error = {
+				.status  = entry->status,
+				.message = "Can't configure PWM channel",
+				.chip    = entry->chip,
+				.channel = entry->channel,
+			};
+
+			job->config->error_cb(&error, job->config->error_arg);
+		}
+	}
+
+	return NULL;
+}
+
+/* ----------------------------------------------------------------------- */
+
+pwm_status_t pwm_apply(
+	pwm_apply_entry_t *entries,
+	size_t count,
+	const pwm_apply_config_t *config
+)
+{
+	pwm_apply_chip_t *jobs;
+	uint64_t start = pwm_time_ns();
+	size_t njobs = 0;
+	size_t i;
+	size_t j;
+
+	if (!count)
+		return PWM_E_OK;
+
+	jobs = pwm_mem_alloc(pwm_arena_get_default(),
+		count * sizeof(pwm_apply_chip_t));
+	if (!jobs)
+		return PWM_E_NO_MEMORY;
+
+	memset(jobs, 0, count * sizeof(pwm_apply_chip_t));
+
+	for (i = 0; i < count; i++) {
+		for (j = 0; j < njobs; j++) {
+			if (jobs[j].chip == entries[i].chip)
+				break;
+		}
+
+		if (j == njobs) {
+			jobs[njobs].chip    = entries[i].chip;
+			jobs[njobs].entries = entries;
+			jobs[njobs].count   = count;
+			jobs[njobs].config  = config;
+			jobs[njobs].start   = start;
+			njobs++;
+		}
+	}
+
+	/* First chip is handled by the calling thread */
+	for (j = 1; j < njobs; j++) {
+		jobs[j].threaded = !pthread_create(&jobs[j].thread, NULL,
+			pwm_apply_thread, &jobs[j]);
+	}
+
+	for (j = 0; j < njobs; j++) {
+		if (!jobs[j].threaded)
+			pwm_apply_thread(&jobs[j]);
+	}
+
+	for (j = 1; j < njobs; j++) {
+		if (jobs[j].threaded)
+			pthread_join(jobs[j].thread, NULL);
+	}
+
+	pwm_mem_free(pwm_arena_get_default(), jobs,
+		count * sizeof(pwm_apply_chip_t));
+
+	for (i = 0; i < count; i++) {
+		if (entries[i].status != PWM_E_OK)
+			return entries[i].status;
+	}
+
+	return PWM_E_OK;
+}
@@ -0,0 +1,114 @@
+/*
+ * SPDX-License-Identifier: WTFPL
+ * SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * PWM tool
+ * Copyright © 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file for more details.
+ */
+
+/**
+ * @file
+ * @brief PWM channels bulk configuration header file
+ *
+ * Sets the states of many PWM channels at once (e.g. at boot).
+ * PWM drivers serialize the requests per chip, so the channels of
+ * each chip are configured by a separate thread, while all the
+ * missing channels of the chip are exported before waiting for
+ * any of them.
+ *
+ * @author Anton Kikin <a.kikin@tano-systems.com>
+ */
+
+#ifndef PWM_APPLY_H_INCLUDED
+#define PWM_APPLY_H_INCLUDED
+
+#include <stddef.h>       /* size_t */
+
+#include "pwm.h"
+
+/* ----------------------------------------------------------------------- */
+
+/** Period and duty cycle of the entry state are set */
+#define PWM_APPLY_FLAG_PERIOD    0x01
+
+/** Polarity of the entry state is set */
+#define PWM_APPLY_FLAG_POLARITY  0x02
+
+/**
+ * PWM channel state entry
+ */
+typedef struct {
+	/** PWM chip number */
+	unsigned int chip;
+
+	/** PWM channel number */
+	unsigned int channel;
+
+	/**
+	 * Requested state. Period, duty cycle and polarity are kept
+	 * unless the corresponding flag is set.
+	 */
+	pwm_state_t state;
+
+	/** Entry flags (PWM_APPLY_FLAG_*) */
+	unsigned int flags;
+
+	/** Result status (set by @ref pwm_apply) */
+	pwm_status_t status;
+
+	/**
+	 * Time in nanoseconds from the start of @ref pwm_apply until
+	 * the channel is configured (set by @ref pwm_apply)
+	 */
+	unsigned long long elapsed_ns;
+
+} pwm_apply_entry_t;
+
+/**
+ * Bulk configuration parameters
+ */
+typedef struct {
+	/**
+	 * Timeout in milliseconds for waiting of the PWM channels
+	 * after exporting (see @ref pwm_open_config_t)
+	 */
+	unsigned int export_timeout_ms;
+
+	/** Error callback (optional, called from the chip threads) */
+	pwm_error_cb_t error_cb;
+
+	/** Error callback user argument */
+	void *error_arg;
+
+} pwm_apply_config_t;
+
+/**
+ * Set the states of the PWM channels. Channels are exported
+ * if needed and remain exported. Channels of the same chip are
+ * configured in the entries order, only the differing attributes
+ * are written (see @ref pwm_set_state).
+ *
+ * Failure of a channel does not stop configuration of others,
+ * the status of each channel is stored in its entry.
+ *
+ * @param[in,out] entries Array of the entries
+ * @param[in]     count   Number of the entries
+ * @param[in]     config  Pointer to the configuration structure
+ *
+ * @return PWM_E_OK All channels are configured
+ * @return PWM_E_NO_MEMORY Out of memory
+ * @return Status of the first failed entry otherwise
+ */
+pwm_status_t pwm_apply(
+	pwm_apply_entry_t *entries,
+	size_t count,
+	const pwm_apply_config_t *config
+);
+
+/* ----------------------------------------------------------------------- */
+
+#endif /* PWM_APPLY_H_INCLUDED */
@@ -0,0 +1,205 @@
+/*
+ * SPDX-License-Identifier: WTFPL
+ * SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * PWM tool
+ * Copyright © 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file for more details.
+ */
+
+/**
+ * @file
+ * @brief PWM memory arenas
+ *
+ * @author Anton Kikin <a.kikin@tano-systems.com>
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "pwm_arena.h"
+
+/* ----------------------------------------------------------------------- */
+
+#ifdef PWM_NO_HEAP
+
+/** Static default arena storage */
+static unsigned char pwm_arena_storage[PWM_ARENA_SIZE]
+	__attribute__((aligned(PWM_ARENA_ALIGN)));
+
+/** Static default arena */
+static pwm_arena_t pwm_arena_static = {
+	.base = pwm_arena_storage,
+	.size = PWM_ARENA_SIZE & ~(size_t)(PWM_ARENA_ALIGN - 1),
+};
+
+#define PWM_ARENA_BUILTIN  (&pwm_arena_static)
+#else
+#define PWM_ARENA_BUILTIN  NULL
+#endif
+
+/** Default arena (NULL if the heap is used) */
+static pwm_arena_t *pwm_arena_default = PWM_ARENA_BUILTIN;
+
+/**
+ * Round block size up to the alignment
+ *
+ * @return Rounded size
+ * @return SIZE_MAX on overflow
+ */
+static inline size_t pwm_arena_round(size_t size)
+{
+	if (size > SIZE_MAX - (PWM_ARENA_ALIGN - 1))
+		return SIZE_MAX;
+
+	return (size + PWM_ARENA_ALIGN - 1) & ~(size_t)(PWM_ARENA_ALIGN - 1);
+}
+
+/**
+ * Update the high-water mark
+ */
+static inline void pwm_arena_peak(pwm_arena_t *arena, size_t used)
+{
+	size_t peak = __atomic_load_n(&arena->high_water, __ATOMIC_RELAXED);
+
+	while ((used > peak) &&
+	       !__atomic_compare_exchange_n(&arena->high_water, &peak, used,
+	           1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/**
+ * Count failed allocation
+ */
+static inline void *pwm_arena_fail(pwm_arena_t *arena)
+{
+	__atomic_add_fetch(&arena->failures, 1, __ATOMIC_RELAXED);
+	return NULL;
+}
+
+/* ----------------------------------------------------------------------- */
+
+void pwm_arena_init(pwm_arena_t *arena, void *storage, size_t size)
+{
+	uintptr_t addr = (uintptr_t)storage;
+	size_t pad = (size_t)(-addr & (PWM_ARENA_ALIGN - 1));
+
+	memset(arena, 0, sizeof(pwm_arena_t));
+
+	if (size < pad)
+		return;
+
+	arena->base = (unsigned char *)storage + pad;
+	arena->size = (size - pad) & ~(size_t)(PWM_ARENA_ALIGN - 1);
+}
+
+void pwm_arena_reset(pwm_arena_t *arena)
+{
+	__atomic_store_n(&arena->used, 0, __ATOMIC_RELAXED);
+}
+
+void *pwm_arena_alloc(pwm_arena_t *arena, size_t size)
+{
+	size_t used;
+	size_t next;
+
+	if (!arena)
+		return NULL;
+
+	size = pwm_arena_round(size ? size : 1);
+	used = __atomic_load_n(&arena->used, __ATOMIC_RELAXED);
+
+	do {
+		if (size > arena->size - used)
+			return pwm_arena_fail(arena);
+
+		next = used + size;
+	} while (!__atomic_compare_exchange_n(&arena->used, &used, next,
+		1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	pwm_arena_peak(arena, next);
+	return arena->base + used;
+}
+
+void *pwm_arena_resize(
+	pwm_arena_t *arena,
+	void *ptr,
+	size_t old_size,
+	size_t size
+)
+{
+	size_t offset;
+	size_t end;
+	size_t next;
+	void *block;
+
+	if (!ptr)
+		return pwm_arena_alloc(arena, size);
+
+	if (!arena)
+		return NULL;
+
+	offset = (size_t)((unsigned char *)ptr - arena->base);
+	end    = offset + pwm_arena_round(old_size ? old_size : 1);
+	size   = pwm_arena_round(size ? size : 1);
+
+	/* Last block is resized in place */
+	if (size <= arena->size - offset) {
+		next = offset + size;
+
+		if (__atomic_compare_exchange_n(&arena->used, &end, next,
+		        0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+			pwm_arena_peak(arena, next);
+			return ptr;
+		}
+
+		end = offset + pwm_arena_round(old_size ? old_size : 1);
+	}
+
+	if (offset + size <= end)
+		return ptr;
+
+	block = pwm_arena_alloc(arena, size);
+	if (!block)
+		return NULL;
+
+	memcpy(block, ptr, old_size);
+	return block;
+}
+
+void pwm_arena_free(pwm_arena_t *arena, void *ptr, size_t size)
+{
+	size_t offset;
+	size_t end;
+
+	if (!arena || !ptr)
+		return;
+
+	offset = (size_t)((unsigned char *)ptr - arena->base);
+	end    = offset + pwm_arena_round(size ? size : 1);
+
+	/* Only the last block is released */
+	__atomic_compare_exchange_n(&arena->used, &end, offset,
+		0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+void pwm_arena_get_stats(const pwm_arena_t *arena, pwm_arena_stats_t *stats)
+{
+	stats->size       = arena->size;
+	stats->used       = __atomic_load_n(&arena->used, __ATOMIC_RELAXED);
+	stats->high_water = __atomic_load_n(&arena->high_water, __ATOMIC_RELAXED);
+	stats->failures   = __atomic_load_n(&arena->failures, __ATOMIC_RELAXED);
+}
+
+void pwm_arena_set_default(pwm_arena_t *arena)
+{
+	__atomic_store_n(&pwm_arena_default,
+		arena ? arena : PWM_ARENA_BUILTIN, __ATOMIC_RELEASE);
+}
+
+pwm_arena_t *pwm_arena_get_default(void)
+{
+	return __atomic_load_n(&pwm_arena_default, __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,187 @@
+/*
+ * SPDX-License-Identifier: WTFPL
+ * SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * PWM tool
+ * Copyright © 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file for more details.
+ */
+
+/**
+ * @file
+ * @brief PWM memory arenas header file
+ *
+ * Arena is a fixed-size memory block with the lock-free bump
+ * allocator. When the default arena is set, all dynamic storage
+ * of the library (compiled programs, melodies, patterns library
+ * conversion buffers, chips scanning) is taken from it instead of
+ * the heap, so the memory use is bounded and predictable.
+ *
+ * Memory is released only when it is the last allocated block of
+ * the arena. Blocks released out of order stay allocated until all
+ * blocks allocated after them are released or the arena is reset
+ * with @ref pwm_arena_reset. The nested allocations (compiling and
+ * executing a single script, loading a patterns library) release
+ * the memory in reverse order. Executions which may finish in any
+ * order (asynchronous API, several worker channels) must not share
+ * the arena: such scripts are compiled into their own arenas (see
+ * the `arena` field of the execution configuration and the programs
+ * storage of the worker) or precompiled before the execution.
+ *
+ * In the zero-heap build (PWM_NO_HEAP defined) the library has
+ * the static default arena of @ref PWM_ARENA_SIZE bytes and does
+ * not call the heap functions itself. Allocations made inside the
+ * C library are out of scope: stdio streams (fopen() of the bulk
+ * configuration, chips index, metrics and trace files), directory
+ * streams of the chips scanning and qsort() of the large arrays
+ * may use the heap. Script compilation and execution do not use
+ * these functions.
+ *
+ * @author Anton Kikin <a.kikin@tano-systems.com>
+ */
+
+#ifndef PWM_ARENA_H_INCLUDED
+#define PWM_ARENA_H_INCLUDED
+
+#include <stddef.h>       /* size_t */
+
+/* ----------------------------------------------------------------------- */
+
+#ifndef PWM_ARENA_SIZE
+
+/** Size of the static default arena in the zero-heap build in bytes */
+#define PWM_ARENA_SIZE  65536
+#endif
+
+/** Alignment of the arena blocks in bytes */
+#define PWM_ARENA_ALIGN  16
+
+/**
+ * Arena structure
+ *
+ * All fields are private and must not be accessed directly.
+ */
+typedef struct pwm_arena {
+	/** Storage (aligned to @ref PWM_ARENA_ALIGN) */
+	unsigned char *base;
+
+	/** Storage size in bytes */
+	size_t size;
+
+	/** Allocated size in bytes */
+	size_t used;
+
+	/** Maximum allocated size in bytes */
+	size_t high_water;
+
+	/** Number of the failed allocations */
+	unsigned long failures;
+
+} pwm_arena_t;
+
+/**
+ * Arena statistics
+ */
+typedef struct {
+	/** Storage size in bytes */
+	size_t size;
+
+	/** Allocated size in bytes */
+	size_t used;
+
+	/** Maximum allocated size in bytes since initialization */
+	size_t high_water;
+
+	/** Number of the allocations failed because of exhausted arena */
+	unsigned long failures;
+
+} pwm_arena_stats_t;
+
+/**
+ * Initialize arena with the caller-provided storage
+ *
+ * @param[out] arena   Pointer to the arena structure
+ * @param[in]  storage Pointer to the storage
+ * @param[in]  size    Storage size in bytes
+ */
+void pwm_arena_init(pwm_arena_t *arena, void *storage, size_t size);
+
+/**
+ * Release all blocks of the arena. The high-water mark is kept.
+ *
+ * @param[in] arena Pointer to the arena structure
+ */
+void pwm_arena_reset(pwm_arena_t *arena);
+
+/**
+ * Allocate memory block from the arena. Thread-safe and lock-free.
+ *
+ * @param[in] arena Pointer to the arena structure
+ * @param[in] size  Block size in bytes
+ *
+ * @return Pointer to the block
+ * @return NULL if arena is exhausted
+ */
+void *pwm_arena_alloc(pwm_arena_t *arena, size_t size);
+
+/**
+ * Resize memory block of the arena. The last allocated block
+ * is resized in place, other blocks are moved on growth.
+ *
+ * @param[in] arena    Pointer to the arena structure
+ * @param[in] ptr      Pointer to the block (NULL to allocate)
+ * @param[in] old_size Current block size in bytes
+ * @param[in] size     New block size in bytes
+ *
+ * @return Pointer to the block
+ * @return NULL if arena is exhausted (block is not changed)
+ */
+void *pwm_arena_resize(
+	pwm_arena_t *arena,
+	void *ptr,
+	size_t old_size,
+	size_t size
+);
+
+/**
+ * Release memory block of the arena
+ *
+ * @param[in] arena Pointer to the arena structure
+ * @param[in] ptr   Pointer to the block (can be NULL)
+ * @param[in] size  Block size in bytes
+ */
+void pwm_arena_free(pwm_arena_t *arena, void *ptr, size_t size);
+
+/**
+ * Get arena statistics
+ *
+ * @param[in]  arena Pointer to the arena structure
+ * @param[out] stats Pointer to the statistics structure
+ */
+void pwm_arena_get_stats(const pwm_arena_t *arena, pwm_arena_stats_t *stats);
+
+/**
+ * Set the default arena used for all dynamic storage of the library.
+ * Must be called before any PWM functions are used by other threads
+ * and while no memory of the previous default arena is in use.
+ *
+ * @param[in] arena Pointer to the arena structure (NULL to restore
+ *                  the heap, or the static arena in the zero-heap
+ *                  build)
+ */
+void pwm_arena_set_default(pwm_arena_t *arena);
+
+/**
+ * Get the default arena
+ *
+ * @return Pointer to the default arena structure
+ * @return NULL if the heap is used
+ */
+pwm_arena_t *pwm_arena_get_default(void);
+
+/* ----------------------------------------------------------------------- */
+
+#endif /* PWM_ARENA_H_INCLUDED */
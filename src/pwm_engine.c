@@ -0,0 +1,240 @@
+/*
+ * SPDX-License-Identifier: WTFPL
+ * SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * PWM tool
+ * Copyright © 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file for more details.
+ */
+
+/**
+ * @file
+ * @brief PWM pattern engine
+ *
+ * Executions are prepared without timers (see @ref pwm_execute_prepare),
+ * as each armed timerfd would wake the CPU by itself. The engine sleeps
+ * with clock_nanosleep(), which (unlike timerfd) honours the thread
+ * timer slack.
+ *
+ * @author Anton Kikin <a.kikin@tano-systems.com>
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/prctl.h>    /* PR_SET_TIMERSLACK */
+
+#include "pwm.h"
+#include "pwm_engine.h"
+#include "pwm_private.h"
+
+/* ----------------------------------------------------------------------- */
+
+static uint64_t pwm_engine_deadline_ns(const pwm_execute_t *ex)
+{
+	return (uint64_t)ex->deadline.tv_sec * 1000000000ULL +
+		(uint64_t)ex->deadline.tv_nsec;
+}
+
+/**
+ * Start (or restart) pattern execution of the channel. Restarted
+ * pattern continues from the end of the previous run, so the
+ * pattern period does not drift.
+ */
+static pwm_status_t pwm_engine_prepare(
+	const pwm_engine_config_t *config,
+	const pwm_engine_channel_t *ch,
+	pwm_execute_t *ex,
+	const struct timespec *start
+)
+{
+	pwm_status_t ret;
+
+	pwm_execute_config_t exec_config = {
+		.program   = ch->program,
+		.error_cb  = config->error_cb,
+		.error_arg = config->error_arg,
+	};
+
+	ret = pwm_execute_prepare(ex, ch->pwm, &exec_config);
+	if (ret != PWM_E_OK)
+		return ret;
+
+	if (start)
+		ex->deadline = *start;
+
+	return PWM_E_OK;
+}
+
+/**
+ * Start all commands of the channel which deadlines are
+ * not later than the limit
+ *
+ * @return PWM_E_AGAIN Success
+ * @return Execution failure status otherwise
+ */
+static pwm_status_t pwm_engine_serve(
+	const pwm_engine_config_t *config,
+	const pwm_engine_channel_t *ch,
+	pwm_execute_t *ex,
+	pwm_engine_stats_t *stats,
+	uint64_t now,
+	uint64_t limit
+)
+{
+	struct timespec end;
+	pwm_status_t ret;
+	uint64_t deadline;
+
+	while ((deadline = pwm_engine_deadline_ns(ex)) <= limit) {
+		ret = pwm_execute_step(ex);
+
+		if (ret == PWM_E_OK) {
+			/* Pattern is over, start it again right away */
+			end = ex->deadline;
+
+			ret = pwm_engine_prepare(config, ch, ex, &end);
+			if (ret != PWM_E_OK)
+				return ret;
+
+			continue;
+		}
+
+		if (ret != PWM_E_AGAIN)
+			return ret;
+
+		stats->events++;
+
+		if (deadline > now)
+			stats->coalesced++;
+	}
+
+	return PWM_E_AGAIN;
+}
+
+pwm_status_t pwm_engine_run(const pwm_engine_config_t *config)
+{
+	pwm_execute_t ex[PWM_ENGINE_CHANNELS_MAX];
+	pwm_engine_stats_t stats;
+	pwm_status_t ret = PWM_E_AGAIN;
+	struct timespec ts;
+	unsigned long slack = 0;
+	unsigned int prepared = 0;
+	unsigned long long duration_ms;
+	uint64_t tolerance_ns;
+	uint64_t start;
+	uint64_t now;
+	uint64_t next;
+	unsigned int i;
+	size_t n;
+	int err;
+
+	if (!config->channels || !config->count ||
+	    (config->count > PWM_ENGINE_CHANNELS_MAX))
+		return PWM_E_FAILED;
+
+	/* Endless loop of zero-duration pattern would never sleep */
+	for (i = 0; i < config->count; i++) {
+		const pwm_program_t *program = config->channels[i].program;
+
+		if (!program || !config->channels[i].pwm)
+			return PWM_E_FAILED;
+
+		duration_ms = 0;
+		for (n = 0; n < program->count; n++)
+			duration_ms += program->cmds[n].duration_ms;
+
+		if (!duration_ms)
+			return PWM_E_INVALID_DURATION;
+	}
+
+	memset(&stats, 0, sizeof(stats));
+	tolerance_ns = config->tolerance_ms * 1000000ULL;
+
+	if (config->slack_us) {
+		slack = (unsigned long)prctl(PR_GET_TIMERSLACK, 0, 0, 0, 0);
+		prctl(PR_SET_TIMERSLACK, config->slack_us * 1000UL, 0, 0, 0);
+	}
+
+	/* All patterns are started at the same time */
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	start = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+
+	for (prepared = 0; prepared < config->count; prepared++) {
+		ret = pwm_engine_prepare(config, &config->channels[prepared],
+			&ex[prepared], &ts);
+
+		if (ret != PWM_E_OK)
+			goto out;
+	}
+
+	for (;;) {
+		now  = pwm_time_ns();
+		next = UINT64_MAX;
+
+		for (i = 0; i < config->count; i++) {
+			ret = pwm_engine_serve(config, &config->channels[i], &ex[i],
+				&stats, now, now + tolerance_ns);
+
+			if (ret != PWM_E_AGAIN)
+				goto out;
+
+			if (pwm_engine_deadline_ns(&ex[i]) < next)
+				next = pwm_engine_deadline_ns(&ex[i]);
+		}
+
+		stats.elapsed_ns = now - start;
+
+		if (config->stats)
+			*config->stats = stats;
+
+		if (config->stop_flag && *(config->stop_flag)) {
+			ret = PWM_E_INTR;
+			break;
+		}
+
+		/* Single wakeup at the earliest deadline of all channels */
+		ts.tv_sec  = (time_t)(next / 1000000000ULL);
+		ts.tv_nsec = (long)(next % 1000000000ULL);
+
+		err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+
+		/* Interrupted sleep is restarted after the stop flag check */
+		if (err == EINTR)
+			continue;
+
+		if (err) {
+			ret = PWM_E_FAILED;
+			break;
+		}
+
+		stats.wakeups++;
+
+		now = pwm_time_ns();
+		if (now > next && (now - next) > stats.max_late_ns)
+			stats.max_late_ns = now - next;
+
+		if (config->metrics) {
+			pwm_metrics_inc(&config->metrics->wakeups, 1);
+			pwm_metrics_sleep(config->metrics, (now > next) ? now - next : 0);
+		}
+	}
+
+out:
+	for (i = 0; i < prepared; i++)
+		pwm_execute_cancel(&ex[i]);
+
+	if (config->slack_us)
+		prctl(PR_SET_TIMERSLACK, slack, 0, 0, 0);
+
+	stats.elapsed_ns = pwm_time_ns() - start;
+
+	if (config->stats)
+		*config->stats = stats;
+
+	return ret;
+}
@@ -0,0 +1,136 @@
+/*
+ * SPDX-License-Identifier: WTFPL
+ * SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * PWM tool
+ * Copyright © 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file for more details.
+ */
+
+/**
+ * @file
+ * @brief PWM pattern engine header file
+ *
+ * The pattern engine plays endless patterns (heartbeats, blinks)
+ * on several PWM channels in the calling thread. The transitions of
+ * all channels are scheduled on a shared timeline and the thread
+ * sleeps only until the earliest one. Transitions which fall within
+ * the tolerance window after it are served by the same wakeup, and
+ * the timer slack lets the kernel merge the wakeup with other timers,
+ * so the CPU is woken up as rarely as possible.
+ *
+ * @author Anton Kikin <a.kikin@tano-systems.com>
+ */
+
+#ifndef PWM_ENGINE_H_INCLUDED
+#define PWM_ENGINE_H_INCLUDED
+
+#include "pwm.h"
+#include "pwm_metrics.h"
+
+/* ----------------------------------------------------------------------- */
+
+#ifndef PWM_ENGINE_CHANNELS_MAX
+
+/** Maximum number of the PWM channels served by the engine */
+#define PWM_ENGINE_CHANNELS_MAX  16
+#endif
+
+/**
+ * Engine channel structure
+ */
+typedef struct {
+	/** PWM handle */
+	pwm_t *pwm;
+
+	/**
+	 * Pattern program, restarted when completed. The program
+	 * must have non-zero total duration.
+	 */
+	const pwm_program_t *program;
+
+} pwm_engine_channel_t;
+
+/**
+ * Engine statistics
+ */
+typedef struct {
+	/** Number of the wakeups */
+	unsigned long long wakeups;
+
+	/** Number of the started commands */
+	unsigned long long events;
+
+	/** Number of the commands started ahead of their deadline */
+	unsigned long long coalesced;
+
+	/** Maximum wakeup delay (including the timer slack) in nanoseconds */
+	unsigned long long max_late_ns;
+
+	/** Running time in nanoseconds */
+	unsigned long long elapsed_ns;
+
+} pwm_engine_stats_t;
+
+/**
+ * Engine configuration structure
+ */
+typedef struct {
+	/** Array of the channels */
+	const pwm_engine_channel_t *channels;
+
+	/** Number of the channels (up to @ref PWM_ENGINE_CHANNELS_MAX) */
+	unsigned int count;
+
+	/**
+	 * Coalescing tolerance in milliseconds. Commands which
+	 * deadlines are within this window after the wakeup are
+	 * started ahead of time by the same wakeup.
+	 */
+	unsigned int tolerance_ms;
+
+	/**
+	 * Timer slack in microseconds applied to the calling thread
+	 * while the engine is running (0 keeps the current slack).
+	 * Wakeups may be delayed by up to this value.
+	 */
+	unsigned int slack_us;
+
+	/** Pointer to the stop flag. Engine runs until the flag is set. */
+	volatile int *stop_flag;
+
+	/** Error callback (optional) */
+	pwm_error_cb_t error_cb;
+
+	/** Error callback user argument */
+	void *error_arg;
+
+	/** Statistics storage (optional, updated on each wakeup) */
+	pwm_engine_stats_t *stats;
+
+	/** Metrics (optional, wakeups and their lateness are counted) */
+	pwm_metrics_t *metrics;
+
+} pwm_engine_config_t;
+
+/**
+ * Run the pattern engine in the calling thread until the stop flag
+ * is set or an error occurs. On return the current command of each
+ * channel is completed as usual (i.e. PWM is disabled unless the
+ * command has `k` operation).
+ *
+ * @param[in] config Pointer to the engine configuration structure
+ *
+ * @return PWM_E_INTR Engine is stopped by the stop flag
+ * @return PWM_E_INVALID_DURATION Pattern has zero total duration
+ * @return PWM_E_IO Execution failure (sysfs I/O error).
+ * @return PWM_E_FAILED Invalid configuration or execution failure
+ */
+pwm_status_t pwm_engine_run(const pwm_engine_config_t *config);
+
+/* ----------------------------------------------------------------------- */
+
+#endif /* PWM_ENGINE_H_INCLUDED */
@@ -0,0 +1,477 @@
+/*
+ * SPDX-License-Identifier: WTFPL
+ * SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * PWM tool
+ * Copyright © 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file for more details.
+ */
+
+/**
+ * @file
+ * @brief PWM chips discovery and index cache
+ *
+ * @author Anton Kikin <a.kikin@tano-systems.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>        /* ENOMEM */
+#include <dirent.h>       /* opendir() */
+#include <fcntl.h>        /* openat(), AT_FDCWD */
+
+#include "pwm.h"
+#include "pwm_private.h"
+
+/* ----------------------------------------------------------------------- */
+
+/** Index cache file format version */
+#define PWM_INDEX_VERSION  2
+
+/* ----------------------------------------------------------------------- */
+
+/**
+ * Get the index cache file path
+ */
+static const char *pwm_index_file(void)
+{
+	const char *file = secure_getenv(PWM_ENV_INDEX_FILE);
+	return (file && *file) ? file : PWM_INDEX_FILE;
+}
+
+/**
+ * Parse PWM chip number from the sysfs folder name
+ *
+ * @return 0 on success
+ * @return <0 if name is not a PWM chip folder name
+ */
+static int pwm_chip_parse_name(const char *name, unsigned int *chip)
+{
+	int n = 0;
+
+	if (sscanf(name, SYSFS_PWM_CHIP_FOLDER_FMT "%n", chip, &n) != 1)
+		return -1;
+
+	if (!n || name[n])
+		return -1;
+
+	return 0;
+}
+
+/** Maximum length of the PWM chip folder name (including null) */
+#define PWM_CHIP_NAME_MAX  32
+
+/**
+ * PWM chip folder entry
+ */
+typedef struct {
+	/** Folder name */
+	char name[PWM_CHIP_NAME_MAX];
+
+} pwm_chip_entry_t;
+
+static int pwm_chip_filter(const struct dirent *entry)
+{
+	unsigned int chip;
+
+	if (strlen(entry->d_name) >= PWM_CHIP_NAME_MAX)
+		return 0;
+
+	return !pwm_chip_parse_name(entry->d_name, &chip);
+}
+
+static int pwm_chip_entry_cmp(const void *a, const void *b)
+{
+	return strverscmp(
+		((const pwm_chip_entry_t *)a)->name,
+		((const pwm_chip_entry_t *)b)->name);
+}
+
+static void pwm_chip_scan_free(pwm_chip_entry_t *entries, int capacity)
+{
+	pwm_mem_free(pwm_arena_get_default(), entries,
+		capacity * sizeof(pwm_chip_entry_t));
+}
+
+/**
+ * Scan sysfs PWM root folder for the PWM chip folders in a single
+ * pass. Entries are allocated from the default arena (if set),
+ * the storage is grown while reading the folder. Entries are
+ * sorted in the version order.
+ *
+ * @return Number of the found entries
+ * @return -ENOMEM if out of memory
+ * @return <0 if sysfs PWM root folder is not available
+ */
+static int pwm_chip_scan(pwm_chip_entry_t **entries, int *capacity)
+{
+	pwm_chip_entry_t *grown;
+	struct dirent *entry;
+	DIR *dir;
+	int count = 0;
+
+	*entries = NULL;
+	*capacity = 0;
+
+	dir = opendir(pwm_get_sysfs_root());
+	if (!dir)
+		return -1;
+
+	while ((entry = readdir(dir))) {
+		if (!pwm_chip_filter(entry))
+			continue;
+
+		if (count == *capacity) {
+			int size = *capacity ? *capacity * 2 : 8;
+
+			grown = pwm_mem_resize(pwm_arena_get_default(), *entries,
+				*capacity * sizeof(pwm_chip_entry_t),
+				size * sizeof(pwm_chip_entry_t));
+			if (!grown) {
+				pwm_chip_scan_free(*entries, *capacity);
+				*entries = NULL;
+				*capacity = 0;
+				closedir(dir);
+				return -ENOMEM;
+			}
+
+			*entries = grown;
+			*capacity = size;
+		}
+
+		strcpy((*entries)[count++].name, entry->d_name);
+	}
+
+	closedir(dir);
+
+	if (count)
+		qsort(*entries, count, sizeof(pwm_chip_entry_t), pwm_chip_entry_cmp);
+
+	return count;
+}
+
+/**
+ * Read small sysfs attribute into the null-terminated string.
+ * Trailing newline and null characters are stripped.
+ *
+ * @return Length of the string
+ * @return <0 on error
+ */
+static ssize_t pwm_attr_read_str(
+	int dir_fd,
+	const char *name,
+	char *buffer,
+	size_t size
+)
+{
+	ssize_t len;
+	int fd = openat(dir_fd, name, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	len = read(fd, buffer, size - 1);
+	close(fd);
+
+	if (len < 0)
+		return -1;
+
+	buffer[len] = '\0';
+
+	while (len > 0 && (buffer[len - 1] == '\n' || buffer[len - 1] == '\0'))
+		buffer[--len] = '\0';
+
+	return len;
+}
+
+/**
+ * Read information about the PWM chip from sysfs
+ */
+static pwm_status_t pwm_chip_info_read(
+	const char *folder,
+	pwm_chip_info_t *info
+)
+{
+	int chip_fd;
+	unsigned int ch;
+	char buffer[PATH_MAX];
+
+	memset(info, 0, sizeof(pwm_chip_info_t));
+
+	if (pwm_chip_parse_name(folder, &info->chip))
+		return PWM_E_NO_CHIP;
+
+	snprintf(buffer, sizeof(buffer), "%s/%s", pwm_get_sysfs_root(), folder);
+
+	chip_fd = open(buffer, O_PATH | O_DIRECTORY);
+	if (chip_fd < 0)
+		return PWM_E_NO_CHIP;
+
+	/* Backing device */
+	snprintf(buffer, sizeof(buffer), "%s/%s/%s",
+		pwm_get_sysfs_root(), folder, SYSFS_PWM_LINK_DEVICE);
+
+	if (!realpath(buffer, info->device))
+		info->device[0] = '\0';
+
+	if (pwm_attr_read_str(chip_fd, SYSFS_PWM_FILE_LABEL,
+			info->label, sizeof(info->label)) < 0)
+		info->label[0] = '\0';
+
+	if (pwm_attr_read_str(chip_fd, SYSFS_PWM_FILE_NPWM,
+			buffer, sizeof(buffer)) > 0)
+		info->npwm = (unsigned int)strtoul(buffer, NULL, 10);
+
+	/* Exported channels */
+	for (ch = 0; ch < info->npwm && ch < 64; ch++) {
+		snprintf(buffer, sizeof(buffer), SYSFS_PWM_CH_FOLDER_FMT, ch);
+		if (!faccessat(chip_fd, buffer, F_OK, 0))
+			info->exported |= 1ULL << ch;
+	}
+
+	close(chip_fd);
+	return PWM_E_OK;
+}
+
+/**
+ * Check whether the PWM chip matches the specified stable name
+ */
+static int pwm_chip_match(const pwm_chip_info_t *info, const char *name)
+{
+	size_t dlen;
+	size_t nlen;
+
+	if (!*name)
+		return 0;
+
+	if (info->label[0] && !strcmp(info->label, name))
+		return 1;
+
+	dlen = strlen(info->device);
+	nlen = strlen(name);
+
+	if (!dlen || nlen > dlen)
+		return 0;
+
+	if (strcmp(info->device + dlen - nlen, name))
+		return 0;
+
+	/* Only whole path components are matched */
+	return (nlen == dlen) ||
+	       (name[0] == '/') ||
+	       (info->device[dlen - nlen - 1] == '/');
+}
+
+/* ----------------------------------------------------------------------- */
+
+pwm_status_t pwm_chip_list(pwm_chip_cb_t cb, void *arg)
+{
+	pwm_chip_entry_t *entries;
+	pwm_chip_info_t info;
+	int capacity;
+	int count;
+	int i;
+
+	count = pwm_chip_scan(&entries, &capacity);
+	if (count < 0)
+		return (count == -ENOMEM) ? PWM_E_NO_MEMORY : PWM_E_NO_SYSFS;
+
+	for (i = 0; i < count; i++) {
+		if (pwm_chip_info_read(entries[i].name, &info) != PWM_E_OK)
+			continue;
+
+		if (cb(&info, arg))
+			break;
+	}
+
+	pwm_chip_scan_free(entries, capacity);
+	return PWM_E_OK;
+}
+
+/* ----------------------------------------------------------------------- */
+
+/**
+ * Format the index cache file header.
+ * Index is bound to the sysfs PWM root folder it has been built for.
+ */
+static void pwm_index_header_format(char *buffer, size_t size)
+{
+	snprintf(buffer, size, "pwm-index %d %s\n",
+		PWM_INDEX_VERSION, pwm_get_sysfs_root());
+}
+
+/**
+ * Parse single index cache line
+ *
+ * Line format is "<chip>\t<npwm>\t<device>\t<label>\n".
+ */
+static int pwm_index_parse_line(char *line, pwm_chip_info_t *info)
+{
+	char *fields[4];
+	int i;
+
+	line[strcspn(line, "\n")] = '\0';
+
+	for (i = 0; i < 4; i++) {
+		fields[i] = strsep(&line, "\t");
+		if (!fields[i])
+			return -1;
+	}
+
+	memset(info, 0, sizeof(pwm_chip_info_t));
+
+	info->chip = (unsigned int)strtoul(fields[0], NULL, 10);
+	info->npwm = (unsigned int)strtoul(fields[1], NULL, 10);
+	snprintf(info->device, sizeof(info->device), "%s", fields[2]);
+	snprintf(info->label, sizeof(info->label), "%s", fields[3]);
+
+	return 0;
+}
+
+/**
+ * Check that the cached PWM chip still has the same backing
+ * device and label. Only the attributes of the cached chip
+ * are read, the sysfs PWM root folder is not scanned.
+ */
+static int pwm_index_validate(const pwm_chip_info_t *cached)
+{
+	char path[PATH_MAX];
+	char device[PATH_MAX];
+	char label[PWM_CHIP_LABEL_MAX];
+
+	snprintf(path, sizeof(path), "%s/" SYSFS_PWM_CHIP_FOLDER_FMT "/%s",
+		pwm_get_sysfs_root(), cached->chip, SYSFS_PWM_FILE_LABEL);
+
+	if (pwm_attr_read_str(AT_FDCWD, path, label, sizeof(label)) < 0)
+		label[0] = '\0';
+
+	if (strcmp(label, cached->label))
+		return 0;
+
+	snprintf(path, sizeof(path), "%s/" SYSFS_PWM_CHIP_FOLDER_FMT "/%s",
+		pwm_get_sysfs_root(), cached->chip, SYSFS_PWM_LINK_DEVICE);
+
+	if (!realpath(path, device))
+		return 0;
+
+	return !strcmp(device, cached->device);
+}
+
+/**
+ * Lookup PWM chip in the index cache file
+ *
+ * @return PWM_E_OK PWM chip is found and its cached entry is valid
+ * @return PWM_E_FAILED Index is missing, built for another sysfs
+ *                      root, PWM chip is not found or changed
+ */
+static pwm_status_t pwm_index_find(const char *name, unsigned int *chip)
+{
+	char header[PATH_MAX + 32];
+	char line[PATH_MAX + PWM_CHIP_LABEL_MAX + 32];
+	pwm_chip_info_t info;
+	pwm_status_t ret = PWM_E_FAILED;
+	FILE *f;
+
+	f = fopen(pwm_index_file(), "re");
+	if (!f)
+		return PWM_E_FAILED;
+
+	pwm_index_header_format(header, sizeof(header));
+
+	if (!fgets(line, sizeof(line), f) || strcmp(line, header)) {
+		fclose(f);
+		return PWM_E_FAILED;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		if (pwm_index_parse_line(line, &info))
+			continue;
+
+		if (pwm_chip_match(&info, name)) {
+			if (pwm_index_validate(&info)) {
+				*chip = info.chip;
+				ret = PWM_E_OK;
+			}
+			break;
+		}
+	}
+
+	fclose(f);
+	return ret;
+}
+
+/**
+ * Rebuild index cache file and lookup PWM chip
+ *
+ * Failure to write the index cache file is not an error,
+ * the lookup result is returned anyway.
+ */
+static pwm_status_t pwm_index_rebuild(
+	const pwm_chip_entry_t *entries,
+	int count,
+	const char *name,
+	unsigned int *chip
+)
+{
+	char tmpname[PATH_MAX];
+	char header[PATH_MAX + 32];
+	pwm_chip_info_t info;
+	pwm_status_t ret = PWM_E_NO_CHIP;
+	FILE *f;
+	int i;
+
+	snprintf(tmpname, sizeof(tmpname), "%s.%ld",
+		pwm_index_file(), (long)getpid());
+
+	f = fopen(tmpname, "we");
+	if (f) {
+		pwm_index_header_format(header, sizeof(header));
+		fputs(header, f);
+	}
+
+	for (i = 0; i < count; i++) {
+		if (pwm_chip_info_read(entries[i].name, &info) != PWM_E_OK)
+			continue;
+
+		if (f) {
+			fprintf(f, "%u\t%u\t%s\t%s\n",
+				info.chip, info.npwm, info.device, info.label);
+		}
+
+		if ((ret != PWM_E_OK) && pwm_chip_match(&info, name)) {
+			*chip = info.chip;
+			ret = PWM_E_OK;
+		}
+	}
+
+	if (f) {
+		if (fclose(f) || rename(tmpname, pwm_index_file()))
+			unlink(tmpname);
+	}
+
+	return ret;
+}
+
+pwm_status_t pwm_chip_lookup(const char *name, unsigned int *chip)
+{
+	pwm_chip_entry_t *entries;
+	pwm_status_t ret;
+	int capacity;
+	int count;
+
+	if (pwm_index_find(name, chip) == PWM_E_OK)
+		return PWM_E_OK;
+
+	count = pwm_chip_scan(&entries, &capacity);
+	if (count < 0)
+		return (count == -ENOMEM) ? PWM_E_NO_MEMORY : PWM_E_NO_SYSFS;
+
+	ret = pwm_index_rebuild(entries, count, name, chip);
+
+	pwm_chip_scan_free(entries, capacity);
+	return ret;
+}
@@ -0,0 +1,419 @@
+/*
+ * SPDX-License-Identifier: WTFPL
+ * SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * PWM tool
+ * Copyright © 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file for more details.
+ */
+
+/**
+ * @file
+ * @brief PWM melodies (RTTTL)
+ *
+ * @author Anton Kikin <a.kikin@tano-systems.com>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>        /* isspace(), isdigit(), tolower() */
+#include <stdint.h>       /* uint64_t */
+
+#include "pwm.h"
+#include "pwm_melody.h"
+#include "pwm_private.h"
+
+/* ----------------------------------------------------------------------- */
+
+/** Maximum note octave */
+#define PWM_MELODY_OCTAVE_MAX  8
+
+/** Maximum note duration divider */
+#define PWM_MELODY_DURATION_MAX  64
+
+/** Note position resolution (whole note fraction, dotted 64th is 3/128) */
+#define PWM_MELODY_UNITS  (PWM_MELODY_DURATION_MAX * 2)
+
+/**
+ * Periods in nanoseconds of the notes of the octave 0 (C0 to B0,
+ * A4 is 440 Hz). Periods of the higher octaves are obtained by
+ * right shifts.
+ */
+static const unsigned int pwm_melody_periods[12] = {
+	61156103, /* C  */
+	57723675, /* C# */
+	54483894, /* D  */
+	51425948, /* D# */
+	48539631, /* E  */
+	45815311, /* F  */
+	43243895, /* F# */
+	40816802, /* G  */
+	38525931, /* G# */
+	36363636, /* A  */
+	34322702, /* A# */
+	32396317, /* B  */
+};
+
+/**
+ * Melody parser data structure
+ */
+typedef struct {
+	const char *melody;
+	const char *pos;
+
+	/** Default note duration divider */
+	unsigned int duration;
+
+	/** Default note octave */
+	unsigned int octave;
+
+	/** Tempo in beats per minute */
+	unsigned int bpm;
+
+	/** End position of the last note in @ref PWM_MELODY_UNITS */
+	uint64_t position;
+
+	/** End time of the last note in milliseconds */
+	uint64_t elapsed_ms;
+
+} pwm_melody_parser_t;
+
+/* ----------------------------------------------------------------------- */
+
+static void pwm_melody_skip_spaces(pwm_melody_parser_t *p)
+{
+	while (*(p->pos) && isspace(*(p->pos)))
+		p->pos++;
+}
+
+/**
+ * Parse decimal number
+ *
+ * @return 0 on success, -1 if there is no number
+ */
+static int pwm_melody_number(pwm_melody_parser_t *p, unsigned int *value)
+{
+	unsigned long v;
+
+	if (!isdigit(p->pos[0]))
+		return -1;
+
+	v = strtoul(p->pos, (char **)&p->pos, 10);
+	*value = (v > 0xffffffffUL) ? 0xffffffffU : (unsigned int)v;
+
+	return 0;
+}
+
+/**
+ * Check that value is a valid note duration divider
+ */
+static int pwm_melody_duration_valid(unsigned int duration)
+{
+	return duration && (duration <= PWM_MELODY_DURATION_MAX) &&
+		!(duration & (duration - 1));
+}
+
+/**
+ * Parse defaults section (`d=<duration>,o=<octave>,b=<bpm>`)
+ *
+ * @return 0 on success, -1 on syntax error
+ */
+static int pwm_melody_parse_defaults(pwm_melody_parser_t *p)
+{
+	for (;;) {
+		const char *key;
+		unsigned int value;
+
+		pwm_melody_skip_spaces(p);
+
+		if (p->pos[0] == ':')
+			break;
+
+		key = p->pos++;
+
+		pwm_melody_skip_spaces(p);
+
+		if (p->pos[0] != '=')
+			return -1;
+
+		p->pos++;
+		pwm_melody_skip_spaces(p);
+
+		if (pwm_melody_number(p, &value))
+			return -1;
+
+		switch (tolower(key[0])) {
+			case 'd':
+				if (!pwm_melody_duration_valid(value)) {
+					p->pos = key;
+					return -1;
+				}
+
+				p->duration = value;
+				break;
+
+			case 'o':
+				if (value > PWM_MELODY_OCTAVE_MAX) {
+					p->pos = key;
+					return -1;
+				}
+
+				p->octave = value;
+				break;
+
+			case 'b':
+				if (!value) {
+					p->pos = key;
+					return -1;
+				}
+
+				p->bpm = value;
+				break;
+
+			default:
+				p->pos = key;
+				return -1;
+		}
+
+		pwm_melody_skip_spaces(p);
+
+		if (p->pos[0] == ',')
+			p->pos++;
+		else if (p->pos[0] != ':')
+			return -1;
+	}
+
+	/* Skip ':' */
+	p->pos++;
+	return 0;
+}
+
+/**
+ * Parse single note into the command
+ *
+ * @return 0 on success, -1 on syntax error
+ */
+static int pwm_melody_parse_note(pwm_melody_parser_t *p, pwm_cmd_t *cmd)
+{
+	unsigned int duration = p->duration;
+	unsigned int octave = p->octave;
+	unsigned int units;
+	unsigned int period;
+	uint64_t end_ms;
+	int semitone;
+	int dotted = 0;
+
+	static const int semitones[] = {
+		/* a   b  c  d  e  f  g  h */
+		   9, 11, 0, 2, 4, 5, 7, 11
+	};
+
+	if (isdigit(p->pos[0])) {
+		const char *start = p->pos;
+
+		pwm_melody_number(p, &duration);
+
+		if (!pwm_melody_duration_valid(duration)) {
+			p->pos = start;
+			return -1;
+		}
+	}
+
+	switch (tolower(p->pos[0])) {
+		case 'a': case 'b': case 'c': case 'd':
+		case 'e': case 'f': case 'g': case 'h':
+			semitone = semitones[tolower(p->pos[0]) - 'a'];
+			break;
+
+		case 'p':
+			semitone = -1;
+			break;
+
+		default:
+			return -1;
+	}
+
+	p->pos++;
+
+	if ((p->pos[0] == '#') && (semitone >= 0)) {
+		semitone++;
+		p->pos++;
+	}
+
+	if (p->pos[0] == '.') {
+		dotted = 1;
+		p->pos++;
+	}
+
+	if (isdigit(p->pos[0])) {
+		octave = (unsigned int)(p->pos[0] - '0');
+
+		if (octave > PWM_MELODY_OCTAVE_MAX)
+			return -1;
+
+		p->pos++;
+	}
+
+	if ((p->pos[0] == '.') && !dotted) {
+		dotted = 1;
+		p->pos++;
+	}
+
+	/* B# is C of the next octave */
+	if (semitone == 12) {
+		semitone = 0;
+		octave++;
+	}
+
+	if (octave > PWM_MELODY_OCTAVE_MAX)
+		return -1;
+
+	units = PWM_MELODY_UNITS / duration;
+	if (dotted)
+		units += units / 2;
+
+	/* Whole note lasts for 4 beats (240000 ms / bpm) */
+	p->position += units;
+	end_ms = (p->position * 240000 + PWM_MELODY_UNITS / 2 * p->bpm) /
+		((uint64_t)PWM_MELODY_UNITS * p->bpm);
+
+	memset(cmd, 0, sizeof(pwm_cmd_t));
+	cmd->duration_ms = (unsigned int)(end_ms - p->elapsed_ms);
+	p->elapsed_ms = end_ms;
+
+	if (semitone >= 0) {
+		period = (pwm_melody_periods[semitone] + ((1U << octave) >> 1))
+			>> octave;
+
+		cmd->period       = period;
+		cmd->duty_cycle   = (period + 1) / 2;
+		cmd->frequency_hz = (1000000000U + period / 2) / period;
+	}
+
+	return 0;
+}
+
+/**
+ * Parse notes section into the program
+ *
+ * @return 0 on success, -1 on syntax error
+ */
+static int pwm_melody_parse_notes(
+	pwm_melody_parser_t *p,
+	pwm_program_t *program)
+{
+	for (;;) {
+		pwm_melody_skip_spaces(p);
+
+		if (!p->pos[0])
+			break;
+
+		if (pwm_melody_parse_note(p, &program->cmds[program->count]))
+			return -1;
+
+		program->count++;
+		pwm_melody_skip_spaces(p);
+
+		if (p->pos[0] == ',')
+			p->pos++;
+		else if (p->pos[0])
+			return -1;
+	}
+
+	return 0;
+}
+
+pwm_status_t pwm_melody_compile(
+	pwm_program_t *program,
+	const char *melody,
+	pwm_error_cb_t error_cb,
+	void *error_arg
+)
+{
+	pwm_melody_parser_t parser = {
+		.melody   = melody,
+		.pos      = melody,
+		.duration = PWM_MELODY_DEFAULT_DURATION,
+		.octave   = PWM_MELODY_DEFAULT_OCTAVE,
+		.bpm      = PWM_MELODY_DEFAULT_BPM,
+	};
+
+	const char *colon;
+	const char *s;
+	size_t count = 1;
+	int failed = 0;
+
+	memset(program, 0, sizeof(pwm_program_t));
+	program->arena = pwm_arena_get_default();
+
+	if (!melody)
+		return PWM_E_FAILED;
+
+	/* Number of the notes is not greater than number of commas + 1 */
+	for (s = melody; *s; s++) {
+		if (*s == ',')
+			count++;
+	}
+
+	program->cmds = pwm_mem_alloc(program->arena, count * sizeof(pwm_cmd_t));
+	if (!program->cmds) {
+		pwm_error_t error = {
+			.status  = PWM_E_NO_MEMORY,
+			.message = program->arena
+				? "Arena capacity is exceeded"
+				: "Out of memory",
+		};
+
+		if (error_cb)
+			error_cb(&error, error_arg);
+
+		return PWM_E_NO_MEMORY;
+	}
+
+	program->capacity = count;
+
+	/* Name and defaults sections */
+	colon = strchr(melody, ':');
+	if (colon) {
+		parser.pos = colon + 1;
+
+		if (!strchr(parser.pos, ':')) {
+			/* Defaults section is not terminated */
+			parser.pos = colon;
+			failed = 1;
+		}
+		else
+			failed = pwm_melody_parse_defaults(&parser);
+	}
+
+	if (!failed)
+		failed = pwm_melody_parse_notes(&parser, program);
+
+	if (failed) {
+		pwm_error_t error = {
+			.status   = PWM_E_INVALID_COMMAND,
+			.message  = "Invalid melody syntax",
+			.op       = parser.pos[0],
+			.position = (size_t)(parser.pos - parser.melody) + 1,
+		};
+
+		if (error_cb)
+			error_cb(&error, error_arg);
+
+		pwm_program_free(program);
+		return PWM_E_FAILED;
+	}
+
+	/* Unused capacity is returned to the arena */
+	if (program->arena && program->count < program->capacity) {
+		program->cmds = pwm_arena_resize(program->arena, program->cmds,
+			program->capacity * sizeof(pwm_cmd_t),
+			program->count * sizeof(pwm_cmd_t));
+		program->capacity = program->count;
+	}
+
+	return PWM_E_OK;
+}
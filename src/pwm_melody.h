@@ -0,0 +1,99 @@
+/*
+ * SPDX-License-Identifier: WTFPL
+ * SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * PWM tool
+ * Copyright © 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file for more details.
+ */
+
+/**
+ * @file
+ * @brief PWM melodies (RTTTL) header file
+ *
+ * Melodies in the RTTTL (Ring Tone Text Transfer Language) format
+ * are compiled directly into the PWM commands program, which can
+ * be executed as any other compiled script (see
+ * @ref pwm_execute_config_t.program).
+ *
+ * @author Anton Kikin <a.kikin@tano-systems.com>
+ */
+
+#ifndef PWM_MELODY_H_INCLUDED
+#define PWM_MELODY_H_INCLUDED
+
+#include "pwm.h"
+
+/* ----------------------------------------------------------------------- */
+
+/** Default note duration (quarter note) */
+#define PWM_MELODY_DEFAULT_DURATION  4
+
+/** Default note octave */
+#define PWM_MELODY_DEFAULT_OCTAVE    6
+
+/** Default tempo in beats (quarter notes) per minute */
+#define PWM_MELODY_DEFAULT_BPM       63
+
+/**
+ * Compile RTTTL melody into the program.
+ *
+ * The melody consists of three sections separated by colons:
+ * <code>
+ *     <name>:<defaults>:<notes>
+ * </code>
+ *
+ * The name is ignored. The defaults section is a comma-separated
+ * list of `d=<duration>` (default note duration), `o=<octave>`
+ * (default octave) and `b=<bpm>` (tempo in quarter notes per
+ * minute) values. Name and defaults sections can be omitted
+ * together.
+ *
+ * Notes are separated by commas, each note is written as:
+ * <code>
+ *     [<duration>]<note>[#][.][<octave>][.]
+ * </code>
+ *
+ * - `<duration>`: 1, 2, 4, 8, 16, 32 or 64 (whole note divider);
+ * - `<note>`: `c`, `d`, `e`, `f`, `g`, `a`, `b` (or `h`) or `p`
+ *   for the rest;
+ * - `#`: sharp;
+ * - `.`: dotted note (duration is multiplied by 1.5);
+ * - `<octave>`: 0-8.
+ *
+ * Note periods are taken from the precomputed table (A4 is
+ * 440 Hz, equal temperament), so no floating point math is
+ * performed. End time of each note is rounded to milliseconds
+ * from the melody start, so the rounding errors do not accumulate
+ * and the tempo is exact. PWM is disabled at the end of each note
+ * to separate the repeated notes.
+ *
+ * Example:
+ * <code>
+ *     Beep:d=8,o=6,b=120:c,e,g,2c7,p,c
+ * </code>
+ *
+ * The program must be freed with @ref pwm_program_free.
+ *
+ * @param[out] program   Pointer to the program structure
+ * @param[in]  melody    Melody in RTTTL format
+ * @param[in]  error_cb  Error callback for syntax errors (optional)
+ * @param[in]  error_arg Error callback user argument
+ *
+ * @return PWM_E_OK Melody successfully compiled
+ * @return PWM_E_NO_MEMORY Out of memory (arena capacity is exceeded)
+ * @return PWM_E_FAILED Syntax error
+ */
+pwm_status_t pwm_melody_compile(
+	pwm_program_t *program,
+	const char *melody,
+	pwm_error_cb_t error_cb,
+	void *error_arg
+);
+
+/* ----------------------------------------------------------------------- */
+
+#endif /* PWM_MELODY_H_INCLUDED */
@@ -0,0 +1,205 @@
+/*
+ * SPDX-License-Identifier: WTFPL
+ * SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * PWM tool
+ * Copyright © 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file for more details.
+ */
+
+/**
+ * @file
+ * @brief PWM metrics
+ *
+ * @author Anton Kikin <a.kikin@tano-systems.com>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <linux/limits.h> /* PATH_MAX */
+
+#include "pwm.h"
+#include "pwm_metrics.h"
+#include "pwm_private.h"
+
+/* ----------------------------------------------------------------------- */
+
+static const char *pwm_metrics_attr_names[PWM_METRICS_ATTRS] = {
+	[PWM_ATTR_ENABLE]     = SYSFS_PWM_FILE_ENABLE,
+	[PWM_ATTR_PERIOD]     = SYSFS_PWM_FILE_PERIOD,
+	[PWM_ATTR_DUTY_CYCLE] = SYSFS_PWM_FILE_DUTY_CYCLE,
+	[PWM_ATTR_POLARITY]   = SYSFS_PWM_FILE_POLARITY,
+};
+
+static const char *pwm_metrics_late_bounds[PWM_METRICS_LATE_BUCKETS - 1] = {
+	"1e-05", "5e-05", "0.0001", "0.0005", "0.001", "0.005", "0.01",
+};
+
+static inline uint64_t pwm_metrics_get(const uint64_t *counter)
+{
+	return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+/* ----------------------------------------------------------------------- */
+
+void pwm_metrics_init(pwm_metrics_t *metrics)
+{
+	memset(metrics, 0, sizeof(pwm_metrics_t));
+
+	metrics->magic   = PWM_METRICS_MAGIC;
+	metrics->version = PWM_METRICS_VERSION;
+	metrics->size    = sizeof(pwm_metrics_t);
+}
+
+void pwm_metrics_attach(pwm_t *pwm, pwm_metrics_t *metrics)
+{
+	pwm->metrics = metrics;
+}
+
+pwm_status_t pwm_metrics_map(const char *file, pwm_metrics_t **metrics)
+{
+	void *addr;
+	int fd;
+
+	fd = open(file, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return PWM_E_IO;
+
+	if (ftruncate(fd, sizeof(pwm_metrics_t))) {
+		close(fd);
+		return PWM_E_IO;
+	}
+
+	addr = mmap(NULL, sizeof(pwm_metrics_t),
+		PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	close(fd);
+
+	if (addr == MAP_FAILED)
+		return PWM_E_IO;
+
+	*metrics = (pwm_metrics_t *)addr;
+	pwm_metrics_init(*metrics);
+	return PWM_E_OK;
+}
+
+void pwm_metrics_unmap(pwm_metrics_t *metrics)
+{
+	munmap(metrics, sizeof(pwm_metrics_t));
+}
+
+pwm_status_t pwm_metrics_save(const pwm_metrics_t *metrics, const char *file)
+{
+	char tmp[PATH_MAX];
+	uint64_t total;
+	uint64_t value;
+	unsigned int i;
+	FILE *f;
+	int ret;
+
+	snprintf(tmp, sizeof(tmp), "%s.%ld", file, (long)getpid());
+
+	f = fopen(tmp, "w");
+	if (!f)
+		return PWM_E_IO;
+
+	fprintf(f,
+		"# HELP pwm_scripts_total Completed scripts by the status.\n"
+		"# TYPE pwm_scripts_total counter\n");
+
+	for (i = 0; i < PWM_METRICS_STATUSES; i++) {
+		value = pwm_metrics_get(&metrics->scripts[i]);
+		if (value)
+			fprintf(f, "pwm_scripts_total{status=\"%u\"} %llu\n",
+				i, (unsigned long long)value);
+	}
+
+	fprintf(f,
+		"# HELP pwm_writes_total PWM attributes writes.\n"
+		"# TYPE pwm_writes_total counter\n");
+
+	for (i = 0; i < PWM_METRICS_ATTRS; i++) {
+		fprintf(f, "pwm_writes_total{attr=\"%s\"} %llu\n",
+			pwm_metrics_attr_names[i],
+			(unsigned long long)pwm_metrics_get(&metrics->writes[i]));
+	}
+
+	fprintf(f,
+		"# HELP pwm_write_errors_total PWM attributes write errors by errno.\n"
+		"# TYPE pwm_write_errors_total counter\n");
+
+	for (i = 0; i < PWM_METRICS_ERRNOS; i++) {
+		value = pwm_metrics_get(&metrics->write_errors[i]);
+		if (value)
+			fprintf(f, "pwm_write_errors_total{errno=\"%u\"} %llu\n",
+				i, (unsigned long long)value);
+	}
+
+	fprintf(f,
+		"# HELP pwm_sleep_lateness_seconds Wakeup time after the deadline.\n"
+		"# TYPE pwm_sleep_lateness_seconds histogram\n");
+
+	for (i = 0, total = 0; i < PWM_METRICS_LATE_BUCKETS; i++) {
+		total += pwm_metrics_get(&metrics->late_buckets[i]);
+		fprintf(f, "pwm_sleep_lateness_seconds_bucket{le=\"%s\"} %llu\n",
+			(i < PWM_METRICS_LATE_BUCKETS - 1)
+				? pwm_metrics_late_bounds[i] : "+Inf",
+			(unsigned long long)total);
+	}
+
+	value = pwm_metrics_get(&metrics->late_sum_ns);
+	fprintf(f, "pwm_sleep_lateness_seconds_sum %llu.%09llu\n",
+		(unsigned long long)(value / 1000000000ULL),
+		(unsigned long long)(value % 1000000000ULL));
+	fprintf(f, "pwm_sleep_lateness_seconds_count %llu\n",
+		(unsigned long long)total);
+
+	fprintf(f,
+		"# HELP pwm_worker_queue_depth Worker queue depth at enqueue.\n"
+		"# TYPE pwm_worker_queue_depth histogram\n");
+
+	for (i = 0, total = 0; i < PWM_METRICS_DEPTH_BUCKETS; i++) {
+		total += pwm_metrics_get(&metrics->depth_buckets[i]);
+
+		if (i < PWM_METRICS_DEPTH_BUCKETS - 1)
+			fprintf(f, "pwm_worker_queue_depth_bucket{le=\"%u\"} %llu\n",
+				1U << i, (unsigned long long)total);
+		else
+			fprintf(f, "pwm_worker_queue_depth_bucket{le=\"+Inf\"} %llu\n",
+				(unsigned long long)total);
+	}
+
+	fprintf(f, "pwm_worker_queue_depth_sum %llu\n",
+		(unsigned long long)pwm_metrics_get(&metrics->depth_sum));
+	fprintf(f, "pwm_worker_queue_depth_count %llu\n",
+		(unsigned long long)total);
+
+	fprintf(f,
+		"# HELP pwm_worker_dropped_total Worker requests dropped on the queue overflow.\n"
+		"# TYPE pwm_worker_dropped_total counter\n"
+		"pwm_worker_dropped_total %llu\n"
+		"# HELP pwm_worker_preemptions_total Worker scripts preemptions.\n"
+		"# TYPE pwm_worker_preemptions_total counter\n"
+		"pwm_worker_preemptions_total %llu\n"
+		"# HELP pwm_engine_wakeups_total Pattern engine wakeups.\n"
+		"# TYPE pwm_engine_wakeups_total counter\n"
+		"pwm_engine_wakeups_total %llu\n",
+		(unsigned long long)pwm_metrics_get(&metrics->dropped),
+		(unsigned long long)pwm_metrics_get(&metrics->preemptions),
+		(unsigned long long)pwm_metrics_get(&metrics->wakeups));
+
+	ret = ferror(f);
+
+	if (fclose(f) || ret || rename(tmp, file)) {
+		unlink(tmp);
+		return PWM_E_IO;
+	}
+
+	return PWM_E_OK;
+}
@@ -0,0 +1,172 @@
+/*
+ * SPDX-License-Identifier: WTFPL
+ * SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * PWM tool
+ * Copyright © 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file for more details.
+ */
+
+/**
+ * @file
+ * @brief PWM metrics header file
+ *
+ * Metrics are the counters and histograms of the executed scripts,
+ * PWM attributes writes and write errors, sleeps lateness, worker
+ * queue and pattern engine. They are updated with relaxed atomic
+ * increments without any locks, so they can be collected in the
+ * time-critical paths.
+ *
+ * The metrics structure has no pointers, so it can be placed
+ * in the shared memory (see @ref pwm_metrics_map) and read
+ * by another process, or saved to the file in the Prometheus
+ * text format (see @ref pwm_metrics_save).
+ *
+ * @author Anton Kikin <a.kikin@tano-systems.com>
+ */
+
+#ifndef PWM_METRICS_H_INCLUDED
+#define PWM_METRICS_H_INCLUDED
+
+#include <stdint.h>
+
+#include "pwm.h"
+#include "pwm_trace.h"
+
+/* ----------------------------------------------------------------------- */
+
+/** Metrics structure magic ("PWMMETR\0" in little-endian) */
+#define PWM_METRICS_MAGIC  0x005254454d4d5750ULL
+
+/** Metrics structure version */
+#define PWM_METRICS_VERSION  1
+
+/** Number of the counted PWM attributes (see @ref pwm_attr_t) */
+#define PWM_METRICS_ATTRS  4
+
+/** Number of the counted script statuses (see @ref pwm_status_t) */
+#define PWM_METRICS_STATUSES  32
+
+/**
+ * Number of the counted errno values. Write errors with
+ * greater errno values are counted as errno 0.
+ */
+#define PWM_METRICS_ERRNOS  64
+
+/**
+ * Number of the sleep lateness histogram buckets (the upper bounds
+ * are 10, 50, 100, 500 us, 1, 5, 10 ms and +Inf)
+ */
+#define PWM_METRICS_LATE_BUCKETS  8
+
+/**
+ * Number of the worker queue depth histogram buckets (the upper
+ * bounds are 1, 2, 4, 8, 16, 32, 64 requests and +Inf)
+ */
+#define PWM_METRICS_DEPTH_BUCKETS  8
+
+/**
+ * Metrics structure
+ *
+ * All fields are private and must not be accessed directly.
+ */
+typedef struct pwm_metrics {
+	/** Magic (@ref PWM_METRICS_MAGIC) */
+	uint64_t magic;
+
+	/** Version (@ref PWM_METRICS_VERSION) */
+	uint32_t version;
+
+	/** Size of the structure */
+	uint32_t size;
+
+	/** Completed scripts by the status */
+	uint64_t scripts[PWM_METRICS_STATUSES];
+
+	/** PWM attributes writes by the attribute */
+	uint64_t writes[PWM_METRICS_ATTRS];
+
+	/** PWM attributes write errors by errno */
+	uint64_t write_errors[PWM_METRICS_ERRNOS];
+
+	/** Sleeps lateness histogram (non-cumulative bucket counts) */
+	uint64_t late_buckets[PWM_METRICS_LATE_BUCKETS];
+
+	/** Total sleeps lateness in nanoseconds */
+	uint64_t late_sum_ns;
+
+	/** Worker queue depth at enqueue histogram (non-cumulative) */
+	uint64_t depth_buckets[PWM_METRICS_DEPTH_BUCKETS];
+
+	/** Total worker queue depth at enqueue */
+	uint64_t depth_sum;
+
+	/** Worker requests dropped on the queue overflow */
+	uint64_t dropped;
+
+	/** Worker scripts preemptions */
+	uint64_t preemptions;
+
+	/** Pattern engine wakeups */
+	uint64_t wakeups;
+
+} pwm_metrics_t;
+
+/**
+ * Initialize (reset) metrics
+ *
+ * @param[out] metrics Pointer to the metrics structure
+ */
+void pwm_metrics_init(pwm_metrics_t *metrics);
+
+/**
+ * Attach metrics to the PWM handle. Writes, sleeps and scripts
+ * executed for the handle are counted. The same metrics can be
+ * attached to any number of handles.
+ *
+ * @param[in] pwm     Pointer to the PWM handle structure
+ * @param[in] metrics Pointer to the metrics structure (NULL to detach)
+ */
+void pwm_metrics_attach(pwm_t *pwm, pwm_metrics_t *metrics);
+
+/**
+ * Create (or truncate) the shared file (e.g. in /dev/shm), map
+ * the metrics structure into it and initialize the metrics, so they
+ * can be read by other processes while they are updated.
+ *
+ * @param[in]  file    File name
+ * @param[out] metrics Pointer to the mapped metrics structure
+ *
+ * @return PWM_E_OK Success
+ * @return PWM_E_IO Can't create or map file
+ */
+pwm_status_t pwm_metrics_map(const char *file, pwm_metrics_t **metrics);
+
+/**
+ * Unmap metrics structure mapped with @ref pwm_metrics_map.
+ * The file is not removed.
+ *
+ * @param[in] metrics Pointer to the mapped metrics structure
+ */
+void pwm_metrics_unmap(pwm_metrics_t *metrics);
+
+/**
+ * Save metrics snapshot to the file in the Prometheus text format
+ * (e.g. for the node_exporter textfile collector). The file is
+ * written atomically (to the temporary file which is renamed
+ * afterwards).
+ *
+ * @param[in] metrics Pointer to the metrics structure
+ * @param[in] file    Output file name
+ *
+ * @return PWM_E_OK Success
+ * @return PWM_E_IO Can't write file
+ */
+pwm_status_t pwm_metrics_save(const pwm_metrics_t *metrics, const char *file);
+
+/* ----------------------------------------------------------------------- */
+
+#endif /* PWM_METRICS_H_INCLUDED */
@@ -0,0 +1,416 @@
+/*
+ * SPDX-License-Identifier: WTFPL
+ * SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * PWM tool
+ * Copyright © 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file for more details.
+ */
+
+/**
+ * @file
+ * @brief PWM precompiled patterns library
+ *
+ * File layout (all numbers are little-endian):
+ *
+ * <code>
+ *     header    magic[8], version, count, buckets, cmd_size (u32),
+ *               file_size (u64)
+ *     buckets   u32[buckets], entry index + 1 (0 if bucket is empty)
+ *     entries   { name_hash (u64), name_offset, cmds_offset,
+ *                 cmds_count, reserved (u32) }[count]
+ *     commands  { frequency_hz, period, duty_cycle, polarity,
+ *                 duration_ms, flags (u32) }[]
+ *     names     null-terminated strings
+ * </code>
+ *
+ * The hash table uses open addressing with linear probing and
+ * is at most half full.
+ *
+ * @author Anton Kikin <a.kikin@tano-systems.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <ctype.h>        /* isgraph() */
+#include <limits.h>       /* PATH_MAX */
+#include <fcntl.h>        /* open() */
+#include <stddef.h>       /* offsetof() */
+#include <sys/mman.h>     /* mmap() */
+#include <sys/stat.h>     /* fstat() */
+
+#include "pwm.h"
+#include "pwm_pattern.h"
+#include "pwm_private.h"
+
+/* ----------------------------------------------------------------------- */
+
+/** Patterns library file magic */
+#define PWM_PATTERN_MAGIC  "PWMPATT"
+
+#define PWM_PATTERN_HEADER_SIZE  32
+#define PWM_PATTERN_ENTRY_SIZE   24
+#define PWM_PATTERN_CMD_SIZE     24
+
+/* Command records are used in place on little-endian hosts */
+_Static_assert(sizeof(pwm_cmd_t) == PWM_PATTERN_CMD_SIZE &&
+	offsetof(pwm_cmd_t, frequency_hz) == 0  &&
+	offsetof(pwm_cmd_t, period)       == 4  &&
+	offsetof(pwm_cmd_t, duty_cycle)   == 8  &&
+	offsetof(pwm_cmd_t, polarity)     == 12 &&
+	offsetof(pwm_cmd_t, duration_ms)  == 16 &&
+	offsetof(pwm_cmd_t, flags)        == 20,
+	"pwm_cmd_t layout does not match patterns library command record");
+
+/* ----------------------------------------------------------------------- */
+
+static uint32_t pwm_le32_get(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+		((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t pwm_le64_get(const uint8_t *p)
+{
+	return (uint64_t)pwm_le32_get(p) | ((uint64_t)pwm_le32_get(p + 4) << 32);
+}
+
+static void pwm_le32_put(uint8_t *p, uint32_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+	p[2] = (uint8_t)(v >> 16);
+	p[3] = (uint8_t)(v >> 24);
+}
+
+static void pwm_le64_put(uint8_t *p, uint64_t v)
+{
+	pwm_le32_put(p, (uint32_t)v);
+	pwm_le32_put(p + 4, (uint32_t)(v >> 32));
+}
+
+/**
+ * Pattern name hash (FNV-1a)
+ */
+static uint64_t pwm_pattern_hash(const char *name)
+{
+	const unsigned char *c;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	for (c = (const unsigned char *)name; *c; c++) {
+		hash ^= *c;
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+static int pwm_pattern_name_valid(const char *name)
+{
+	size_t len = 0;
+
+	if (!name)
+		return 0;
+
+	for (; name[len]; len++) {
+		if (!isgraph((unsigned char)name[len]))
+			return 0;
+	}
+
+	return len && (len <= PWM_PATTERN_NAME_MAX);
+}
+
+static size_t pwm_pattern_align(size_t offset)
+{
+	return (offset + 7) & ~(size_t)7;
+}
+
+/* ----------------------------------------------------------------------- */
+
+/**
+ * Compare pattern name stored in the file with the specified name
+ */
+static int pwm_pattern_name_equal(
+	const uint8_t *data,
+	size_t size,
+	uint32_t offset,
+	const char *name,
+	size_t len
+)
+{
+	if ((offset >= size) || (size - offset <= len))
+		return 0;
+
+	return !memcmp(data + offset, name, len) && !data[offset + len];
+}
+
+pwm_status_t pwm_pattern_write(
+	const char *file,
+	const pwm_pattern_t *patterns,
+	size_t count
+)
+{
+	char tmpname[PATH_MAX];
+	uint32_t buckets = 2;
+	size_t entries_offset;
+	size_t cmds_offset;
+	size_t names_offset;
+	size_t total;
+	size_t cmds = 0;
+	size_t names = 0;
+	size_t i;
+	size_t j;
+	uint8_t *data;
+	pwm_status_t ret = PWM_E_OK;
+	FILE *f;
+
+	for (i = 0; i < count; i++) {
+		if (!pwm_pattern_name_valid(patterns[i].name))
+			return PWM_E_FAILED;
+
+		cmds  += patterns[i].program->count;
+		names += strlen(patterns[i].name) + 1;
+	}
+
+	/* Hash table is at most half full */
+	while (buckets < count * 2)
+		buckets *= 2;
+
+	entries_offset = pwm_pattern_align(
+		PWM_PATTERN_HEADER_SIZE + (size_t)buckets * 4);
+	cmds_offset    = entries_offset + count * PWM_PATTERN_ENTRY_SIZE;
+	names_offset   = cmds_offset + cmds * PWM_PATTERN_CMD_SIZE;
+	total          = names_offset + names;
+
+	if (total > UINT32_MAX)
+		return PWM_E_FAILED;
+
+	data = pwm_mem_alloc(pwm_arena_get_default(), total);
+	if (!data)
+		return PWM_E_NO_MEMORY;
+
+	memset(data, 0, total);
+
+	memcpy(data, PWM_PATTERN_MAGIC, sizeof(PWM_PATTERN_MAGIC));
+	pwm_le32_put(data + 8,  PWM_PATTERN_VERSION);
+	pwm_le32_put(data + 12, (uint32_t)count);
+	pwm_le32_put(data + 16, buckets);
+	pwm_le32_put(data + 20, PWM_PATTERN_CMD_SIZE);
+	pwm_le64_put(data + 24, total);
+
+	for (i = 0; i < count; i++) {
+		const pwm_program_t *program = patterns[i].program;
+		const char *name = patterns[i].name;
+		size_t len = strlen(name);
+		uint64_t hash = pwm_pattern_hash(name);
+		uint8_t *entry = data + entries_offset + i * PWM_PATTERN_ENTRY_SIZE;
+		uint32_t b = (uint32_t)hash & (buckets - 1);
+		uint32_t idx;
+
+		/* Find free bucket, reject duplicate names */
+		while ((idx = pwm_le32_get(data + PWM_PATTERN_HEADER_SIZE + b * 4))) {
+			const uint8_t *other = data + entries_offset +
+				(idx - 1) * PWM_PATTERN_ENTRY_SIZE;
+
+			if ((pwm_le64_get(other) == hash) &&
+			    pwm_pattern_name_equal(data, total,
+			        pwm_le32_get(other + 8), name, len)) {
+				ret = PWM_E_FAILED;
+				goto out;
+			}
+
+			b = (b + 1) & (buckets - 1);
+		}
+
+		pwm_le32_put(data + PWM_PATTERN_HEADER_SIZE + b * 4, (uint32_t)i + 1);
+
+		pwm_le64_put(entry,      hash);
+		pwm_le32_put(entry + 8,  (uint32_t)names_offset);
+		pwm_le32_put(entry + 12, (uint32_t)cmds_offset);
+		pwm_le32_put(entry + 16, (uint32_t)program->count);
+
+		memcpy(data + names_offset, name, len + 1);
+		names_offset += len + 1;
+
+		for (j = 0; j < program->count; j++) {
+			const pwm_cmd_t *cmd = &program->cmds[j];
+			uint8_t *rec = data + cmds_offset;
+
+			pwm_le32_put(rec,      cmd->frequency_hz);
+			pwm_le32_put(rec + 4,  cmd->period);
+			pwm_le32_put(rec + 8,  cmd->duty_cycle);
+			pwm_le32_put(rec + 12, (uint32_t)cmd->polarity);
+			pwm_le32_put(rec + 16, cmd->duration_ms);
+			pwm_le32_put(rec + 20, cmd->flags);
+
+			cmds_offset += PWM_PATTERN_CMD_SIZE;
+		}
+	}
+
+	snprintf(tmpname, sizeof(tmpname), "%s.%ld", file, (long)getpid());
+
+	f = fopen(tmpname, "we");
+	if (!f) {
+		ret = PWM_E_IO;
+		goto out;
+	}
+
+	if ((fwrite(data, 1, total, f) != total) | fclose(f) ||
+	    rename(tmpname, file)) {
+		unlink(tmpname);
+		ret = PWM_E_IO;
+	}
+
+out:
+	pwm_mem_free(pwm_arena_get_default(), data, total);
+	return ret;
+}
+
+/* ----------------------------------------------------------------------- */
+
+pwm_status_t pwm_pattern_open(pwm_pattern_lib_t *lib, const char *file)
+{
+	struct stat st;
+	void *data;
+	int fd;
+
+	memset(lib, 0, sizeof(pwm_pattern_lib_t));
+
+	fd = open(file, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return PWM_E_IO;
+
+	if (fstat(fd, &st)) {
+		close(fd);
+		return PWM_E_IO;
+	}
+
+	if (st.st_size < PWM_PATTERN_HEADER_SIZE) {
+		close(fd);
+		return PWM_E_FAILED;
+	}
+
+	data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED)
+		return PWM_E_IO;
+
+	lib->data    = data;
+	lib->size    = (size_t)st.st_size;
+	lib->count   = pwm_le32_get(lib->data + 12);
+	lib->buckets = pwm_le32_get(lib->data + 16);
+
+	/* Only the header is validated, entries are checked on lookup */
+	if (memcmp(lib->data, PWM_PATTERN_MAGIC, sizeof(PWM_PATTERN_MAGIC)) ||
+	    (pwm_le32_get(lib->data + 8) != PWM_PATTERN_VERSION) ||
+	    (pwm_le32_get(lib->data + 20) != PWM_PATTERN_CMD_SIZE) ||
+	    (pwm_le64_get(lib->data + 24) != lib->size) ||
+	    !lib->buckets || (lib->buckets & (lib->buckets - 1)) ||
+	    (lib->count > lib->buckets) ||
+	    (pwm_pattern_align(PWM_PATTERN_HEADER_SIZE +
+	        (size_t)lib->buckets * 4) +
+	        (size_t)lib->count * PWM_PATTERN_ENTRY_SIZE > lib->size)) {
+		pwm_pattern_close(lib);
+		return PWM_E_FAILED;
+	}
+
+	return PWM_E_OK;
+}
+
+pwm_status_t pwm_pattern_find(
+	pwm_pattern_lib_t *lib,
+	const char *name,
+	pwm_program_t *program
+)
+{
+	size_t entries_offset = pwm_pattern_align(
+		PWM_PATTERN_HEADER_SIZE + (size_t)lib->buckets * 4);
+	uint64_t hash = pwm_pattern_hash(name);
+	uint32_t b = (uint32_t)hash & (lib->buckets - 1);
+	size_t len = strlen(name);
+	uint32_t probes;
+	uint32_t idx;
+
+	memset(program, 0, sizeof(pwm_program_t));
+
+	for (probes = 0; probes < lib->buckets; probes++) {
+		const uint8_t *entry;
+		uint32_t offset;
+		uint32_t count;
+
+		idx = pwm_le32_get(lib->data + PWM_PATTERN_HEADER_SIZE + b * 4);
+		if (!idx)
+			break;
+
+		if (idx > lib->count)
+			return PWM_E_FAILED;
+
+		entry = lib->data + entries_offset + (idx - 1) * PWM_PATTERN_ENTRY_SIZE;
+
+		if ((pwm_le64_get(entry) != hash) ||
+		    !pwm_pattern_name_equal(lib->data, lib->size,
+		        pwm_le32_get(entry + 8), name, len)) {
+			b = (b + 1) & (lib->buckets - 1);
+			continue;
+		}
+
+		offset = pwm_le32_get(entry + 12);
+		count  = pwm_le32_get(entry + 16);
+
+		if ((offset % 4) || (offset > lib->size) ||
+		    (count > (lib->size - offset) / PWM_PATTERN_CMD_SIZE))
+			return PWM_E_FAILED;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		program->cmds = (pwm_cmd_t *)(lib->data + offset);
+#else
+		{
+			const uint8_t *rec = lib->data + offset;
+			uint32_t i;
+
+			pwm_mem_free(pwm_arena_get_default(), lib->converted,
+				lib->converted_count * sizeof(pwm_cmd_t));
+
+			lib->converted_count = count ? count : 1;
+			lib->converted = pwm_mem_alloc(pwm_arena_get_default(),
+				lib->converted_count * sizeof(pwm_cmd_t));
+			if (!lib->converted) {
+				lib->converted_count = 0;
+				return PWM_E_NO_MEMORY;
+			}
+
+			for (i = 0; i < count; i++, rec += PWM_PATTERN_CMD_SIZE) {
+				lib->converted[i].frequency_hz = pwm_le32_get(rec);
+				lib->converted[i].period       = pwm_le32_get(rec + 4);
+				lib->converted[i].duty_cycle   = pwm_le32_get(rec + 8);
+				lib->converted[i].polarity     = pwm_le32_get(rec + 12);
+				lib->converted[i].duration_ms  = pwm_le32_get(rec + 16);
+				lib->converted[i].flags        = pwm_le32_get(rec + 20);
+			}
+
+			program->cmds = lib->converted;
+		}
+#endif
+
+		program->count = count;
+		return PWM_E_OK;
+	}
+
+	return PWM_E_NO_PATTERN;
+}
+
+void pwm_pattern_close(pwm_pattern_lib_t *lib)
+{
+	if (lib->data)
+		munmap((void *)lib->data, lib->size);
+
+	pwm_mem_free(pwm_arena_get_default(), lib->converted,
+		lib->converted_count * sizeof(pwm_cmd_t));
+	memset(lib, 0, sizeof(pwm_pattern_lib_t));
+}
@@ -0,0 +1,150 @@
+/*
+ * SPDX-License-Identifier: WTFPL
+ * SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * PWM tool
+ * Copyright © 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file for more details.
+ */
+
+/**
+ * @file
+ * @brief PWM precompiled patterns library header file
+ *
+ * The patterns library is a binary file with the named compiled
+ * programs (see @ref pwm_compile and @ref pwm_melody_compile).
+ * The file is memory-mapped and the patterns are looked up through
+ * the hash table stored in the file, so opening the library and
+ * finding a pattern take constant time regardless of the library
+ * size, and nothing is parsed at runtime.
+ *
+ * All numbers in the file are stored in little-endian byte order,
+ * so the file can be built on a host with a different architecture.
+ *
+ * @author Anton Kikin <a.kikin@tano-systems.com>
+ */
+
+#ifndef PWM_PATTERN_H_INCLUDED
+#define PWM_PATTERN_H_INCLUDED
+
+#include <stddef.h>       /* size_t */
+#include <stdint.h>
+
+#include "pwm.h"
+
+/* ----------------------------------------------------------------------- */
+
+/** Patterns library file format version */
+#define PWM_PATTERN_VERSION  1
+
+/** Maximum length of the pattern name (without terminating null) */
+#define PWM_PATTERN_NAME_MAX  63
+
+/**
+ * Pattern to be written to the patterns library
+ */
+typedef struct {
+	/** Pattern name */
+	const char *name;
+
+	/** Compiled program */
+	const pwm_program_t *program;
+
+} pwm_pattern_t;
+
+/**
+ * Opened patterns library
+ *
+ * All fields are private and must not be accessed directly.
+ */
+typedef struct {
+	/** Mapped file data */
+	const uint8_t *data;
+
+	/** Mapped file size */
+	size_t size;
+
+	/** Number of the patterns */
+	uint32_t count;
+
+	/** Number of the hash table buckets (power of two) */
+	uint32_t buckets;
+
+	/** Commands of the last found pattern (big-endian hosts only) */
+	pwm_cmd_t *converted;
+
+	/** Number of the converted commands */
+	size_t converted_count;
+
+} pwm_pattern_lib_t;
+
+/**
+ * Write patterns library file.
+ *
+ * The file is written atomically (to the temporary file which
+ * is renamed afterwards).
+ *
+ * @param[in] file     Output file name
+ * @param[in] patterns Array of the patterns
+ * @param[in] count    Number of the patterns
+ *
+ * @return PWM_E_OK Success
+ * @return PWM_E_NO_MEMORY Out of memory
+ * @return PWM_E_FAILED Invalid or duplicate pattern name
+ * @return PWM_E_IO Can't write file
+ */
+pwm_status_t pwm_pattern_write(
+	const char *file,
+	const pwm_pattern_t *patterns,
+	size_t count
+);
+
+/**
+ * Open (memory-map) patterns library file.
+ *
+ * @param[out] lib  Pointer to the patterns library structure
+ * @param[in]  file Patterns library file name
+ *
+ * @return PWM_E_OK Success
+ * @return PWM_E_IO Can't open or map file
+ * @return PWM_E_FAILED Invalid file format or version
+ */
+pwm_status_t pwm_pattern_open(pwm_pattern_lib_t *lib, const char *file);
+
+/**
+ * Find pattern by the name.
+ *
+ * On little-endian hosts the commands of the program point
+ * directly to the mapped file. The program must not be freed
+ * with @ref pwm_program_free and remains valid until the
+ * library is closed (or, on big-endian hosts, until the next
+ * pattern is found).
+ *
+ * @param[in]  lib     Pointer to the patterns library structure
+ * @param[in]  name    Pattern name
+ * @param[out] program Pointer to the program structure
+ *
+ * @return PWM_E_OK Success
+ * @return PWM_E_NO_PATTERN Pattern is not found
+ * @return PWM_E_NO_MEMORY Out of memory (big-endian hosts only)
+ * @return PWM_E_FAILED Pattern data is corrupted
+ */
+pwm_status_t pwm_pattern_find(
+	pwm_pattern_lib_t *lib,
+	const char *name,
+	pwm_program_t *program
+);
+
+/**
+ * Close patterns library
+ *
+ * @param[in] lib Pointer to the patterns library structure
+ */
+void pwm_pattern_close(pwm_pattern_lib_t *lib);
+
+/* ----------------------------------------------------------------------- */
+
+#endif /* PWM_PATTERN_H_INCLUDED */
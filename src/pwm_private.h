@@ -0,0 +1,289 @@
+/*
+ * SPDX-License-Identifier: WTFPL
+ * SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * PWM tool
+ * Copyright © 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file for more details.
+ */
+
+/**
+ * @file
+ * @brief PWM tool private header file
+ *
+ * Definitions shared between the PWM tool library sources.
+ * Not a part of the public API.
+ *
+ * @author Anton Kikin <a.kikin@tano-systems.com>
+ */
+
+#ifndef PWM_PRIVATE_H_INCLUDED
+#define PWM_PRIVATE_H_INCLUDED
+
+#include <stdint.h>       /* uint64_t */
+#include <stdlib.h>       /* malloc() */
+#include <time.h>         /* clock_gettime() */
+
+#include "pwm_trace.h"
+#include "pwm_metrics.h"
+#include "pwm_arena.h"
+
+/* ----------------------------------------------------------------------- */
+
+#ifndef SYSFS_PWM_ROOT
+
+/**
+ * Default root in sysfs for PWM control. Can be overridden
+ * at runtime, see @ref pwm_set_sysfs_root.
+ *
+ * Full sysfs path for specified PWM channel is:
+ * <code>
+ * sprintf(path, SYSFS_PWM_ROOT"/"
+ *               SYSFS_PWM_CHIP_FOLDER_FMT"/"
+ *               SYSFS_PWM_CH_FOLDER_FMT,
+ *               chip, ch);
+ * </code>
+ */
+#define SYSFS_PWM_ROOT  "/sys/class/pwm"
+#endif
+
+#ifndef SYSFS_PWM_CHIP_FOLDER_FMT
+
+/**
+ * Format for PWM chip number subfolder in sysfs
+ *
+ * @see SYSFS_PWM_ROOT
+ */
+#define SYSFS_PWM_CHIP_FOLDER_FMT  "pwmchip%u"
+#endif
+
+#ifndef SYSFS_PWM_CH_FOLDER_FMT
+
+/**
+ * Format for PWM channel number subfolder in sysfs
+ *
+ * @see SYSFS_PWM_ROOT
+ */
+#define SYSFS_PWM_CH_FOLDER_FMT  "pwm%u"
+#endif
+
+#ifndef SYSFS_PWM_FILE_ENABLE
+
+/** File name in sysfs for control enabled state of the PWM */
+#define SYSFS_PWM_FILE_ENABLE  "enable"
+#endif
+
+#ifndef SYSFS_PWM_FILE_PERIOD
+
+/** File name in sysfs for control period of the PWM */
+#define SYSFS_PWM_FILE_PERIOD  "period"
+#endif
+
+#ifndef SYSFS_PWM_FILE_DUTY_CYCLE
+
+/** File name in sysfs for control duty-cycle of the PWM */
+#define SYSFS_PWM_FILE_DUTY_CYCLE  "duty_cycle"
+#endif
+
+#ifndef SYSFS_PWM_FILE_POLARITY
+
+/** File name in sysfs for control polarity of the PWM */
+#define SYSFS_PWM_FILE_POLARITY  "polarity"
+#endif
+
+#ifndef SYSFS_PWM_FILE_NPWM
+
+/** File name in sysfs with the number of the PWM chip channels */
+#define SYSFS_PWM_FILE_NPWM  "npwm"
+#endif
+
+#ifndef SYSFS_PWM_FILE_EXPORT
+
+/** File name in sysfs for exporting PWM chip channels */
+#define SYSFS_PWM_FILE_EXPORT  "export"
+#endif
+
+#ifndef SYSFS_PWM_FILE_UNEXPORT
+
+/** File name in sysfs for unexporting PWM chip channels */
+#define SYSFS_PWM_FILE_UNEXPORT  "unexport"
+#endif
+
+#ifndef SYSFS_PWM_LINK_DEVICE
+
+/** Link in sysfs to the PWM chip backing device */
+#define SYSFS_PWM_LINK_DEVICE  "device"
+#endif
+
+#ifndef SYSFS_PWM_FILE_LABEL
+
+/**
+ * File name (relative to the PWM chip folder) with
+ * the optional backing device label
+ */
+#define SYSFS_PWM_FILE_LABEL  "device/of_node/label"
+#endif
+
+#ifndef PWM_EXPORT_RECHECK_MS
+
+/**
+ * Interval in milliseconds for rechecking the PWM channel
+ * readiness while waiting for it after exporting
+ */
+#define PWM_EXPORT_RECHECK_MS  10
+#endif
+
+#ifndef PWM_INDEX_FILE
+
+/**
+ * Default PWM chips index cache file. Can be overridden
+ * at runtime with @ref PWM_ENV_INDEX_FILE environment variable.
+ *
+ * Keeping the index on tmpfs guarantees that it is dropped
+ * on reboot, when the chips numbering is most likely to change.
+ */
+#define PWM_INDEX_FILE  "/run/pwm-tool.index"
+#endif
+
+/** PWM attribute bit in the @ref pwm_t.unknown mask */
+#define PWM_ATTR_BIT(attr)  (1U << (attr))
+
+/** All PWM attributes mask */
+#define PWM_ATTR_ALL  (PWM_ATTR_BIT(PWM_ATTR_ENABLE) | \
+                       PWM_ATTR_BIT(PWM_ATTR_PERIOD) | \
+                       PWM_ATTR_BIT(PWM_ATTR_DUTY_CYCLE) | \
+                       PWM_ATTR_BIT(PWM_ATTR_POLARITY))
+
+/* ----------------------------------------------------------------------- */
+
+/**
+ * Get current CLOCK_MONOTONIC time in nanoseconds
+ */
+static inline uint64_t pwm_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Increment metrics counter. Relaxed ordering is enough,
+ * counters are only read for reporting.
+ */
+static inline void pwm_metrics_inc(uint64_t *counter, uint64_t value)
+{
+	__atomic_add_fetch(counter, value, __ATOMIC_RELAXED);
+}
+
+/**
+ * Count PWM attribute write
+ */
+static inline void pwm_metrics_write(
+	pwm_metrics_t *metrics,
+	pwm_attr_t attr,
+	int error
+)
+{
+	pwm_metrics_inc(&metrics->writes[attr], 1);
+
+	if (error) {
+		pwm_metrics_inc(&metrics->write_errors[
+			(error < PWM_METRICS_ERRNOS) ? error : 0], 1);
+	}
+}
+
+/**
+ * Count sleep lateness (wakeup time after the deadline)
+ */
+static inline void pwm_metrics_sleep(pwm_metrics_t *metrics, uint64_t late_ns)
+{
+	static const uint64_t bounds[PWM_METRICS_LATE_BUCKETS - 1] = {
+		10000, 50000, 100000, 500000, 1000000, 5000000, 10000000,
+	};
+
+	unsigned int i = 0;
+
+	while ((i < PWM_METRICS_LATE_BUCKETS - 1) && (late_ns > bounds[i]))
+		i++;
+
+	pwm_metrics_inc(&metrics->late_buckets[i], 1);
+	pwm_metrics_inc(&metrics->late_sum_ns, late_ns);
+}
+
+/**
+ * Count worker queue depth at enqueue
+ */
+static inline void pwm_metrics_depth(pwm_metrics_t *metrics, uint64_t depth)
+{
+	unsigned int i = 0;
+
+	while ((i < PWM_METRICS_DEPTH_BUCKETS - 1) && (depth > (1ULL << i)))
+		i++;
+
+	pwm_metrics_inc(&metrics->depth_buckets[i], 1);
+	pwm_metrics_inc(&metrics->depth_sum, depth);
+}
+
+/**
+ * Allocate memory from the arena (from the heap if arena is NULL,
+ * except in the zero-heap build)
+ */
+static inline void *pwm_mem_alloc(pwm_arena_t *arena, size_t size)
+{
+#ifndef PWM_NO_HEAP
+	if (!arena)
+		return malloc(size);
+#endif
+
+	return pwm_arena_alloc(arena, size);
+}
+
+/**
+ * Resize memory block allocated with @ref pwm_mem_alloc
+ */
+static inline void *pwm_mem_resize(
+	pwm_arena_t *arena,
+	void *ptr,
+	size_t old_size,
+	size_t size
+)
+{
+#ifndef PWM_NO_HEAP
+	if (!arena)
+		return realloc(ptr, size);
+#endif
+
+	return pwm_arena_resize(arena, ptr, old_size, size);
+}
+
+/**
+ * Free memory block allocated with @ref pwm_mem_alloc
+ */
+static inline void pwm_mem_free(pwm_arena_t *arena, void *ptr, size_t size)
+{
+#ifndef PWM_NO_HEAP
+	if (!arena) {
+		free(ptr);
+		return;
+	}
+#endif
+
+	pwm_arena_free(arena, ptr, size);
+}
+
+/**
+ * Reserve the next event in the trace ring buffer.
+ * Async-signal-safe and thread-safe.
+ */
+static inline pwm_trace_event_t *pwm_trace_next(pwm_trace_t *trace)
+{
+	uint64_t n = __atomic_fetch_add(&trace->count, 1, __ATOMIC_RELAXED);
+	return &trace->events[n % trace->capacity];
+}
+
+/* ----------------------------------------------------------------------- */
+
+#endif /* PWM_PRIVATE_H_INCLUDED */
@@ -0,0 +1,173 @@
+/*
+ * SPDX-License-Identifier: WTFPL
+ * SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * PWM tool
+ * Copyright © 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file for more details.
+ */
+
+/**
+ * @file
+ * @brief PWM execution tracing
+ *
+ * @author Anton Kikin <a.kikin@tano-systems.com>
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pwm.h"
+#include "pwm_trace.h"
+#include "pwm_private.h"
+
+/* ----------------------------------------------------------------------- */
+
+static const char *pwm_trace_attr_names[] = {
+	[PWM_ATTR_ENABLE]     = SYSFS_PWM_FILE_ENABLE,
+	[PWM_ATTR_PERIOD]     = SYSFS_PWM_FILE_PERIOD,
+	[PWM_ATTR_DUTY_CYCLE] = SYSFS_PWM_FILE_DUTY_CYCLE,
+	[PWM_ATTR_POLARITY]   = SYSFS_PWM_FILE_POLARITY,
+};
+
+pwm_status_t pwm_trace_init(
+	pwm_trace_t *trace,
+	pwm_trace_event_t *events,
+	size_t capacity
+)
+{
+	if (!events || !capacity)
+		return PWM_E_FAILED;
+
+	memset(trace, 0, sizeof(pwm_trace_t));
+
+	trace->events   = events;
+	trace->capacity = capacity;
+
+	return PWM_E_OK;
+}
+
+void pwm_trace_attach(pwm_t *pwm, pwm_trace_t *trace)
+{
+	pwm->trace = trace;
+}
+
+void pwm_trace_signal(pwm_trace_t *trace, int signo)
+{
+	pwm_trace_event_t *ev = pwm_trace_next(trace);
+
+	ev->type         = PWM_TRACE_SIGNAL;
+	ev->ts_ns        = pwm_time_ns();
+	ev->dur_ns       = 0;
+	ev->chip         = 0;
+	ev->channel      = 0;
+	ev->signal.signo = signo;
+}
+
+/* ----------------------------------------------------------------------- */
+
+/**
+ * Print nanoseconds value as microseconds
+ */
+static void pwm_trace_print_us(FILE *f, const char *name, uint64_t ns)
+{
+	fprintf(f, "\"%s\":%llu.%03u", name,
+		(unsigned long long)(ns / 1000), (unsigned int)(ns % 1000));
+}
+
+static void pwm_trace_print_event(FILE *f, const pwm_trace_event_t *ev)
+{
+	fputs("{", f);
+
+	switch (ev->type) {
+		case PWM_TRACE_FETCH:
+			fprintf(f, "\"name\":\"cmd %u\",\"cat\":\"fetch\","
+				"\"ph\":\"i\",\"s\":\"t\",",
+				ev->fetch.index);
+			break;
+
+		case PWM_TRACE_WRITE:
+			fprintf(f, "\"name\":\"write %s\",\"cat\":\"write\",\"ph\":\"X\",",
+				pwm_trace_attr_names[ev->write.attr]);
+			pwm_trace_print_us(f, "dur", ev->dur_ns);
+			fputs(",", f);
+			break;
+
+		case PWM_TRACE_SLEEP:
+			fputs("\"name\":\"sleep\",\"cat\":\"sleep\",\"ph\":\"X\",", f);
+			pwm_trace_print_us(f, "dur", ev->dur_ns);
+			fputs(",", f);
+			break;
+
+		case PWM_TRACE_SIGNAL:
+			fprintf(f, "\"name\":\"signal %d\",\"cat\":\"signal\","
+				"\"ph\":\"i\",\"s\":\"g\",",
+				ev->signal.signo);
+			break;
+	}
+
+	pwm_trace_print_us(f, "ts", ev->ts_ns);
+	fprintf(f, ",\"pid\":%u,\"tid\":%u,\"args\":{", ev->chip, ev->channel);
+
+	switch (ev->type) {
+		case PWM_TRACE_FETCH:
+			fprintf(f, "\"frequency_hz\":%u,\"duration_ms\":%u,\"flags\":%u",
+				ev->fetch.frequency_hz,
+				ev->fetch.duration_ms,
+				ev->fetch.flags);
+			break;
+
+		case PWM_TRACE_WRITE:
+			fprintf(f, "\"value\":%u,\"error\":%d",
+				ev->write.value, ev->write.error);
+			break;
+
+		case PWM_TRACE_SLEEP:
+			/* Wakeup latency (actual wakeup time - requested time) */
+			fprintf(f, "\"late_ns\":%lld,\"error\":%d",
+				(long long)(ev->ts_ns + ev->dur_ns - ev->sleep.deadline_ns),
+				ev->sleep.error);
+			break;
+
+		case PWM_TRACE_SIGNAL:
+			fprintf(f, "\"signo\":%d", ev->signal.signo);
+			break;
+	}
+
+	fputs("}}", f);
+}
+
+pwm_status_t pwm_trace_save(const pwm_trace_t *trace, const char *file)
+{
+	uint64_t count = __atomic_load_n(&trace->count, __ATOMIC_ACQUIRE);
+	uint64_t first = 0;
+	uint64_t i;
+	FILE *f;
+
+	/* Oldest events are overwritten */
+	if (count > trace->capacity)
+		first = count - trace->capacity;
+
+	f = fopen(file, "we");
+	if (!f)
+		return PWM_E_IO;
+
+	fputs("{\"traceEvents\":[\n", f);
+
+	for (i = first; i < count; i++) {
+		pwm_trace_print_event(f, &trace->events[i % trace->capacity]);
+		fputs((i + 1 < count) ? ",\n" : "\n", f);
+	}
+
+	fprintf(f, "],\"displayTimeUnit\":\"ns\","
+		"\"otherData\":{\"events\":%llu,\"dropped\":%llu}}\n",
+		(unsigned long long)count, (unsigned long long)first);
+
+	if (fclose(f))
+		return PWM_E_IO;
+
+	return PWM_E_OK;
+}
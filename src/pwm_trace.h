@@ -0,0 +1,196 @@
+/*
+ * SPDX-License-Identifier: WTFPL
+ * SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * PWM tool
+ * Copyright © 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file for more details.
+ */
+
+/**
+ * @file
+ * @brief PWM execution tracing header file
+ *
+ * The trace records script commands fetching, PWM attributes
+ * writes, sleeps and signals into the ring buffer preallocated
+ * by the caller. Recording does not allocate memory and does
+ * not perform any I/O, so it does not disturb the measured
+ * timings. The collected events are saved afterwards in the
+ * Chrome trace event format (can be opened in Perfetto or
+ * chrome://tracing).
+ *
+ * @author Anton Kikin <a.kikin@tano-systems.com>
+ */
+
+#ifndef PWM_TRACE_H_INCLUDED
+#define PWM_TRACE_H_INCLUDED
+
+#include <stdint.h>
+
+#include "pwm.h"
+
+/* ----------------------------------------------------------------------- */
+
+/**
+ * Trace event types
+ */
+typedef enum {
+	/** Script command is fetched */
+	PWM_TRACE_FETCH = 0,
+
+	/** PWM attribute is written */
+	PWM_TRACE_WRITE,
+
+	/** Execution is sleeping until the command deadline */
+	PWM_TRACE_SLEEP,
+
+	/** Signal is received */
+	PWM_TRACE_SIGNAL,
+
+} pwm_trace_type_t;
+
+/**
+ * PWM attributes
+ */
+typedef enum {
+	PWM_ATTR_ENABLE = 0,
+	PWM_ATTR_PERIOD,
+	PWM_ATTR_DUTY_CYCLE,
+	PWM_ATTR_POLARITY,
+} pwm_attr_t;
+
+/**
+ * Trace event
+ */
+typedef struct {
+	/** Event type */
+	pwm_trace_type_t type;
+
+	/** Event start time in nanoseconds (CLOCK_MONOTONIC) */
+	uint64_t ts_ns;
+
+	/** Event duration in nanoseconds */
+	uint64_t dur_ns;
+
+	/** PWM chip number */
+	unsigned int chip;
+
+	/** PWM channel number */
+	unsigned int channel;
+
+	union {
+		/** PWM_TRACE_FETCH event data */
+		struct {
+			/** Command index in the program */
+			unsigned int index;
+
+			/** Frequency in Hz */
+			unsigned int frequency_hz;
+
+			/** Duration in milliseconds */
+			unsigned int duration_ms;
+
+			/** Command flags (PWM_CMD_FLAG_*) */
+			unsigned int flags;
+		} fetch;
+
+		/** PWM_TRACE_WRITE event data */
+		struct {
+			/** Written attribute */
+			pwm_attr_t attr;
+
+			/** Written value */
+			unsigned int value;
+
+			/** Write result (0 or errno value) */
+			int error;
+		} write;
+
+		/** PWM_TRACE_SLEEP event data */
+		struct {
+			/** Requested wakeup time in nanoseconds */
+			uint64_t deadline_ns;
+
+			/** Sleep result (0 or errno value) */
+			int error;
+		} sleep;
+
+		/** PWM_TRACE_SIGNAL event data */
+		struct {
+			/** Signal number */
+			int signo;
+		} signal;
+	};
+
+} pwm_trace_event_t;
+
+/**
+ * Trace ring buffer
+ *
+ * All fields are private and must not be accessed directly.
+ */
+typedef struct pwm_trace {
+	/** Events storage */
+	pwm_trace_event_t *events;
+
+	/** Number of the events in the storage */
+	uint64_t capacity;
+
+	/**
+	 * Total number of the recorded events. When the storage
+	 * is full, the oldest events are overwritten.
+	 */
+	uint64_t count;
+
+} pwm_trace_t;
+
+/**
+ * Initialize trace ring buffer.
+ *
+ * @param[out] trace    Pointer to the trace structure
+ * @param[in]  events   Events storage
+ * @param[in]  capacity Number of the events in the storage
+ *
+ * @return PWM_E_OK Success
+ * @return PWM_E_FAILED Invalid arguments
+ */
+pwm_status_t pwm_trace_init(
+	pwm_trace_t *trace,
+	pwm_trace_event_t *events,
+	size_t capacity
+);
+
+/**
+ * Attach trace to the PWM handle. All writes and sleeps
+ * performed for the handle are recorded.
+ *
+ * @param[in] pwm   Pointer to the PWM handle structure
+ * @param[in] trace Pointer to the trace structure (NULL to detach)
+ */
+void pwm_trace_attach(pwm_t *pwm, pwm_trace_t *trace);
+
+/**
+ * Record signal event. Async-signal-safe.
+ *
+ * @param[in] trace Pointer to the trace structure
+ * @param[in] signo Signal number
+ */
+void pwm_trace_signal(pwm_trace_t *trace, int signo);
+
+/**
+ * Save recorded events in the Chrome trace event format.
+ *
+ * @param[in] trace Pointer to the trace structure
+ * @param[in] file  Output file name
+ *
+ * @return PWM_E_OK Success
+ * @return PWM_E_IO Can't write file
+ */
+pwm_status_t pwm_trace_save(const pwm_trace_t *trace, const char *file);
+
+/* ----------------------------------------------------------------------- */
+
+#endif /* PWM_TRACE_H_INCLUDED */
@@ -0,0 +1,762 @@
+/*
+ * SPDX-License-Identifier: WTFPL
+ * SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * PWM tool
+ * Copyright © 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file for more details.
+ */
+
+/**
+ * @file
+ * @brief PWM background worker
+ *
+ * Queue is a bounded lock-free ring based on the per-slot sequence
+ * numbers (D. Vyukov's algorithm). Dequeue is multi-consumer safe,
+ * which is used by the producers to drop the oldest request with
+ * @ref PWM_WORKER_OVERFLOW_REPLACE policy.
+ *
+ * @author Anton Kikin <a.kikin@tano-systems.com>
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>       /* INT_MAX */
+#include <poll.h>         /* poll() */
+#include <sys/eventfd.h>  /* eventfd() */
+#include <sys/syscall.h>  /* SYS_futex */
+#include <linux/futex.h>  /* FUTEX_WAIT */
+
+#include "pwm.h"
+#include "pwm_worker.h"
+#include "pwm_private.h"
+
+/* ----------------------------------------------------------------------- */
+
+static uint64_t pwm_worker_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void pwm_atomic_max(uint64_t *ptr, uint64_t value)
+{
+	uint64_t cur = __atomic_load_n(ptr, __ATOMIC_RELAXED);
+
+	while (value > cur) {
+		if (__atomic_compare_exchange_n(ptr, &cur, value, 1,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			break;
+	}
+}
+
+static void pwm_atomic_inc(uint64_t *ptr, uint64_t value)
+{
+	__atomic_add_fetch(ptr, value, __ATOMIC_RELAXED);
+}
+
+/* ----------------------------------------------------------------------- */
+
+/**
+ * Push request into the queue
+ *
+ * @return 0 on success
+ * @return <0 if queue is full
+ */
+static int pwm_queue_push(
+	pwm_worker_t *w,
+	const pwm_request_t *req,
+	uint64_t ts
+)
+{
+	pwm_worker_slot_t *slot;
+	uint64_t pos = __atomic_load_n(&w->tail, __ATOMIC_RELAXED);
+	uint64_t seq;
+	int64_t dif;
+
+	for (;;) {
+		slot = &w->slots[pos & w->mask];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		dif = (int64_t)(seq - pos);
+
+		if (!dif) {
+			if (__atomic_compare_exchange_n(&w->tail, &pos, pos + 1, 1,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		}
+		else if (dif < 0) {
+			return -1;
+		}
+		else {
+			pos = __atomic_load_n(&w->tail, __ATOMIC_RELAXED);
+		}
+	}
+
+	slot->req = *req;
+	slot->ts  = ts;
+
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+	/* Head may be already moved forward by the concurrent pops */
+	dif = (int64_t)(pos + 1 - __atomic_load_n(&w->head, __ATOMIC_RELAXED));
+	if (dif > 0) {
+		pwm_atomic_max(&w->stats.depth_max, (uint64_t)dif);
+
+		if (w->metrics)
+			pwm_metrics_depth(w->metrics, (uint64_t)dif);
+	}
+
+	return 0;
+}
+
+/**
+ * Pop oldest request from the queue
+ *
+ * @return 0 on success
+ * @return <0 if queue is empty
+ */
+static int pwm_queue_pop(
+	pwm_worker_t *w,
+	pwm_request_t *req,
+	uint64_t *ts
+)
+{
+	pwm_worker_slot_t *slot;
+	uint64_t pos = __atomic_load_n(&w->head, __ATOMIC_RELAXED);
+	uint64_t seq;
+	int64_t dif;
+
+	for (;;) {
+		slot = &w->slots[pos & w->mask];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		dif = (int64_t)(seq - (pos + 1));
+
+		if (!dif) {
+			if (__atomic_compare_exchange_n(&w->head, &pos, pos + 1, 1,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		}
+		else if (dif < 0) {
+			return -1;
+		}
+		else {
+			pos = __atomic_load_n(&w->head, __ATOMIC_RELAXED);
+		}
+	}
+
+	*req = slot->req;
+	*ts  = slot->ts;
+
+	__atomic_store_n(&slot->seq, pos + w->mask + 1, __ATOMIC_RELEASE);
+
+	/* Wake up producers blocked on the full queue */
+	__atomic_add_fetch(&w->space_seq, 1, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&w->space_waiters, __ATOMIC_SEQ_CST)) {
+		syscall(SYS_futex, &w->space_seq, FUTEX_WAKE_PRIVATE,
+			INT_MAX, NULL, NULL, 0);
+	}
+
+	return 0;
+}
+
+/**
+ * Wait until the worker frees any queue slot
+ */
+static void pwm_queue_wait_space(pwm_worker_t *w, uint32_t seq)
+{
+	__atomic_add_fetch(&w->space_waiters, 1, __ATOMIC_SEQ_CST);
+
+	syscall(SYS_futex, &w->space_seq, FUTEX_WAIT_PRIVATE,
+		seq, NULL, NULL, 0);
+
+	__atomic_sub_fetch(&w->space_waiters, 1, __ATOMIC_SEQ_CST);
+}
+
+/* ----------------------------------------------------------------------- */
+
+/**
+ * Get running job of the channel
+ */
+static pwm_worker_job_t *pwm_worker_top(pwm_worker_channel_t *ch)
+{
+	return ch->depth ? &ch->jobs[ch->depth - 1] : NULL;
+}
+
+/**
+ * Remove job from the channel jobs stack
+ */
+static void pwm_worker_job_remove(pwm_worker_channel_t *ch, unsigned int idx)
+{
+	memmove(&ch->jobs[idx], &ch->jobs[idx + 1],
+		(ch->depth - idx - 1) * sizeof(pwm_worker_job_t));
+
+	ch->depth--;
+}
+
+/**
+ * Discard job without any PWM changes
+ */
+static void pwm_worker_job_discard(
+	pwm_worker_t *w,
+	pwm_worker_channel_t *ch,
+	unsigned int idx
+)
+{
+	pwm_execute_suspend(&ch->jobs[idx].ex);
+	pwm_execute_cancel(&ch->jobs[idx].ex);
+	pwm_worker_job_remove(ch, idx);
+	pwm_atomic_inc(&w->stats.discarded, 1);
+}
+
+/**
+ * Get program arena of the channel not used by any of its jobs.
+ * At most @ref PWM_WORKER_SUSPEND_MAX jobs are left when the new
+ * job is initialized, so the channel always has a free arena.
+ *
+ * @return Pointer to the arena (reset)
+ * @return NULL if the worker has no programs storage
+ */
+static pwm_arena_t *pwm_worker_arena(pwm_worker_channel_t *ch)
+{
+	unsigned int i;
+	unsigned int j;
+
+	if (!ch->arenas[0].base)
+		return NULL;
+
+	for (i = 0; i <= PWM_WORKER_SUSPEND_MAX; i++) {
+		for (j = 0; j < ch->depth; j++) {
+			if (ch->jobs[j].ex.compiled.arena == &ch->arenas[i])
+				break;
+		}
+
+		if (j == ch->depth) {
+			pwm_arena_reset(&ch->arenas[i]);
+			return &ch->arenas[i];
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Initialize job from the request. Execution is started,
+ * but no commands are executed until the first dispatch.
+ */
+static pwm_status_t pwm_worker_job_init(
+	pwm_worker_t *w,
+	pwm_worker_channel_t *ch,
+	pwm_worker_job_t *job,
+	const pwm_request_t *req
+)
+{
+	pwm_status_t ret;
+
+	pwm_execute_config_t config = {
+		.script               = req->script,
+		.default_frequency_hz = req->default_frequency_hz,
+		.default_duration_ms  = req->default_duration_ms,
+		.program              = req->program,
+		.error_cb             = w->error_cb,
+		.error_arg            = w->error_arg,
+		.arena                = req->program ? NULL : pwm_worker_arena(ch),
+	};
+
+	job->priority = req->priority;
+	job->flags    = req->flags;
+
+	ret = pwm_execute_start(&job->ex, ch->pwm, &config, NULL);
+	if (ret != PWM_E_OK)
+		pwm_atomic_inc(&w->stats.failed, 1);
+
+	return ret;
+}
+
+/**
+ * Start pending request as the running job of the channel
+ */
+static void pwm_worker_pending_start(
+	pwm_worker_t *w,
+	pwm_worker_channel_t *ch
+)
+{
+	pwm_request_t req = ch->pending;
+
+	ch->has_pending = 0;
+
+	if (pwm_worker_job_init(w, ch, &ch->jobs[ch->depth], &req) == PWM_E_OK)
+		ch->depth++;
+}
+
+/**
+ * Advance the running job of the channel. Finished job
+ * is removed and the next job is resumed (or pending
+ * request is started).
+ */
+static void pwm_worker_top_dispatch(pwm_worker_t *w, pwm_worker_channel_t *ch)
+{
+	pwm_worker_job_t *job;
+	pwm_status_t ret;
+
+	while (((job = pwm_worker_top(ch)) != NULL) || ch->has_pending) {
+		/*
+		 * Job waited by the pending request is gone (replaced
+		 * by the request which is failed to start)
+		 */
+		if (!job) {
+			pwm_worker_pending_start(w, ch);
+			continue;
+		}
+
+		if (job->ex.suspended) {
+			if (pwm_execute_resume(&job->ex) == PWM_E_OK) {
+				pwm_atomic_inc(&w->stats.resumed, 1);
+				continue;
+			}
+
+			ret = pwm_execute_status(&job->ex);
+		}
+		else {
+			ret = pwm_execute_dispatch(&job->ex);
+			if (ret == PWM_E_AGAIN)
+				return;
+		}
+
+		if (ret == PWM_E_OK)
+			pwm_atomic_inc(&w->stats.executed, 1);
+		else
+			pwm_atomic_inc(&w->stats.failed, 1);
+
+		pwm_worker_job_remove(ch, ch->depth - 1);
+
+		if (ch->has_pending)
+			pwm_worker_pending_start(w, ch);
+	}
+}
+
+/**
+ * Start request as the running job of the channel
+ */
+static void pwm_worker_push(
+	pwm_worker_t *w,
+	pwm_worker_channel_t *ch,
+	const pwm_request_t *req
+)
+{
+	/* Lowest priority job is dropped if stack is full */
+	if (ch->depth > PWM_WORKER_SUSPEND_MAX)
+		pwm_worker_job_discard(w, ch, 0);
+
+	if (pwm_worker_job_init(w, ch, &ch->jobs[ch->depth], req) == PWM_E_OK)
+		ch->depth++;
+
+	/* Start immediately (or resume preempted job on failure) */
+	pwm_worker_top_dispatch(w, ch);
+}
+
+/**
+ * Preempt running job of the channel by the request
+ */
+static void pwm_worker_preempt(
+	pwm_worker_t *w,
+	pwm_worker_channel_t *ch,
+	const pwm_request_t *req,
+	uint64_t ts
+)
+{
+	pwm_worker_job_t *job = pwm_worker_top(ch);
+	uint64_t ns;
+
+	if (job) {
+		pwm_atomic_inc(&w->stats.preempted, 1);
+
+		if (w->metrics)
+			pwm_metrics_inc(&w->metrics->preemptions, 1);
+
+		if (job->flags & PWM_REQUEST_FLAG_RESUME)
+			pwm_execute_suspend(&job->ex);
+		else
+			pwm_worker_job_discard(w, ch, ch->depth - 1);
+	}
+
+	pwm_worker_push(w, ch, req);
+
+	ns = pwm_worker_now_ns() - ts;
+	pwm_atomic_inc(&w->stats.preempt_ns_total, ns);
+	pwm_atomic_max(&w->stats.preempt_ns_max, ns);
+}
+
+/**
+ * Insert suspended job below the running one
+ */
+static void pwm_worker_insert(
+	pwm_worker_t *w,
+	pwm_worker_channel_t *ch,
+	const pwm_request_t *req
+)
+{
+	pwm_worker_job_t job;
+	unsigned int idx = ch->depth - 1;
+
+	while (idx > 0 && ch->jobs[idx - 1].priority > req->priority)
+		idx--;
+
+	if (ch->depth > PWM_WORKER_SUSPEND_MAX) {
+		if (!idx) {
+			/* Request has the lowest priority */
+			pwm_atomic_inc(&w->stats.discarded, 1);
+			return;
+		}
+
+		pwm_worker_job_discard(w, ch, 0);
+		idx--;
+	}
+
+	if (pwm_worker_job_init(w, ch, &job, req) != PWM_E_OK)
+		return;
+
+	pwm_execute_suspend(&job.ex);
+
+	memmove(&ch->jobs[idx + 1], &ch->jobs[idx],
+		(ch->depth - idx) * sizeof(pwm_worker_job_t));
+
+	ch->jobs[idx] = job;
+	ch->depth++;
+}
+
+/**
+ * Handle lower-priority request (queue or discard)
+ */
+static void pwm_worker_defer(
+	pwm_worker_t *w,
+	pwm_worker_channel_t *ch,
+	const pwm_request_t *req
+)
+{
+	if (req->flags & PWM_REQUEST_FLAG_RESUME)
+		pwm_worker_insert(w, ch, req);
+	else
+		pwm_atomic_inc(&w->stats.discarded, 1);
+}
+
+/**
+ * Handle dequeued request
+ */
+static void pwm_worker_request(
+	pwm_worker_t *w,
+	const pwm_request_t *req,
+	uint64_t ts
+)
+{
+	pwm_worker_channel_t *ch = &w->channels[req->channel];
+	pwm_worker_job_t *job = pwm_worker_top(ch);
+
+	if (!job) {
+		pwm_worker_push(w, ch, req);
+	}
+	else if (req->priority > job->priority) {
+		if (req->flags & PWM_REQUEST_FLAG_PREEMPT_NOW) {
+			pwm_worker_preempt(w, ch, req, ts);
+		}
+		else if (ch->has_pending && (ch->pending.priority > req->priority)) {
+			pwm_worker_defer(w, ch, req);
+		}
+		else {
+			/* Preemption at the deadline of the current command */
+			if (ch->has_pending)
+				pwm_worker_defer(w, ch, &ch->pending);
+
+			ch->pending     = *req;
+			ch->pending_ts  = ts;
+			ch->has_pending = 1;
+		}
+	}
+	else if (req->priority == job->priority) {
+		/* Replace running job */
+		pwm_execute_cancel(&job->ex);
+		pwm_worker_job_remove(ch, ch->depth - 1);
+		pwm_atomic_inc(&w->stats.discarded, 1);
+
+		pwm_worker_push(w, ch, req);
+	}
+	else {
+		pwm_worker_defer(w, ch, req);
+	}
+}
+
+/**
+ * Handle expired timer of the channel running job
+ */
+static void pwm_worker_timer(pwm_worker_t *w, pwm_worker_channel_t *ch)
+{
+	pwm_request_t req;
+
+	if (ch->has_pending) {
+		req = ch->pending;
+		ch->has_pending = 0;
+		pwm_worker_preempt(w, ch, &req, ch->pending_ts);
+	}
+	else {
+		pwm_worker_top_dispatch(w, ch);
+	}
+}
+
+/**
+ * Handle all queued requests
+ */
+static void pwm_worker_drain(pwm_worker_t *w)
+{
+	pwm_request_t req;
+	uint64_t ts;
+	uint64_t now;
+
+	while (!pwm_queue_pop(w, &req, &ts)) {
+		now = pwm_worker_now_ns();
+
+		pwm_atomic_inc(&w->stats.queue_ns_total, now - ts);
+		pwm_atomic_max(&w->stats.queue_ns_max, now - ts);
+
+		pwm_worker_request(w, &req, ts);
+	}
+}
+
+static void *pwm_worker_thread(void *arg)
+{
+	pwm_worker_t *w = (pwm_worker_t *)arg;
+	struct pollfd pfds[PWM_WORKER_CHANNELS_MAX + 1];
+	unsigned int map[PWM_WORKER_CHANNELS_MAX + 1];
+	uint64_t value;
+	unsigned int n;
+	unsigned int i;
+
+	while (!__atomic_load_n(&w->stop, __ATOMIC_ACQUIRE)) {
+		pfds[0].fd = w->event_fd;
+		pfds[0].events = POLLIN;
+		n = 1;
+
+		for (i = 0; i < w->count; i++) {
+			pwm_worker_job_t *job = pwm_worker_top(&w->channels[i]);
+			if (!job)
+				continue;
+
+			pfds[n].fd = job->ex.timer_fd;
+			pfds[n].events = POLLIN;
+			map[n++] = i;
+		}
+
+		if (poll(pfds, n, -1) < 0)
+			continue;
+
+		for (i = 1; i < n; i++) {
+			if (pfds[i].revents)
+				pwm_worker_timer(w, &w->channels[map[i]]);
+		}
+
+		if (pfds[0].revents & POLLIN) {
+			if (read(w->event_fd, &value, sizeof(value)) > 0)
+				pwm_worker_drain(w);
+		}
+	}
+
+	for (i = 0; i < w->count; i++) {
+		pwm_worker_channel_t *ch = &w->channels[i];
+
+		/* Running job is cancelled as usual, suspended are discarded */
+		while (ch->depth) {
+			pwm_execute_cancel(&ch->jobs[ch->depth - 1].ex);
+			ch->depth--;
+		}
+
+		ch->has_pending = 0;
+	}
+
+	return NULL;
+}
+
+/* ----------------------------------------------------------------------- */
+
+pwm_status_t pwm_worker_init(
+	pwm_worker_t *w,
+	const pwm_worker_config_t *config
+)
+{
+	unsigned char *storage = config->arena_storage;
+	size_t size;
+	unsigned int i;
+	unsigned int j;
+
+	memset(w, 0, sizeof(pwm_worker_t));
+
+	/* Stopping the worker after a failed init must not close fd 0 */
+	w->event_fd = -1;
+
+	if (!config->pwms || !config->count ||
+	    (config->count > PWM_WORKER_CHANNELS_MAX))
+		return PWM_E_FAILED;
+
+	/* Capacity must be a power of two */
+	if (!config->slots || (config->capacity < 2) ||
+	    (config->capacity & (config->capacity - 1)))
+		return PWM_E_FAILED;
+
+	w->slots     = config->slots;
+	w->mask      = config->capacity - 1;
+	w->overflow  = config->overflow;
+	w->error_cb  = config->error_cb;
+	w->error_arg = config->error_arg;
+	w->metrics   = config->metrics;
+	w->count     = config->count;
+
+	for (i = 0; i < config->capacity; i++)
+		w->slots[i].seq = i;
+
+	for (i = 0; i < config->count; i++)
+		w->channels[i].pwm = &config->pwms[i];
+
+	/* Programs storage is split into the arenas of the channels jobs */
+	if (storage) {
+		size = config->arena_size /
+			(config->count * (PWM_WORKER_SUSPEND_MAX + 1));
+
+		for (i = 0; i < config->count; i++) {
+			for (j = 0; j <= PWM_WORKER_SUSPEND_MAX; j++) {
+				pwm_arena_init(&w->channels[i].arenas[j], storage, size);
+				storage += size;
+			}
+		}
+	}
+
+	w->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (w->event_fd < 0)
+		return PWM_E_FAILED;
+
+	return PWM_E_OK;
+}
+
+pwm_status_t pwm_worker_start(pwm_worker_t *w)
+{
+	if (w->running)
+		return PWM_E_OK;
+
+	__atomic_store_n(&w->stop, 0, __ATOMIC_RELEASE);
+
+	if (pthread_create(&w->thread, NULL, pwm_worker_thread, w))
+		return PWM_E_FAILED;
+
+	w->running = 1;
+	return PWM_E_OK;
+}
+
+pwm_status_t pwm_worker_stop(pwm_worker_t *w)
+{
+	uint64_t value = 1;
+
+	if (w->running) {
+		__atomic_store_n(&w->stop, 1, __ATOMIC_RELEASE);
+
+		if (write(w->event_fd, &value, sizeof(value)) < 0) {
+			/* Counter overflow, worker is woken up anyway */
+		}
+
+		pthread_join(w->thread, NULL);
+		w->running = 0;
+	}
+
+	if (w->event_fd >= 0) {
+		close(w->event_fd);
+		w->event_fd = -1;
+	}
+
+	return PWM_E_OK;
+}
+
+pwm_status_t pwm_worker_submit(
+	pwm_worker_t *w,
+	const pwm_request_t *req
+)
+{
+	pwm_request_t dropped;
+	uint64_t ts_start;
+	uint64_t ts_end;
+	uint64_t ts;
+	uint64_t value = 1;
+	uint32_t seq;
+
+	if (req->channel >= w->count)
+		return PWM_E_NO_CHANNEL;
+
+	ts_start = pwm_worker_now_ns();
+
+	for (;;) {
+		seq = __atomic_load_n(&w->space_seq, __ATOMIC_SEQ_CST);
+
+		if (!pwm_queue_push(w, req, ts_start))
+			break;
+
+		if (w->overflow == PWM_WORKER_OVERFLOW_DROP) {
+			pwm_atomic_inc(&w->stats.dropped, 1);
+
+			if (w->metrics)
+				pwm_metrics_inc(&w->metrics->dropped, 1);
+
+			return PWM_E_QUEUE_FULL;
+		}
+		else if (w->overflow == PWM_WORKER_OVERFLOW_REPLACE) {
+			if (!pwm_queue_pop(w, &dropped, &ts)) {
+				pwm_atomic_inc(&w->stats.dropped, 1);
+
+				if (w->metrics)
+					pwm_metrics_inc(&w->metrics->dropped, 1);
+			}
+		}
+		else {
+			pwm_queue_wait_space(w, seq);
+		}
+	}
+
+	ts_end = pwm_worker_now_ns();
+
+	pwm_atomic_inc(&w->stats.enqueued, 1);
+	pwm_atomic_inc(&w->stats.enqueue_ns_total, ts_end - ts_start);
+	pwm_atomic_max(&w->stats.enqueue_ns_max, ts_end - ts_start);
+
+	if (write(w->event_fd, &value, sizeof(value)) < 0) {
+		/* Counter overflow, worker is woken up anyway */
+	}
+
+	return PWM_E_OK;
+}
+
+void pwm_worker_stats(pwm_worker_t *w, pwm_worker_stats_t *stats)
+{
+	stats->enqueued = __atomic_load_n(&w->stats.enqueued, __ATOMIC_RELAXED);
+	stats->dropped  = __atomic_load_n(&w->stats.dropped, __ATOMIC_RELAXED);
+	stats->executed = __atomic_load_n(&w->stats.executed, __ATOMIC_RELAXED);
+	stats->failed   = __atomic_load_n(&w->stats.failed, __ATOMIC_RELAXED);
+
+	stats->enqueue_ns_total =
+		__atomic_load_n(&w->stats.enqueue_ns_total, __ATOMIC_RELAXED);
+	stats->enqueue_ns_max =
+		__atomic_load_n(&w->stats.enqueue_ns_max, __ATOMIC_RELAXED);
+	stats->queue_ns_total =
+		__atomic_load_n(&w->stats.queue_ns_total, __ATOMIC_RELAXED);
+	stats->queue_ns_max =
+		__atomic_load_n(&w->stats.queue_ns_max, __ATOMIC_RELAXED);
+	stats->depth_max =
+		__atomic_load_n(&w->stats.depth_max, __ATOMIC_RELAXED);
+
+	stats->preempted = __atomic_load_n(&w->stats.preempted, __ATOMIC_RELAXED);
+	stats->resumed   = __atomic_load_n(&w->stats.resumed, __ATOMIC_RELAXED);
+	stats->discarded = __atomic_load_n(&w->stats.discarded, __ATOMIC_RELAXED);
+
+	stats->preempt_ns_total =
+		__atomic_load_n(&w->stats.preempt_ns_total, __ATOMIC_RELAXED);
+	stats->preempt_ns_max =
+		__atomic_load_n(&w->stats.preempt_ns_max, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,406 @@
+/*
+ * SPDX-License-Identifier: WTFPL
+ * SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * PWM tool
+ * Copyright © 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file for more details.
+ */
+
+/**
+ * @file
+ * @brief PWM background worker header file
+ *
+ * The worker is a dedicated thread which owns the PWM handles
+ * and executes the scripts requested by any number of producer
+ * threads. Requests are passed through the bounded lock-free
+ * queue, so the producers never block on sysfs writes or sleeps
+ * and never allocate memory.
+ *
+ * @author Anton Kikin <a.kikin@tano-systems.com>
+ */
+
+#ifndef PWM_WORKER_H_INCLUDED
+#define PWM_WORKER_H_INCLUDED
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "pwm.h"
+#include "pwm_arena.h"
+#include "pwm_metrics.h"
+
+/* ----------------------------------------------------------------------- */
+
+#ifndef PWM_WORKER_CHANNELS_MAX
+
+/** Maximum number of the PWM channels owned by the single worker */
+#define PWM_WORKER_CHANNELS_MAX  16
+#endif
+
+#ifndef PWM_WORKER_SUSPEND_MAX
+
+/** Maximum number of the suspended scripts per PWM channel */
+#define PWM_WORKER_SUSPEND_MAX  4
+#endif
+
+/**
+ * Preempt lower-priority script instantly instead
+ * of waiting for the deadline of its current command
+ */
+#define PWM_REQUEST_FLAG_PREEMPT_NOW  0x01
+
+/**
+ * Suspend the script when it is preempted by (or submitted
+ * during) a higher-priority script and resume it afterwards.
+ * Without this flag such script is discarded.
+ */
+#define PWM_REQUEST_FLAG_RESUME       0x02
+
+/**
+ * Queue overflow policy
+ */
+typedef enum {
+	/** New request is dropped */
+	PWM_WORKER_OVERFLOW_DROP = 0,
+
+	/** Oldest queued request is dropped in favour of the new one */
+	PWM_WORKER_OVERFLOW_REPLACE,
+
+	/** Producer waits until the worker frees the queue slot */
+	PWM_WORKER_OVERFLOW_BLOCK,
+
+} pwm_worker_overflow_t;
+
+/**
+ * Worker request structure
+ */
+typedef struct {
+	/** Index of the PWM channel in the worker channels array */
+	unsigned int channel;
+
+	/**
+	 * Precompiled program (see @ref pwm_compile). The program
+	 * is not copied and must remain valid until its execution
+	 * is finished.
+	 */
+	const pwm_program_t *program;
+
+	/**
+	 * Script, used if program is not set. The script is
+	 * compiled by the worker thread. The string is not copied
+	 * and must remain valid until its execution is finished.
+	 */
+	const char *script;
+
+	/** Default frequency in Hz for the script */
+	unsigned int default_frequency_hz;
+
+	/** Default duration in milliseconds for the script */
+	unsigned int default_duration_ms;
+
+	/**
+	 * Priority (higher value is more important). Request with
+	 * the same priority as the current script of the channel
+	 * replaces the current script immediately.
+	 */
+	unsigned int priority;
+
+	/** Request flags (PWM_REQUEST_FLAG_*) */
+	unsigned int flags;
+
+} pwm_request_t;
+
+/**
+ * Worker queue slot (private)
+ */
+typedef struct {
+	/** Slot sequence number */
+	uint64_t seq;
+
+	/** Enqueue timestamp in nanoseconds (CLOCK_MONOTONIC) */
+	uint64_t ts;
+
+	/** Request */
+	pwm_request_t req;
+
+} pwm_worker_slot_t;
+
+/**
+ * Worker statistics
+ */
+typedef struct {
+	/** Number of the enqueued requests */
+	uint64_t enqueued;
+
+	/** Number of the dropped requests (queue overflow) */
+	uint64_t dropped;
+
+	/** Number of the executed requests */
+	uint64_t executed;
+
+	/** Number of the failed requests */
+	uint64_t failed;
+
+	/** Total enqueue latency in nanoseconds */
+	uint64_t enqueue_ns_total;
+
+	/** Maximum enqueue latency in nanoseconds */
+	uint64_t enqueue_ns_max;
+
+	/** Total time in nanoseconds spent by requests in the queue */
+	uint64_t queue_ns_total;
+
+	/** Maximum time in nanoseconds spent by request in the queue */
+	uint64_t queue_ns_max;
+
+	/** Queue depth high-water mark */
+	uint64_t depth_max;
+
+	/** Number of the preemptions by higher-priority scripts */
+	uint64_t preempted;
+
+	/** Number of the resumed scripts */
+	uint64_t resumed;
+
+	/** Number of the discarded (preempted or replaced) scripts */
+	uint64_t discarded;
+
+	/** Total preemption latency (enqueue to first PWM change) in ns */
+	uint64_t preempt_ns_total;
+
+	/** Maximum preemption latency in nanoseconds */
+	uint64_t preempt_ns_max;
+
+} pwm_worker_stats_t;
+
+/**
+ * Worker script job (private)
+ */
+typedef struct {
+	/** Script execution context */
+	pwm_execute_t ex;
+
+	/** Priority */
+	unsigned int priority;
+
+	/** Request flags */
+	unsigned int flags;
+
+} pwm_worker_job_t;
+
+/**
+ * Worker channel state (private)
+ */
+typedef struct {
+	/** PWM handle */
+	pwm_t *pwm;
+
+	/**
+	 * Jobs stack ordered by priority. The last job is
+	 * the running one, others are suspended.
+	 */
+	pwm_worker_job_t jobs[PWM_WORKER_SUSPEND_MAX + 1];
+
+	/** Number of the jobs */
+	unsigned int depth;
+
+	/** Request waiting for the deadline to preempt the running job */
+	pwm_request_t pending;
+
+	/** Enqueue timestamp of the pending request */
+	uint64_t pending_ts;
+
+	/** Non-zero if pending request is set */
+	int has_pending;
+
+	/**
+	 * Arenas of the programs compiled from the request scripts,
+	 * one per job (unused if the worker has no programs storage)
+	 */
+	pwm_arena_t arenas[PWM_WORKER_SUSPEND_MAX + 1];
+
+} pwm_worker_channel_t;
+
+/**
+ * Worker configuration structure
+ */
+typedef struct {
+	/**
+	 * Array of the opened PWM handles. Handles are owned by
+	 * the worker while it is running.
+	 */
+	pwm_t *pwms;
+
+	/** Number of the PWM handles (up to @ref PWM_WORKER_CHANNELS_MAX) */
+	unsigned int count;
+
+	/** Queue slots storage */
+	pwm_worker_slot_t *slots;
+
+	/** Number of the queue slots (must be a power of two) */
+	unsigned int capacity;
+
+	/** Queue overflow policy */
+	pwm_worker_overflow_t overflow;
+
+	/** Error callback (optional, called from the worker thread) */
+	pwm_error_cb_t error_cb;
+
+	/** Error callback user argument */
+	void *error_arg;
+
+	/** Metrics (optional, queue depth, drops and preemptions are counted) */
+	pwm_metrics_t *metrics;
+
+	/**
+	 * Storage of the programs compiled from the request scripts
+	 * (optional). It is split into the equal arenas, one per job
+	 * of each channel, so the memory of a finished script is
+	 * released regardless of the order in which the scripts of
+	 * the channels finish. If not set, scripts are compiled into
+	 * the default arena (see pwm_arena.h), which releases the
+	 * memory only in reverse order of the allocations.
+	 */
+	void *arena_storage;
+
+	/** Size of the programs storage in bytes */
+	size_t arena_size;
+
+} pwm_worker_config_t;
+
+/**
+ * Worker structure
+ *
+ * All fields are private and must not be accessed directly.
+ */
+typedef struct {
+	/** Queue slots */
+	pwm_worker_slot_t *slots;
+
+	/** Queue slots mask (capacity - 1) */
+	uint64_t mask;
+
+	/** Producers position */
+	uint64_t tail __attribute__((aligned(64)));
+
+	/** Consumer position */
+	uint64_t head __attribute__((aligned(64)));
+
+	/** Incremented on each dequeue, used as futex for blocked producers */
+	uint32_t space_seq __attribute__((aligned(64)));
+
+	/** Number of the producers blocked on the full queue */
+	uint32_t space_waiters;
+
+	/** Queue overflow policy */
+	pwm_worker_overflow_t overflow;
+
+	/** Error callback */
+	pwm_error_cb_t error_cb;
+
+	/** Error callback user argument */
+	void *error_arg;
+
+	/** Statistics */
+	pwm_worker_stats_t stats;
+
+	/** Metrics */
+	pwm_metrics_t *metrics;
+
+	/** Channels */
+	pwm_worker_channel_t channels[PWM_WORKER_CHANNELS_MAX];
+
+	/** Number of the channels */
+	unsigned int count;
+
+	/** Worker wakeup event file descriptor */
+	int event_fd;
+
+	/** Worker stop flag */
+	int stop;
+
+	/** Non-zero if the worker thread is running */
+	int running;
+
+	/** Worker thread */
+	pthread_t thread;
+
+} pwm_worker_t;
+
+/**
+ * Initialize the worker.
+ *
+ * @param[out] w      Pointer to the worker structure
+ * @param[in]  config Pointer to the worker configuration structure
+ *
+ * @return PWM_E_OK Success
+ * @return PWM_E_FAILED Invalid configuration
+ */
+pwm_status_t pwm_worker_init(
+	pwm_worker_t *w,
+	const pwm_worker_config_t *config
+);
+
+/**
+ * Start the worker thread.
+ *
+ * @param[in] w Pointer to the worker structure
+ *
+ * @return PWM_E_OK Success
+ * @return PWM_E_FAILED Can't create thread
+ */
+pwm_status_t pwm_worker_start(pwm_worker_t *w);
+
+/**
+ * Stop the worker thread and release worker resources.
+ * Scripts in progress are cancelled, queued requests
+ * are discarded.
+ *
+ * @param[in] w Pointer to the worker structure
+ *
+ * @return PWM_E_OK Success
+ */
+pwm_status_t pwm_worker_stop(pwm_worker_t *w);
+
+/**
+ * Submit request to the worker. Can be called from any thread.
+ *
+ * Request with higher priority than the script running on the
+ * channel preempts it at the deadline of its current command
+ * or instantly (@ref PWM_REQUEST_FLAG_PREEMPT_NOW). Preempted
+ * script is suspended or discarded according to its
+ * @ref PWM_REQUEST_FLAG_RESUME flag. Request with lower
+ * priority is queued behind the running script (if it has
+ * @ref PWM_REQUEST_FLAG_RESUME flag) or discarded.
+ *
+ * The function never allocates memory. It blocks only if
+ * the queue is full and @ref PWM_WORKER_OVERFLOW_BLOCK
+ * policy is used.
+ *
+ * @param[in] w   Pointer to the worker structure
+ * @param[in] req Pointer to the request structure (copied)
+ *
+ * @return PWM_E_OK Request is enqueued
+ * @return PWM_E_QUEUE_FULL Request is dropped (queue is full)
+ * @return PWM_E_NO_CHANNEL Invalid channel index
+ */
+pwm_status_t pwm_worker_submit(
+	pwm_worker_t *w,
+	const pwm_request_t *req
+);
+
+/**
+ * Get the worker statistics snapshot.
+ *
+ * @param[in]  w     Pointer to the worker structure
+ * @param[out] stats Pointer to the statistics structure
+ */
+void pwm_worker_stats(pwm_worker_t *w, pwm_worker_stats_t *stats);
+
+/* ----------------------------------------------------------------------- */
+
+#endif /* PWM_WORKER_H_INCLUDED */
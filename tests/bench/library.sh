@@ -0,0 +1,33 @@
+#!/bin/sh
+#
+# SPDX-License-Identifier: WTFPL
+# SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+#
+# Library script execution benchmark (pwm_execute() call time
+# with the reused PWM handle)
+#
+# Timing test (run serially)
+#
+
+function do_test {
+	local SYSFS
+	local REPORT
+	local TIMES
+
+	[ -f "${PWM_DRIVER_BIN}" ] || test_failed "test driver is not built"
+
+	test_sysfs_create ${DEFAULT_PWM_CHIP} ${DEFAULT_PWM_CHANNEL} SYSFS
+
+	REPORT=($(${PWM_DRIVER_BIN} bench -n 1000 "F1000d0"))
+	test_assert_eq "$?" "0" "benchmark return code"
+	echo "execute: ${REPORT[@]}"
+
+	# Enable and disable writes only, no process startup costs
+	TIMES=(${REPORT[1]#execute_ns=})
+	TIMES=(${TIMES//\// })
+	test_assert_range ${TIMES[1]} 1 1000000 "median call time"
+
+	test_passed
+}
+
+. ${PWM_TEST_ROOT}/pwm-test-common.sh.inc
@@ -0,0 +1,323 @@
+/*
+ * SPDX-License-Identifier: WTFPL
+ * SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * PWM tool
+ * Copyright © 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file for more details.
+ */
+
+/**
+ * @file
+ * @brief Startup latency benchmark
+ *
+ * Runs the command several times and reports the time from exec to
+ * the first PWM attribute write (taken from the fake PWM device log)
+ * and to the exit, and the number of system calls made by the
+ * command (counted in a separate run under ptrace):
+ *
+ * <code>
+ *     pwm-bench [-n <runs>] [-l <fake_log>] <command> [<args>...]
+ * </code>
+ *
+ * Output is a single line of the key=value pairs, times are
+ * in microseconds (min/median/max):
+ *
+ * <code>
+ *     runs=20 first_write_us=210/250/400 exit_us=600/650/900
+ *     syscalls=90 open=12 read=6 write=4
+ * </code>
+ *
+ * The fake PWM device log is written only in the timed runs,
+ * so the logging does not affect the system calls count.
+ *
+ * @author Anton Kikin <a.kikin@tano-systems.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>     /* mmap() */
+#include <sys/ptrace.h>   /* ptrace() */
+#include <sys/syscall.h>  /* SYS_* */
+#include <sys/wait.h>     /* waitpid() */
+
+/* ----------------------------------------------------------------------- */
+
+#define BENCH_RUNS_DEFAULT  20
+#define BENCH_RUNS_MAX      1000
+
+typedef struct {
+	unsigned long total;
+	unsigned long open;
+	unsigned long read;
+	unsigned long write;
+} bench_syscalls_t;
+
+static unsigned long long bench_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int bench_cmp(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return (x > y) - (x < y);
+}
+
+/**
+ * Print min/median/max of the values in microseconds
+ */
+static void bench_print_stats(
+	const char *name,
+	unsigned long long *values,
+	unsigned int count)
+{
+	if (!count) {
+		printf(" %s=-", name);
+		return;
+	}
+
+	qsort(values, count, sizeof(values[0]), bench_cmp);
+
+	printf(" %s=%llu/%llu/%llu", name,
+		values[0] / 1000,
+		values[count / 2] / 1000,
+		values[count - 1] / 1000);
+}
+
+/**
+ * Get timestamp of the first write from the fake PWM device log
+ *
+ * @return 0 on success, -1 if there are no writes in the log
+ */
+static int bench_first_write(const char *log, unsigned long long *ns)
+{
+	char line[512];
+	int ret = -1;
+	FILE *f;
+
+	f = fopen(log, "r");
+	if (!f)
+		return -1;
+
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "W %llu", ns) == 1) {
+			ret = 0;
+			break;
+		}
+	}
+
+	fclose(f);
+	return ret;
+}
+
+/**
+ * Run command once
+ *
+ * @return Command exit status or -1 on failure
+ */
+static int bench_run(
+	char *argv[],
+	unsigned long long *exec_ns,
+	unsigned long long *exit_ns)
+{
+	int status;
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0)
+		return -1;
+
+	if (!pid) {
+		*exec_ns = bench_now_ns();
+		execvp(argv[0], argv);
+		_exit(127);
+	}
+
+	if (waitpid(pid, &status, 0) != pid)
+		return -1;
+
+	*exit_ns = bench_now_ns();
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+/**
+ * Count system calls of the command
+ *
+ * @return 0 on success, -1 on failure
+ */
+static int bench_count_syscalls(char *argv[], bench_syscalls_t *sc)
+{
+	struct __ptrace_syscall_info info;
+	int status;
+	int sig = 0;
+	pid_t pid;
+
+	memset(sc, 0, sizeof(bench_syscalls_t));
+
+	pid = fork();
+	if (pid < 0)
+		return -1;
+
+	if (!pid) {
+		if (ptrace(PTRACE_TRACEME, 0, NULL, NULL))
+			_exit(127);
+
+		execvp(argv[0], argv);
+		_exit(127);
+	}
+
+	/* Child stops at exec */
+	if ((waitpid(pid, &status, 0) != pid) || !WIFSTOPPED(status))
+		return -1;
+
+	ptrace(PTRACE_SETOPTIONS, pid, NULL,
+		PTRACE_O_TRACESYSGOOD | PTRACE_O_EXITKILL);
+
+	for (;;) {
+		if (ptrace(PTRACE_SYSCALL, pid, NULL, (void *)(long)sig))
+			return -1;
+
+		if (waitpid(pid, &status, 0) != pid)
+			return -1;
+
+		if (WIFEXITED(status) || WIFSIGNALED(status))
+			break;
+
+		sig = 0;
+
+		if (WSTOPSIG(status) != (SIGTRAP | 0x80)) {
+			sig = WSTOPSIG(status);
+			continue;
+		}
+
+		if ((ptrace(PTRACE_GET_SYSCALL_INFO, pid,
+				(void *)sizeof(info), &info) <= 0) ||
+		    (info.op != PTRACE_SYSCALL_INFO_ENTRY))
+			continue;
+
+		sc->total++;
+
+		switch (info.entry.nr) {
+#ifdef SYS_open
+			case SYS_open:
+#endif
+			case SYS_openat:
+				sc->open++;
+				break;
+
+			case SYS_read:
+			case SYS_pread64:
+				sc->read++;
+				break;
+
+			case SYS_write:
+			case SYS_pwrite64:
+				sc->write++;
+				break;
+
+			default:
+				break;
+		}
+	}
+
+	return 0;
+}
+
+static void bench_usage(void)
+{
+	fprintf(stderr,
+		"Usage: pwm-bench [-n <runs>] [-l <fake_log>] <command> [<args>...]\n");
+}
+
+int main(int argc, char *argv[])
+{
+	static unsigned long long first_write[BENCH_RUNS_MAX];
+	static unsigned long long exit_time[BENCH_RUNS_MAX];
+	unsigned long long *exec_ns;
+	unsigned long long exit_ns;
+	unsigned long long write_ns;
+	unsigned int runs = BENCH_RUNS_DEFAULT;
+	unsigned int writes = 0;
+	const char *log = NULL;
+	bench_syscalls_t sc;
+	unsigned int i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "+n:l:")) != -1) {
+		switch (opt) {
+			case 'n':
+				runs = (unsigned int)strtoul(optarg, NULL, 0);
+				break;
+
+			case 'l':
+				log = optarg;
+				break;
+
+			default:
+				bench_usage();
+				return 1;
+		}
+	}
+
+	if ((optind >= argc) || !runs || (runs > BENCH_RUNS_MAX)) {
+		bench_usage();
+		return 1;
+	}
+
+	argv += optind;
+
+	/* Exec time is stored by the child */
+	exec_ns = mmap(NULL, sizeof(*exec_ns), PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+	if (exec_ns == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+
+	if (log)
+		setenv("PWM_FAKE_LOG", log, 1);
+
+	for (i = 0; i < runs; i++) {
+		if (log)
+			unlink(log);
+
+		if (bench_run(argv, exec_ns, &exit_ns) != 0) {
+			fprintf(stderr, "ERROR: Command failed\n");
+			return 1;
+		}
+
+		exit_time[i] = exit_ns - *exec_ns;
+
+		if (log && !bench_first_write(log, &write_ns))
+			first_write[writes++] = write_ns - *exec_ns;
+	}
+
+	unsetenv("PWM_FAKE_LOG");
+
+	if (bench_count_syscalls(argv, &sc)) {
+		fprintf(stderr, "ERROR: Can't count system calls\n");
+		return 1;
+	}
+
+	printf("runs=%u", runs);
+	bench_print_stats("first_write_us", first_write, writes);
+	bench_print_stats("exit_us", exit_time, runs);
+	printf(" syscalls=%lu open=%lu read=%lu write=%lu\n",
+		sc.total, sc.open, sc.read, sc.write);
+
+	return 0;
+}
@@ -0,0 +1,49 @@
+#!/bin/sh
+#
+# SPDX-License-Identifier: WTFPL
+# SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+#
+# Startup latency benchmark (exec to the first PWM write)
+#
+# Timing test (run serially)
+#
+
+function bench_run {
+	LD_PRELOAD="${PWM_FAKE_LIB}" ${PWM_BENCH_BIN} -n 20 \
+		-l "${PWM_FAKE_LOG}" ${PWM_TEST_BIN} -d 1 "$@"
+}
+
+function do_test {
+	local SYSFS
+	local REPORT
+	local FAST
+	local WAVE
+	local SC
+
+	[ -f "${PWM_BENCH_BIN}" ] || test_failed "benchmark is not built"
+
+	test_sysfs_create ${DEFAULT_PWM_CHIP} ${DEFAULT_PWM_CHANNEL} SYSFS
+
+	REPORT=($(bench_run))
+	test_assert_eq "$?" "0" "benchmark return code"
+	echo "default:    ${REPORT[@]}"
+
+	FAST=($(bench_run --fast-start))
+	test_assert_eq "$?" "0" "benchmark return code (fast start)"
+	echo "fast start: ${FAST[@]}"
+
+	# Same waveform is produced
+	WAVE=($(test_fake_waveform))
+	test_assert_eq "${WAVE[1]}" "1000000" "period (fast start)"
+	test_assert_eq "$(test_fake_errors)" "0" "rejected writes (fast start)"
+
+	# Fast start skips folder, control files and state lookups
+	SC=${REPORT[4]#syscalls=}
+	test_assert_range ${FAST[4]#syscalls=} 0 $((SC - 5)) "system calls"
+	test_assert_range ${FAST[5]#open=} 0 $((${REPORT[5]#open=} - 3)) "open calls"
+	test_assert_range ${FAST[6]#read=} 0 $((${REPORT[6]#read=} - 2)) "read calls"
+
+	test_passed
+}
+
+. ${PWM_TEST_ROOT}/pwm-test-common.sh.inc
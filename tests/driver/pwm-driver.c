@@ -0,0 +1,721 @@
+/*
+ * SPDX-License-Identifier: WTFPL
+ * SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * PWM tool
+ * Copyright © 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file for more details.
+ */
+
+/**
+ * @file
+ * @brief Library API test driver
+ *
+ * Exercises the library APIs which are not used by the tool on
+ * the PWM channel 0 of the PWM chip 0 (and channel 1 in `channels`
+ * mode, run with the fake PWM device, see fake/pwm-fake.c):
+ *
+ * <code>
+ *     pwm-driver async [-c <cancel_ms>] <script>
+ *     pwm-driver worker [-o drop|replace|block] [-q <capacity>]
+ *         [-p <producers>] [-n <requests>] [-d <start_delay_ms>]
+ *     pwm-driver preempt <at_ms>:<priority>:<flags>:<script>...
+ *     pwm-driver channels [-n <requests>] [-a <arena_size>]
+ *     pwm-driver bench [-n <calls>] <script>
+ * </code>
+ *
+ * - `async`: executes the script with the asynchronous execution
+ *   API in a poll() loop on the returned timer file descriptor.
+ *   Execution is cancelled after `cancel_ms` milliseconds if
+ *   it is still in progress and cancelled once more after it
+ *   is finished.
+ *
+ * - `worker`: each of the producer threads submits the requests
+ *   to the background worker, the worker thread is started after
+ *   the specified delay. Request N of the producer P plays the
+ *   frequency of 1000 + P * requests + N Hz, so the delivery order
+ *   can be taken from the fake PWM device log. All requests have
+ *   the same priority, i.e. each delivered request replaces the
+ *   previous one. Worker is stopped when all delivered requests
+ *   are finished.
+ *
+ * - `preempt`: each request is submitted to the background worker
+ *   at the specified time after the worker start (in the order of
+ *   the arguments). Flags are any of `n` (preempt instantly) and
+ *   `r` (resume after preemption) or `-` for none. Worker is stopped
+ *   when all requests are finished.
+ *
+ * - `channels`: requests are submitted to the background worker
+ *   owning two PWM channels, alternately to each of the channels,
+ *   with the priority cycling from 0 to 2 and the resume flag, so
+ *   the scripts finish in any order. Scripts are compiled into the
+ *   worker programs storage of `arena_size` bytes (4096 by default),
+ *   the default arena is too small for any script. Worker is stopped
+ *   when all requests are finished.
+ *
+ * - `bench`: executes the script with @ref pwm_execute the specified
+ *   number of times (1000 by default) on the same PWM handle and
+ *   reports the time of a call in nanoseconds (min/median/max).
+ *
+ * Output is a single line of the key=value pairs:
+ *
+ * <code>
+ *     start=0 status=0 dispatches=4 cancel=0 fd_closed=1
+ *     enqueued=4 full=6 dropped=6 executed=1 discarded=3 failed=0
+ *     depth_max=4 enqueue_ms_max=0
+ *     executed=2 discarded=0 failed=0 preempted=1 resumed=1
+ *     executed=412 discarded=588 failed=0
+ *     calls=1000 execute_ns=2900/3100/45000
+ * </code>
+ *
+ * @author Anton Kikin <a.kikin@tano-systems.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>        /* fcntl() */
+#include <poll.h>         /* poll() */
+#include <pthread.h>
+#include <time.h>
+
+#include "pwm.h"
+#include "pwm_arena.h"
+#include "pwm_worker.h"
+
+/* ----------------------------------------------------------------------- */
+
+#define DRIVER_PRODUCERS_MAX  16
+#define DRIVER_REQUESTS_MAX   4096
+#define DRIVER_CAPACITY_MAX   1024
+
+/** Time to wait for the delivered requests to finish */
+#define DRIVER_WORKER_TIMEOUT_MS  5000
+
+typedef struct {
+	pwm_worker_t *w;
+
+	/** First request index of the producer */
+	unsigned int first;
+
+	/** Number of the requests */
+	unsigned int count;
+
+} driver_producer_t;
+
+/** Scripts of the worker requests (must be valid until executed) */
+static char driver_scripts[DRIVER_REQUESTS_MAX][32];
+
+/** Maximum number of the requests in preempt mode */
+#define DRIVER_PREEMPT_MAX  16
+
+/** Maximum number of the calls in bench mode */
+#define DRIVER_CALLS_MAX  100000
+
+/** Maximum worker programs storage size in channels mode */
+#define DRIVER_ARENA_MAX  65536
+
+/** Default arena size in channels mode (too small for any script) */
+#define DRIVER_ARENA_DEFAULT  64
+
+/** Number of the requests rejected with PWM_E_QUEUE_FULL */
+static unsigned int driver_full;
+
+static unsigned long long driver_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned long long driver_now_ms(void)
+{
+	return driver_now_ns() / 1000000;
+}
+
+static int driver_cmp(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return (x > y) - (x < y);
+}
+
+/**
+ * Asynchronous script execution
+ *
+ * @return 0 on success, 1 on failure
+ */
+static int driver_async(pwm_t *pwm, const char *script, int cancel_ms)
+{
+	pwm_execute_config_t config = {
+		.script               = script,
+		.default_frequency_hz = 1000,
+		.default_duration_ms  = 100,
+	};
+
+	unsigned long long start_ms;
+	unsigned int dispatches = 0;
+	pwm_status_t status;
+	pwm_status_t ret;
+	pwm_execute_t ex;
+	struct pollfd pfd;
+	int timeout;
+	int fd = -1;
+
+	start_ms = driver_now_ms();
+
+	ret = pwm_execute_start(&ex, pwm, &config, &fd);
+	printf("start=%d", ret);
+
+	if (ret != PWM_E_OK) {
+		printf("\n");
+		return 1;
+	}
+
+	do {
+		timeout = -1;
+
+		if (cancel_ms >= 0) {
+			timeout = (int)(start_ms + cancel_ms - driver_now_ms());
+			if (timeout < 0)
+				timeout = 0;
+		}
+
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+
+		if (!poll(&pfd, 1, timeout)) {
+			/* Cancelled in the middle of the script */
+			pwm_execute_cancel(&ex);
+			break;
+		}
+
+		dispatches++;
+		ret = pwm_execute_dispatch(&ex);
+	} while (ret == PWM_E_AGAIN);
+
+	status = pwm_execute_status(&ex);
+
+	/* Cancel of the finished execution must not change anything */
+	ret = pwm_execute_cancel(&ex);
+
+	printf(" status=%d dispatches=%u cancel=%d fd_closed=%d\n",
+		status, dispatches, ret, fcntl(fd, F_GETFD) < 0);
+
+	return 0;
+}
+
+static void *driver_producer(void *arg)
+{
+	driver_producer_t *p = (driver_producer_t *)arg;
+	unsigned int i;
+
+	for (i = p->first; i < p->first + p->count; i++) {
+		pwm_request_t req = {
+			.channel = 0,
+			.script  = driver_scripts[i],
+		};
+
+		if (pwm_worker_submit(p->w, &req) == PWM_E_QUEUE_FULL)
+			__atomic_add_fetch(&driver_full, 1, __ATOMIC_RELAXED);
+	}
+
+	return NULL;
+}
+
+/**
+ * Background worker requests delivery
+ *
+ * @return 0 on success, 1 on failure
+ */
+static int driver_worker(
+	pwm_t *pwm,
+	pwm_worker_overflow_t overflow,
+	unsigned int capacity,
+	unsigned int producers,
+	unsigned int requests,
+	unsigned int delay_ms
+)
+{
+	static pwm_worker_slot_t slots[DRIVER_CAPACITY_MAX];
+	driver_producer_t p[DRIVER_PRODUCERS_MAX];
+	pthread_t threads[DRIVER_PRODUCERS_MAX];
+	pwm_worker_config_t config = {
+		.pwms     = pwm,
+		.count    = 1,
+		.slots    = slots,
+		.capacity = capacity,
+		.overflow = overflow,
+	};
+
+	unsigned long long start_ms;
+	pwm_worker_stats_t stats;
+	uint64_t delivered;
+	pwm_worker_t w;
+	unsigned int i;
+	int stdin_open;
+
+	/* Stopping the worker after a failed init keeps stdin open */
+	stdin_open = (fcntl(STDIN_FILENO, F_GETFD) >= 0);
+	config.count = 0;
+
+	if (pwm_worker_init(&w, &config) == PWM_E_OK) {
+		fprintf(stderr, "ERROR: Invalid worker config is accepted\n");
+		return 1;
+	}
+
+	pwm_worker_stop(&w);
+
+	if (stdin_open && (fcntl(STDIN_FILENO, F_GETFD) < 0)) {
+		fprintf(stderr, "ERROR: Stopping failed worker closes stdin\n");
+		return 1;
+	}
+
+	config.count = 1;
+
+	if (pwm_worker_init(&w, &config) != PWM_E_OK) {
+		fprintf(stderr, "ERROR: Can't initialize worker\n");
+		return 1;
+	}
+
+	for (i = 0; i < producers * requests; i++) {
+		snprintf(driver_scripts[i], sizeof(driver_scripts[i]),
+			"F%ud10", 1000 + i);
+	}
+
+	for (i = 0; i < producers; i++) {
+		p[i].w     = &w;
+		p[i].first = i * requests;
+		p[i].count = requests;
+
+		pthread_create(&threads[i], NULL, driver_producer, &p[i]);
+	}
+
+	/* Producers fill up the queue before the worker is started */
+	if (delay_ms)
+		usleep(delay_ms * 1000);
+
+	if (pwm_worker_start(&w) != PWM_E_OK) {
+		fprintf(stderr, "ERROR: Can't start worker\n");
+		return 1;
+	}
+
+	for (i = 0; i < producers; i++)
+		pthread_join(threads[i], NULL);
+
+	/*
+	 * Each delivered request is executed or replaced by the next
+	 * one. Requests dropped with the replace policy are counted
+	 * as enqueued, but are never delivered.
+	 */
+	start_ms = driver_now_ms();
+
+	do {
+		usleep(1000);
+		pwm_worker_stats(&w, &stats);
+
+		delivered = stats.enqueued;
+		if (overflow == PWM_WORKER_OVERFLOW_REPLACE)
+			delivered -= stats.dropped;
+	} while ((stats.executed + stats.discarded + stats.failed < delivered) &&
+		(driver_now_ms() - start_ms < DRIVER_WORKER_TIMEOUT_MS));
+
+	if (stats.executed + stats.discarded + stats.failed < delivered) {
+		fprintf(stderr, "ERROR: Requests are not finished in time\n");
+		pwm_worker_stop(&w);
+		return 1;
+	}
+
+	pwm_worker_stop(&w);
+	pwm_worker_stats(&w, &stats);
+
+	printf("enqueued=%llu full=%u dropped=%llu executed=%llu "
+		"discarded=%llu failed=%llu depth_max=%llu enqueue_ms_max=%llu\n",
+		(unsigned long long)stats.enqueued, driver_full,
+		(unsigned long long)stats.dropped,
+		(unsigned long long)stats.executed,
+		(unsigned long long)stats.discarded,
+		(unsigned long long)stats.failed,
+		(unsigned long long)stats.depth_max,
+		(unsigned long long)stats.enqueue_ns_max / 1000000);
+
+	return 0;
+}
+
+/**
+ * Wait until all enqueued requests are finished
+ *
+ * @return 0 on success, -1 on timeout
+ */
+static int driver_worker_wait(pwm_worker_t *w, pwm_worker_stats_t *stats)
+{
+	unsigned long long start_ms = driver_now_ms();
+
+	do {
+		usleep(1000);
+		pwm_worker_stats(w, stats);
+
+		if (stats->executed + stats->discarded + stats->failed >=
+				stats->enqueued)
+			return 0;
+	} while (driver_now_ms() - start_ms < DRIVER_WORKER_TIMEOUT_MS);
+
+	return -1;
+}
+
+/**
+ * Background worker priority preemption
+ *
+ * @return 0 on success, 1 on failure
+ */
+static int driver_preempt(pwm_t *pwm, int argc, char *argv[])
+{
+	static pwm_worker_slot_t slots[DRIVER_PREEMPT_MAX];
+	pwm_request_t reqs[DRIVER_PREEMPT_MAX];
+	unsigned int at_ms[DRIVER_PREEMPT_MAX];
+	pwm_worker_config_t config = {
+		.pwms     = pwm,
+		.count    = 1,
+		.slots    = slots,
+		.capacity = DRIVER_PREEMPT_MAX,
+		.overflow = PWM_WORKER_OVERFLOW_BLOCK,
+	};
+
+	unsigned long long start_ms;
+	unsigned long long now_ms;
+	pwm_worker_stats_t stats;
+	pwm_worker_t w;
+	char flags[8];
+	int pos;
+	int i;
+
+	if (argc > DRIVER_PREEMPT_MAX)
+		return 1;
+
+	for (i = 0; i < argc; i++) {
+		memset(&reqs[i], 0, sizeof(pwm_request_t));
+
+		if (sscanf(argv[i], "%u:%u:%7[^:]:%n", &at_ms[i],
+				&reqs[i].priority, flags, &pos) != 3) {
+			fprintf(stderr, "ERROR: Invalid request '%s'\n", argv[i]);
+			return 1;
+		}
+
+		reqs[i].script = argv[i] + pos;
+
+		if (strchr(flags, 'n'))
+			reqs[i].flags |= PWM_REQUEST_FLAG_PREEMPT_NOW;
+
+		if (strchr(flags, 'r'))
+			reqs[i].flags |= PWM_REQUEST_FLAG_RESUME;
+	}
+
+	if ((pwm_worker_init(&w, &config) != PWM_E_OK) ||
+	    (pwm_worker_start(&w) != PWM_E_OK)) {
+		fprintf(stderr, "ERROR: Can't start worker\n");
+		return 1;
+	}
+
+	start_ms = driver_now_ms();
+
+	for (i = 0; i < argc; i++) {
+		now_ms = driver_now_ms();
+
+		if (start_ms + at_ms[i] > now_ms)
+			usleep((start_ms + at_ms[i] - now_ms) * 1000);
+
+		pwm_worker_submit(&w, &reqs[i]);
+	}
+
+	if (driver_worker_wait(&w, &stats)) {
+		fprintf(stderr, "ERROR: Requests are not finished in time\n");
+		pwm_worker_stop(&w);
+		return 1;
+	}
+
+	pwm_worker_stop(&w);
+
+	printf("executed=%llu discarded=%llu failed=%llu "
+		"preempted=%llu resumed=%llu\n",
+		(unsigned long long)stats.executed,
+		(unsigned long long)stats.discarded,
+		(unsigned long long)stats.failed,
+		(unsigned long long)stats.preempted,
+		(unsigned long long)stats.resumed);
+
+	return 0;
+}
+
+/**
+ * Background worker scripts finishing in any order on two channels
+ *
+ * @return 0 on success, 1 on failure
+ */
+static int driver_channels(unsigned int requests, size_t arena_size)
+{
+	static unsigned char storage[DRIVER_ARENA_MAX];
+	static unsigned char arena_storage[DRIVER_ARENA_DEFAULT];
+	static pwm_worker_slot_t slots[DRIVER_CAPACITY_MAX];
+	pwm_worker_config_t config = {
+		.count         = 2,
+		.slots         = slots,
+		.capacity      = DRIVER_CAPACITY_MAX,
+		.overflow      = PWM_WORKER_OVERFLOW_BLOCK,
+		.arena_storage = storage,
+		.arena_size    = arena_size,
+	};
+
+	pwm_worker_stats_t stats;
+	pwm_arena_t arena;
+	pwm_worker_t w;
+	pwm_t pwms[2];
+	pwm_status_t ret;
+	unsigned int i;
+
+	for (i = 0; i < 2; i++) {
+		ret = pwm_open(&pwms[i], 0, i, 0);
+		if (ret != PWM_E_OK) {
+			fprintf(stderr, "ERROR: Can't open PWM channel: %s\n",
+				pwm_strstatus(ret));
+			return 1;
+		}
+	}
+
+	/* Scripts compiled into the default arena would fail */
+	pwm_arena_init(&arena, arena_storage, sizeof(arena_storage));
+	pwm_arena_set_default(&arena);
+
+	config.pwms = pwms;
+
+	if ((pwm_worker_init(&w, &config) != PWM_E_OK) ||
+	    (pwm_worker_start(&w) != PWM_E_OK)) {
+		fprintf(stderr, "ERROR: Can't start worker\n");
+		return 1;
+	}
+
+	for (i = 0; i < requests; i++) {
+		pwm_request_t req = {
+			.channel  = i % 2,
+			.script   = driver_scripts[i],
+			.priority = (i / 2) % 3,
+			.flags    = PWM_REQUEST_FLAG_RESUME,
+		};
+
+		snprintf(driver_scripts[i], sizeof(driver_scripts[i]),
+			"F%ud%u", 1000 + i, 10 + 5 * (i % 2));
+
+		pwm_worker_submit(&w, &req);
+	}
+
+	if (driver_worker_wait(&w, &stats)) {
+		fprintf(stderr, "ERROR: Requests are not finished in time\n");
+		pwm_worker_stop(&w);
+		return 1;
+	}
+
+	pwm_worker_stop(&w);
+	pwm_arena_set_default(NULL);
+
+	for (i = 0; i < 2; i++)
+		pwm_close(&pwms[i]);
+
+	printf("executed=%llu discarded=%llu failed=%llu\n",
+		(unsigned long long)stats.executed,
+		(unsigned long long)stats.discarded,
+		(unsigned long long)stats.failed);
+
+	return 0;
+}
+
+/**
+ * Script execution call time with the reused PWM handle
+ *
+ * @return 0 on success, 1 on failure
+ */
+static int driver_bench(pwm_t *pwm, const char *script, unsigned int calls)
+{
+	static unsigned long long times[DRIVER_CALLS_MAX];
+	pwm_execute_config_t config = {
+		.script               = script,
+		.default_frequency_hz = 1000,
+		.default_duration_ms  = 0,
+	};
+
+	unsigned long long start_ns;
+	unsigned int i;
+
+	for (i = 0; i < calls; i++) {
+		start_ns = driver_now_ns();
+
+		if (pwm_execute(pwm, &config) != PWM_E_OK) {
+			fprintf(stderr, "ERROR: Script execution failed\n");
+			return 1;
+		}
+
+		times[i] = driver_now_ns() - start_ns;
+	}
+
+	qsort(times, calls, sizeof(times[0]), driver_cmp);
+
+	printf("calls=%u execute_ns=%llu/%llu/%llu\n", calls,
+		times[0], times[calls / 2], times[calls - 1]);
+
+	return 0;
+}
+
+static void driver_usage(void)
+{
+	fprintf(stderr,
+		"Usage: pwm-driver async [-c <cancel_ms>] <script>\n"
+		"       pwm-driver worker [-o drop|replace|block] [-q <capacity>]\n"
+		"           [-p <producers>] [-n <requests>] [-d <start_delay_ms>]\n"
+		"       pwm-driver preempt <at_ms>:<priority>:<flags>:<script>...\n"
+		"       pwm-driver channels [-n <requests>] [-a <arena_size>]\n"
+		"       pwm-driver bench [-n <calls>] <script>\n");
+}
+
+int main(int argc, char *argv[])
+{
+	pwm_worker_overflow_t overflow = PWM_WORKER_OVERFLOW_DROP;
+	unsigned int capacity = 4;
+	unsigned int producers = 1;
+	unsigned int requests = 0;
+	unsigned int delay_ms = 0;
+	size_t arena_size = 4096;
+	int cancel_ms = -1;
+	pwm_status_t ret;
+	pwm_t pwm;
+	int opt;
+
+	if (argc < 2) {
+		driver_usage();
+		return 1;
+	}
+
+	/* Options of the mode follow the mode name */
+	optind = 2;
+
+	while ((opt = getopt(argc, argv, "+c:o:q:p:n:d:a:")) != -1) {
+		switch (opt) {
+			case 'c':
+				cancel_ms = atoi(optarg);
+				break;
+
+			case 'o':
+				if (!strcmp(optarg, "drop"))
+					overflow = PWM_WORKER_OVERFLOW_DROP;
+				else if (!strcmp(optarg, "replace"))
+					overflow = PWM_WORKER_OVERFLOW_REPLACE;
+				else if (!strcmp(optarg, "block"))
+					overflow = PWM_WORKER_OVERFLOW_BLOCK;
+				else {
+					driver_usage();
+					return 1;
+				}
+				break;
+
+			case 'q':
+				capacity = (unsigned int)strtoul(optarg, NULL, 0);
+				break;
+
+			case 'p':
+				producers = (unsigned int)strtoul(optarg, NULL, 0);
+				break;
+
+			case 'n':
+				requests = (unsigned int)strtoul(optarg, NULL, 0);
+				break;
+
+			case 'd':
+				delay_ms = (unsigned int)strtoul(optarg, NULL, 0);
+				break;
+
+			case 'a':
+				arena_size = strtoul(optarg, NULL, 0);
+				break;
+
+			default:
+				driver_usage();
+				return 1;
+		}
+	}
+
+	if (!strcmp(argv[1], "async")) {
+		if (optind != argc - 1) {
+			driver_usage();
+			return 1;
+		}
+	}
+	else if (!strcmp(argv[1], "worker")) {
+		if (!requests)
+			requests = 1;
+
+		if ((optind != argc) || (capacity > DRIVER_CAPACITY_MAX) ||
+		    !producers || (producers > DRIVER_PRODUCERS_MAX) ||
+		    (producers * requests > DRIVER_REQUESTS_MAX)) {
+			driver_usage();
+			return 1;
+		}
+	}
+	else if (!strcmp(argv[1], "preempt")) {
+		if (optind >= argc) {
+			driver_usage();
+			return 1;
+		}
+	}
+	else if (!strcmp(argv[1], "channels")) {
+		if (!requests)
+			requests = 1;
+
+		if ((optind != argc) || (requests > DRIVER_REQUESTS_MAX) ||
+		    (arena_size > DRIVER_ARENA_MAX)) {
+			driver_usage();
+			return 1;
+		}
+
+		/* Both channels are opened by the mode */
+		return driver_channels(requests, arena_size);
+	}
+	else if (!strcmp(argv[1], "bench")) {
+		if (!requests)
+			requests = 1000;
+
+		if ((optind != argc - 1) || (requests > DRIVER_CALLS_MAX)) {
+			driver_usage();
+			return 1;
+		}
+	}
+	else {
+		driver_usage();
+		return 1;
+	}
+
+	ret = pwm_open(&pwm, 0, 0, 0);
+	if (ret != PWM_E_OK) {
+		fprintf(stderr, "ERROR: Can't open PWM channel: %s\n",
+			pwm_strstatus(ret));
+		return 1;
+	}
+
+	if (!strcmp(argv[1], "async")) {
+		ret = driver_async(&pwm, argv[optind], cancel_ms);
+	}
+	else if (!strcmp(argv[1], "worker")) {
+		ret = driver_worker(&pwm, overflow, capacity,
+			producers, requests, delay_ms);
+	}
+	else if (!strcmp(argv[1], "preempt")) {
+		ret = driver_preempt(&pwm, argc - optind, argv + optind);
+	}
+	else {
+		ret = driver_bench(&pwm, argv[optind], requests);
+	}
+
+	pwm_close(&pwm);
+	return ret;
+}
@@ -0,0 +1,507 @@
+/*
+ * SPDX-License-Identifier: WTFPL
+ * SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * PWM tool
+ * Copyright © 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file for more details.
+ */
+
+/**
+ * @file
+ * @brief Fake PWM device (LD_PRELOAD shim) for tests
+ *
+ * Turns the plain files of the fake sysfs tree (PWM_SYSFS_ROOT)
+ * into the PWM channel attributes with the kernel semantics:
+ *
+ * - write replaces the attribute value instead of appending;
+ * - invalid values, duty cycle greater than period and enabling
+ *   the channel with zero period are rejected with EINVAL, the
+ *   channel state is not changed in this case;
+ * - polarity ("normal" or "inversed") change of the enabled
+ *   channel is rejected with EBUSY.
+ *
+ * Each write is timestamped and logged to the PWM_FAKE_LOG file
+ * together with the resulting channel state:
+ *
+ * <code>
+ *     W <ns> pwmchip<N>/pwm<M> <attr> <value> <errno>
+ *     S <ns> pwmchip<N>/pwm<M> <enable> <period> <duty_cycle> <polarity>
+ * </code>
+ *
+ * Polarity values are logged as 0 (normal) and 1 (inversed).
+ *
+ * Timestamps are CLOCK_MONOTONIC nanoseconds, so the log of
+ * the state (S) lines describes the produced waveform.
+ *
+ * Stalled write (e.g. during heavy flash I/O) can be emulated with
+ * the PWM_FAKE_STALL="<n>:<ms>" variable: the n-th (1-based) write
+ * to the PWM attributes blocks for the specified time after the
+ * value is changed.
+ *
+ * @author Anton Kikin <a.kikin@tano-systems.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dlfcn.h>        /* dlsym() */
+#include <pthread.h>
+#include <time.h>
+#include <linux/limits.h> /* PATH_MAX */
+
+/* ----------------------------------------------------------------------- */
+
+/** Maximum tracked file descriptor number */
+#define FAKE_FD_MAX  1024
+
+typedef enum {
+	FAKE_ATTR_NONE = 0,
+	FAKE_ATTR_ENABLE,
+	FAKE_ATTR_PERIOD,
+	FAKE_ATTR_DUTY_CYCLE,
+	FAKE_ATTR_POLARITY,
+	FAKE_ATTR_COUNT,
+} fake_attr_t;
+
+static const char *fake_attr_names[FAKE_ATTR_COUNT] = {
+	[FAKE_ATTR_ENABLE]     = "enable",
+	[FAKE_ATTR_PERIOD]     = "period",
+	[FAKE_ATTR_DUTY_CYCLE] = "duty_cycle",
+	[FAKE_ATTR_POLARITY]   = "polarity",
+};
+
+static const char *fake_polarity_names[] = {
+	"normal",
+	"inversed",
+};
+
+/**
+ * Tracked attribute file descriptor
+ */
+typedef struct {
+	fake_attr_t attr;
+	unsigned int chip;
+	unsigned int channel;
+
+	/** Channel folder path */
+	char dir[PATH_MAX];
+
+} fake_fd_t;
+
+static fake_fd_t fake_fds[FAKE_FD_MAX];
+static unsigned int fake_writes;
+static pthread_mutex_t fake_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int     (*real_open)(const char *, int, ...);
+static int     (*real_openat)(int, const char *, int, ...);
+static ssize_t (*real_write)(int, const void *, size_t);
+static int     (*real_close)(int);
+static int     (*real_dup2)(int, int);
+
+/* ----------------------------------------------------------------------- */
+
+static void fake_init(void)
+{
+	if (real_open)
+		return;
+
+	real_openat = dlsym(RTLD_NEXT, "openat");
+	real_write  = dlsym(RTLD_NEXT, "write");
+	real_close  = dlsym(RTLD_NEXT, "close");
+	real_dup2   = dlsym(RTLD_NEXT, "dup2");
+	real_open   = dlsym(RTLD_NEXT, "open");
+}
+
+static unsigned long long fake_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void fake_log(const char *fmt, ...)
+{
+	const char *file = getenv("PWM_FAKE_LOG");
+	char line[PATH_MAX];
+	va_list ap;
+	int len;
+	int fd;
+
+	if (!file)
+		return;
+
+	va_start(ap, fmt);
+	len = vsnprintf(line, sizeof(line), fmt, ap);
+	va_end(ap);
+
+	fd = real_open(file, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return;
+
+	if (real_write(fd, line, len) != len) {
+		/* Nothing to do */
+	}
+
+	real_close(fd);
+}
+
+/**
+ * Start tracking of the opened file if it is a PWM channel attribute
+ * in the fake sysfs tree
+ */
+static void fake_track(int fd)
+{
+	char link[32];
+	char path[PATH_MAX];
+	char root[PATH_MAX];
+	char name[32];
+	const char *env;
+	unsigned int chip;
+	unsigned int channel;
+	ssize_t len;
+	size_t rlen;
+	int n = 0;
+	int i;
+
+	if ((fd < 0) || (fd >= FAKE_FD_MAX))
+		return;
+
+	fake_fds[fd].attr = FAKE_ATTR_NONE;
+
+	env = getenv("PWM_SYSFS_ROOT");
+	if (!env || !realpath(env, root))
+		return;
+
+	snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+	len = readlink(link, path, sizeof(path) - 1);
+	if (len < 0)
+		return;
+
+	path[len] = '\0';
+	rlen = strlen(root);
+
+	if (strncmp(path, root, rlen) || (path[rlen] != '/'))
+		return;
+
+	if (sscanf(path + rlen, "/pwmchip%u/pwm%u/%31[a-z_]%n",
+			&chip, &channel, name, &n) != 3 || path[rlen + n])
+		return;
+
+	for (i = FAKE_ATTR_ENABLE; i < FAKE_ATTR_COUNT; i++) {
+		if (!strcmp(name, fake_attr_names[i]))
+			break;
+	}
+
+	if (i == FAKE_ATTR_COUNT)
+		return;
+
+	fake_fds[fd].chip    = chip;
+	fake_fds[fd].channel = channel;
+	snprintf(fake_fds[fd].dir, sizeof(fake_fds[fd].dir), "%.*s",
+		(int)(strrchr(path, '/') - path), path);
+
+	fake_fds[fd].attr = (fake_attr_t)i;
+}
+
+/**
+ * Parse attribute value the same way as kstrtouint()
+ */
+static int fake_parse(const void *buf, size_t count, unsigned int *value)
+{
+	char str[32];
+	char *end;
+	unsigned long v;
+
+	if (!count || (count >= sizeof(str)))
+		return -1;
+
+	memcpy(str, buf, count);
+	str[count] = '\0';
+
+	/* Single trailing newline is allowed */
+	if (str[count - 1] == '\n')
+		str[--count] = '\0';
+
+	if (!count || (str[0] < '0') || (str[0] > '9'))
+		return -1;
+
+	errno = 0;
+	v = strtoul(str, &end, 0);
+	if (errno || *end || (v > 0xffffffffUL))
+		return -1;
+
+	*value = (unsigned int)v;
+	return 0;
+}
+
+/**
+ * Parse polarity value ("normal" or "inversed")
+ */
+static int fake_parse_polarity(const void *buf, size_t count,
+	unsigned int *value)
+{
+	unsigned int i;
+
+	/* Single trailing newline is allowed */
+	if (count && (((const char *)buf)[count - 1] == '\n'))
+		count--;
+
+	for (i = 0; i < 2; i++) {
+		if ((count == strlen(fake_polarity_names[i])) &&
+		    !memcmp(buf, fake_polarity_names[i], count)) {
+			*value = i;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+static unsigned int fake_attr_get(const fake_fd_t *f, fake_attr_t attr)
+{
+	char path[PATH_MAX + 32];
+	char buf[32];
+	ssize_t len;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/%s", f->dir, fake_attr_names[attr]);
+
+	fd = real_open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return 0;
+
+	len = pread(fd, buf, sizeof(buf) - 1, 0);
+	real_close(fd);
+
+	if (len <= 0)
+		return 0;
+
+	buf[len] = '\0';
+
+	if (attr == FAKE_ATTR_POLARITY)
+		return !strncmp(buf, "inversed", 8);
+
+	return (unsigned int)strtoul(buf, NULL, 0);
+}
+
+/**
+ * Emulate write to the PWM channel attribute
+ */
+static ssize_t fake_write(int fd, const void *buf, size_t count)
+{
+	const fake_fd_t *f = &fake_fds[fd];
+	unsigned int state[FAKE_ATTR_COUNT];
+	unsigned int value;
+	unsigned long long ts;
+	char str[32];
+	int err = 0;
+	int len;
+	int i;
+
+	ts = fake_now_ns();
+
+	for (i = FAKE_ATTR_ENABLE; i < FAKE_ATTR_COUNT; i++)
+		state[i] = fake_attr_get(f, (fake_attr_t)i);
+
+	if ((f->attr == FAKE_ATTR_POLARITY)
+			? fake_parse_polarity(buf, count, &value)
+			: fake_parse(buf, count, &value)) {
+		err = EINVAL;
+		value = 0;
+	}
+	else if ((f->attr == FAKE_ATTR_POLARITY) && state[FAKE_ATTR_ENABLE]) {
+		err = EBUSY;
+	}
+	else {
+		state[f->attr] = value;
+
+		if (state[FAKE_ATTR_ENABLE] > 1)
+			err = EINVAL;
+		else if (state[FAKE_ATTR_DUTY_CYCLE] > state[FAKE_ATTR_PERIOD])
+			err = EINVAL;
+		else if (state[FAKE_ATTR_ENABLE] && !state[FAKE_ATTR_PERIOD])
+			err = EINVAL;
+	}
+
+	fake_log("W %llu pwmchip%u/pwm%u %s %u %d\n",
+		ts, f->chip, f->channel, fake_attr_names[f->attr], value, err);
+
+	if (err) {
+		errno = err;
+		return -1;
+	}
+
+	if (f->attr == FAKE_ATTR_POLARITY)
+		len = snprintf(str, sizeof(str), "%s\n", fake_polarity_names[value]);
+	else
+		len = snprintf(str, sizeof(str), "%u\n", value);
+
+	if (ftruncate(fd, 0) || (pwrite(fd, str, len, 0) != len)) {
+		errno = EIO;
+		return -1;
+	}
+
+	fake_log("S %llu pwmchip%u/pwm%u %u %u %u %u\n",
+		ts, f->chip, f->channel,
+		state[FAKE_ATTR_ENABLE],
+		state[FAKE_ATTR_PERIOD],
+		state[FAKE_ATTR_DUTY_CYCLE],
+		state[FAKE_ATTR_POLARITY]);
+
+	return count;
+}
+
+/**
+ * Emulate stalled write if requested by PWM_FAKE_STALL
+ */
+static void fake_stall(void)
+{
+	const char *env = getenv("PWM_FAKE_STALL");
+	unsigned int n;
+	unsigned int ms;
+	struct timespec ts;
+
+	if (!env || (sscanf(env, "%u:%u", &n, &ms) != 2) || (n != fake_writes))
+		return;
+
+	ts.tv_sec  = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000L;
+
+	while (nanosleep(&ts, &ts) && (errno == EINTR));
+}
+
+/* ----------------------------------------------------------------------- */
+
+static int fake_open_mode(int flags, va_list ap)
+{
+	if ((flags & O_CREAT) || ((flags & O_TMPFILE) == O_TMPFILE))
+		return va_arg(ap, int);
+
+	return 0;
+}
+
+/**
+ * Complete open of the file. Sysfs attributes ignore O_TRUNC,
+ * so files are opened without it and truncated here if they
+ * are not PWM channel attributes.
+ */
+static int fake_opened(int fd, int flags)
+{
+	pthread_mutex_lock(&fake_lock);
+	fake_track(fd);
+
+	if ((fd >= 0) && (flags & O_TRUNC) &&
+	    ((fd >= FAKE_FD_MAX) || !fake_fds[fd].attr)) {
+		if (ftruncate(fd, 0)) {
+			/* Nothing to do */
+		}
+	}
+
+	pthread_mutex_unlock(&fake_lock);
+	return fd;
+}
+
+int open(const char *path, int flags, ...)
+{
+	va_list ap;
+	int mode;
+	int fd;
+
+	fake_init();
+
+	va_start(ap, flags);
+	mode = fake_open_mode(flags, ap);
+	va_end(ap);
+
+	fd = real_open(path, flags & ~O_TRUNC, mode);
+	return fake_opened(fd, flags);
+}
+
+int openat(int dirfd, const char *path, int flags, ...)
+{
+	va_list ap;
+	int mode;
+	int fd;
+
+	fake_init();
+
+	va_start(ap, flags);
+	mode = fake_open_mode(flags, ap);
+	va_end(ap);
+
+	fd = real_openat(dirfd, path, flags & ~O_TRUNC, mode);
+	return fake_opened(fd, flags);
+}
+
+int open64(const char *path, int flags, ...)
+	__attribute__((alias("open")));
+
+int openat64(int dirfd, const char *path, int flags, ...)
+	__attribute__((alias("openat")));
+
+int __open_2(const char *path, int flags)
+{
+	return open(path, flags);
+}
+
+int __openat_2(int dirfd, const char *path, int flags)
+{
+	return openat(dirfd, path, flags);
+}
+
+ssize_t write(int fd, const void *buf, size_t count)
+{
+	ssize_t ret;
+
+	fake_init();
+
+	if ((fd < 0) || (fd >= FAKE_FD_MAX) || !fake_fds[fd].attr)
+		return real_write(fd, buf, count);
+
+	pthread_mutex_lock(&fake_lock);
+	ret = fake_write(fd, buf, count);
+	fake_writes++;
+	fake_stall();
+	pthread_mutex_unlock(&fake_lock);
+
+	return ret;
+}
+
+int close(int fd)
+{
+	fake_init();
+
+	if ((fd >= 0) && (fd < FAKE_FD_MAX)) {
+		pthread_mutex_lock(&fake_lock);
+		fake_fds[fd].attr = FAKE_ATTR_NONE;
+		pthread_mutex_unlock(&fake_lock);
+	}
+
+	return real_close(fd);
+}
+
+int dup2(int oldfd, int newfd)
+{
+	int fd;
+
+	fake_init();
+
+	fd = real_dup2(oldfd, newfd);
+
+	if ((fd >= 0) && (fd < FAKE_FD_MAX) && (oldfd != newfd)) {
+		pthread_mutex_lock(&fake_lock);
+		fake_fds[fd] = ((oldfd >= 0) && (oldfd < FAKE_FD_MAX))
+			? fake_fds[oldfd] : (fake_fd_t){ 0 };
+		pthread_mutex_unlock(&fake_lock);
+	}
+
+	return fd;
+}
@@ -0,0 +1,146 @@
+/*
+ * SPDX-License-Identifier: WTFPL
+ * SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * PWM tool
+ * Copyright © 2021 Anton Kikin <a.kikin@tano-systems.com>
+ *
+ * This work is free. You can redistribute it and/or modify it under the
+ * terms of the Do What The Fuck You Want To Public License, Version 2,
+ * as published by Sam Hocevar. See the COPYING file for more details.
+ */
+
+/**
+ * @file
+ * @brief Heap usage counter (LD_PRELOAD shim) for tests
+ *
+ * Counts the calls of the heap allocation functions made by
+ * the process (including the calls made inside the C library)
+ * and the blocks which are not freed. Counters are written to
+ * the PWM_HEAP_LOG file on exit:
+ *
+ * <code>
+ *     allocs=<n> leaked=<n>
+ * </code>
+ *
+ * Calls are passed to the glibc allocator.
+ *
+ * @author Anton Kikin <a.kikin@tano-systems.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+
+/* ----------------------------------------------------------------------- */
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *ptr);
+
+/** Number of the allocations */
+static unsigned long heap_allocs;
+
+/** Number of the allocated and not freed blocks */
+static long heap_blocks;
+
+static void *heap_count(void *ptr)
+{
+	__atomic_add_fetch(&heap_allocs, 1, __ATOMIC_RELAXED);
+
+	if (ptr)
+		__atomic_add_fetch(&heap_blocks, 1, __ATOMIC_RELAXED);
+
+	return ptr;
+}
+
+/* ----------------------------------------------------------------------- */
+
+void *malloc(size_t size)
+{
+	return heap_count(__libc_malloc(size));
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	return heap_count(__libc_calloc(nmemb, size));
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	void *block;
+
+	if (!ptr)
+		return malloc(size);
+
+	__atomic_add_fetch(&heap_allocs, 1, __ATOMIC_RELAXED);
+
+	block = __libc_realloc(ptr, size);
+
+	/* Block is freed by zero size */
+	if (!block && !size)
+		__atomic_sub_fetch(&heap_blocks, 1, __ATOMIC_RELAXED);
+
+	return block;
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+	return heap_count(__libc_memalign(alignment, size));
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+	return memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+	void *block = memalign(alignment, size);
+
+	if (!block)
+		return ENOMEM;
+
+	*ptr = block;
+	return 0;
+}
+
+void free(void *ptr)
+{
+	if (ptr)
+		__atomic_sub_fetch(&heap_blocks, 1, __ATOMIC_RELAXED);
+
+	__libc_free(ptr);
+}
+
+/* ----------------------------------------------------------------------- */
+
+__attribute__((destructor))
+static void heap_report(void)
+{
+	const char *file = getenv("PWM_HEAP_LOG");
+	char line[64];
+	int len;
+	int fd;
+
+	if (!file)
+		return;
+
+	len = snprintf(line, sizeof(line), "allocs=%lu leaked=%ld\n",
+		__atomic_load_n(&heap_allocs, __ATOMIC_RELAXED),
+		__atomic_load_n(&heap_blocks, __ATOMIC_RELAXED));
+
+	fd = open(file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return;
+
+	if (write(fd, line, len) != len) {
+		/* Nothing to do */
+	}
+
+	close(fd);
+}
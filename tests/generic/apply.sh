@@ -0,0 +1,120 @@
+#!/bin/sh
+#
+# SPDX-License-Identifier: WTFPL
+# SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+#
+# Test bulk configuration of the PWM channels
+#
+# Timing test (run serially)
+#
+
+#
+# Print writes to the channel
+#
+# $1 - channel ("<chip>/<channel>")
+#
+function channel_writes {
+	local CH=(${1/\// })
+
+	awk -v ch="pwmchip${CH[0]}/pwm${CH[1]}" '$1 == "W" && $3 == ch {
+		printf("%s=%s ", $4, $5)
+	}' "${PWM_FAKE_LOG}"
+}
+
+#
+# Print reported value of the channel
+#
+# $1 - channel ("<chip>/<channel>")
+# $2 - field name
+#
+function channel_report {
+	local CH=(${1/\// })
+
+	grep "^pwmchip${CH[0]}/pwm${CH[1]} " "${PWM_TEST_DIR}/report" | \
+		tr ' ' '\n' | sed -n "s/^$2=//p"
+}
+
+function do_test {
+	local CONFIG="${PWM_TEST_DIR}/channels.conf"
+	local SYSFS
+	local LATE
+	local RET
+
+	test_sysfs_create 0 0 SYSFS
+	echo -n "1" > ${SYSFS}/${SYSFS_PWM_FILE_ENABLE}
+	echo -n "1000000" > ${SYSFS}/${SYSFS_PWM_FILE_PERIOD}
+	echo -n "500000" > ${SYSFS}/${SYSFS_PWM_FILE_DUTY_CYCLE}
+	touch ${SYSFS}/../export
+
+	test_sysfs_create 1 0 SYSFS
+	test_sysfs_create 1 2 SYSFS
+	echo -n "1" > ${SYSFS}/${SYSFS_PWM_FILE_ENABLE}
+	echo -n "1000000" > ${SYSFS}/${SYSFS_PWM_FILE_PERIOD}
+
+	cat > ${CONFIG} <<-EOT
+		# Fan, backlight and buzzers
+		0:0 period=1000000 duty=25
+		0:1 frequency=25000 duty=40 polarity=inversed  # exported
+
+		1:0 frequency=1000
+		1:2 enable=0
+	EOT
+
+	# Channel 1 of chip 0 appears with a delay after exporting.
+	# Channel folder is created aside and moved, so it appears
+	# with all the attribute files at once.
+	(
+		sleep 0.3
+		SYSFS_PWM_ROOT="${PWM_TEST_DIR}/late" test_sysfs_create 0 1 LATE
+		mv "${LATE}" "${SYSFS_PWM_ROOT}/pwmchip0/"
+	) &
+
+	test_fake_run --apply ${CONFIG} > ${PWM_TEST_DIR}/report
+	RET=$?
+	wait
+
+	test_assert_eq "${RET}" "${PWM_E_OK}" "return code"
+	test_assert_eq "$(test_fake_errors)" "0" "rejected writes"
+	test_assert_eq "$(cat ${SYSFS_PWM_ROOT}/pwmchip0/export)" "1" "exported channel"
+
+	# Only the differing attributes are written
+	test_assert_eq "$(channel_writes 0/0)" "duty_cycle=250000 " "writes 0/0"
+	test_assert_eq "$(channel_writes 0/1)" \
+		"polarity=1 period=40000 duty_cycle=16000 enable=1 " "writes 0/1"
+	test_assert_eq "$(channel_writes 1/0)" \
+		"period=1000000 duty_cycle=500000 enable=1 " "writes 1/0"
+	test_assert_eq "$(channel_writes 1/2)" "enable=0 " "writes 1/2"
+
+	# Chip 1 is not blocked by waiting for the chip 0 channel
+	test_assert_range $(channel_report 0/1 elapsed_us) 300000 600000 "0/1 elapsed"
+	test_assert_range $(channel_report 1/2 elapsed_us) 0 150000 "1/2 elapsed"
+	test_assert_eq "$(tail -n 1 ${PWM_TEST_DIR}/report | cut -d ' ' -f 1-2)" \
+		"channels=4 failed=0" "summary"
+
+	# Failed channel does not prevent configuration of others
+	rm -rf ${SYSFS_PWM_ROOT}/pwmchip0/pwm1 "${PWM_FAKE_LOG}"
+
+	test_fake_run --apply ${CONFIG} --export-timeout 100 > ${PWM_TEST_DIR}/report
+	RET=$?
+
+	test_assert_eq "${RET}" "${PWM_E_NO_CHANNEL}" "return code (no channel)"
+	test_assert_eq "$(channel_report 0/1 status)" "${PWM_E_NO_CHANNEL}" "0/1 status"
+	test_assert_eq "$(channel_report 1/0 status)" "${PWM_E_OK}" "1/0 status"
+	test_assert_eq "$(tail -n 1 ${PWM_TEST_DIR}/report | cut -d ' ' -f 1-2)" \
+		"channels=4 failed=1" "summary (no channel)"
+
+	# Nothing is configured if the file is invalid
+	echo "1:0 duty=20" > ${CONFIG}
+
+	${PWM_TEST_BIN} --apply ${CONFIG}
+	test_assert_eq "$?" "${PWM_E_FAILED}" "return code (duty without period)"
+
+	echo "1:0 frequency=1000 speed=2" > ${CONFIG}
+
+	${PWM_TEST_BIN} --apply ${CONFIG}
+	test_assert_eq "$?" "${PWM_E_FAILED}" "return code (unknown attribute)"
+
+	test_passed
+}
+
+. ${PWM_TEST_ROOT}/pwm-test-common.sh.inc
@@ -0,0 +1,78 @@
+#!/bin/sh
+#
+# SPDX-License-Identifier: WTFPL
+# SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+#
+# Test asynchronous script execution API (start, dispatch on the
+# timer file descriptor, cancel) with the fake PWM device
+#
+# Timing test (run serially)
+#
+
+SCRIPT="F1000D100k F2000k d100 F1000"
+
+function driver_run {
+	local SYSFS
+
+	test_sysfs_create ${DEFAULT_PWM_CHIP} ${DEFAULT_PWM_CHANNEL} SYSFS
+	rm -f "${PWM_FAKE_LOG}"
+
+	LD_PRELOAD="${PWM_FAKE_LIB}" PWM_FAKE_LOG="${PWM_FAKE_LOG}" \
+		${PWM_DRIVER_BIN} async "$@"
+}
+
+function do_test {
+	local REPORT
+	local WAVE
+
+	[ -f "${PWM_DRIVER_BIN}" ] || test_failed "test driver is not built"
+
+	# Complete execution, cancel after completion changes nothing
+	REPORT="$(driver_run "${SCRIPT}")"
+	test_assert_eq "$?" "0" "driver return code"
+	test_assert_eq "${REPORT}" \
+		"start=0 status=0 dispatches=5 cancel=0 fd_closed=1" "report"
+
+	WAVE=($(test_fake_waveform | awk '{ print $2 }'))
+	test_assert_eq "${WAVE[*]}" "0 1000000 500000 0 1000000 0" "waveform"
+
+	WAVE=($(test_fake_waveform | awk '{ print $1 }'))
+	test_assert_range ${WAVE[2]} 95 125 "2nd command start"
+	test_assert_range ${WAVE[3]} 195 225 "3rd command start"
+	test_assert_range ${WAVE[4]} 295 325 "4th command start"
+	test_assert_range ${WAVE[5]} 395 425 "completion"
+	test_assert_eq "$(test_fake_errors)" "0" "rejected writes"
+
+	# Cancel in the middle of the 4th command disables PWM
+	REPORT="$(driver_run -c 350 "${SCRIPT}")"
+	test_assert_eq "$?" "0" "driver return code (cancel)"
+	test_assert_eq "${REPORT}" \
+		"start=0 status=${PWM_E_INTR} dispatches=4 cancel=${PWM_E_INTR} fd_closed=1" \
+		"report (cancel)"
+
+	WAVE=($(test_fake_waveform | awk '{ print $2 }'))
+	test_assert_eq "${WAVE[*]}" "0 1000000 500000 0 1000000 0" "waveform (cancel)"
+
+	WAVE=($(test_fake_waveform | tail -n 1))
+	test_assert_range ${WAVE[0]} 345 375 "cancel time"
+
+	# Command with 'k' operation keeps PWM enabled when cancelled
+	REPORT="$(driver_run -c 150 "${SCRIPT}")"
+	test_assert_eq "$?" "0" "driver return code (cancel, keep enabled)"
+	test_assert_eq "${REPORT}" \
+		"start=0 status=${PWM_E_INTR} dispatches=2 cancel=${PWM_E_INTR} fd_closed=1" \
+		"report (cancel, keep enabled)"
+
+	WAVE=($(test_fake_waveform | awk '{ print $2 }'))
+	test_assert_eq "${WAVE[*]}" "0 1000000 500000" "waveform (cancel, keep enabled)"
+
+	# Syntax error is reported at start, PWM is not changed
+	REPORT="$(driver_run "F1000 x")"
+	test_assert_eq "$?" "1" "driver return code (syntax error)"
+	test_assert_eq "${REPORT}" "start=${PWM_E_FAILED}" "report (syntax error)"
+	test_assert_eq "$(test_fake_waveform | wc -l)" "0" "waveform (syntax error)"
+
+	test_passed
+}
+
+. ${PWM_TEST_ROOT}/pwm-test-common.sh.inc
@@ -3,6 +3,8 @@
 # SPDX-License-Identifier: WTFPL
 # SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
 #
+# Timing test (run serially)
+#
 
 function duration_test() {
 	local RET
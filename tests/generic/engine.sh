@@ -0,0 +1,110 @@
+#!/bin/sh
+#
+# SPDX-License-Identifier: WTFPL
+# SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+#
+# Test pattern engine wakeups coalescing
+#
+# Timing test (run serially)
+#
+
+#
+# Run two heartbeats in the pattern engine for about one second
+#
+# $@ - additional arguments
+#
+function run_engine {
+	local PID
+
+	rm -f "${PWM_FAKE_LOG}"
+
+	LD_PRELOAD="${PWM_FAKE_LIB}" PWM_FAKE_LOG="${PWM_FAKE_LOG}" \
+		${PWM_TEST_BIN} --stats "$@" \
+			--engine "0:0:F1000d100 f0d400" \
+			--engine "0:1:F1000d120 f0d380" > "${PWM_TEST_DIR}/stats" &
+	PID=$!
+	sleep 1.05
+	kill -INT ${PID}
+	wait ${PID}
+}
+
+#
+# Print value of the statistics field
+#
+# $1 - field name
+#
+function stat_value {
+	tr ' ' '\n' < "${PWM_TEST_DIR}/stats" | sed -n "s/^$1=//p"
+}
+
+#
+# Print time of the first disable of the channel
+# relative to the first PWM change
+#
+# $1 - channel
+#
+function channel_off {
+	awk -v ch="pwmchip0/pwm$1" '$1 == "S" {
+		if (!t0)
+			t0 = $2
+		if ($3 != ch)
+			next
+		if (on && !$4) {
+			printf("%d\n", ($2 - t0) / 1000000)
+			exit
+		}
+		on = $4
+	}' "${PWM_FAKE_LOG}"
+}
+
+function do_test {
+	local SYSFS
+	local RET
+	local WAKEUPS
+
+	[ -f "${PWM_FAKE_LIB}" ] || test_failed "fake PWM device is not built"
+
+	test_sysfs_create ${DEFAULT_PWM_CHIP} 0 SYSFS
+	test_sysfs_create ${DEFAULT_PWM_CHIP} 1 SYSFS
+
+	${PWM_TEST_BIN} --engine "0:F1000d100"
+	test_assert_eq "$?" "${PWM_E_FAILED}" "return code (invalid channel)"
+
+	${PWM_TEST_BIN} --engine "0:0:F1000d0"
+	test_assert_eq "$?" "${PWM_E_INVALID_DURATION}" "return code (zero duration)"
+
+	# Each transition has its own wakeup: 100, 120, 500, 600, 620, 1000 ms
+	run_engine
+	RET=$?
+
+	test_assert_eq "${RET}" "${PWM_E_INTR}" "return code"
+	test_assert_eq "$(test_fake_errors)" "0" "rejected writes"
+	test_assert_range $(stat_value wakeups) 5 7 "wakeups"
+	test_assert_eq "$(stat_value coalesced)" "0" "coalesced"
+	test_assert_range $(( $(channel_off 1) - $(channel_off 0) )) 12 30 \
+		"channel 1 disable delay"
+
+	WAKEUPS=$(stat_value wakeups)
+
+	# Channel 1 transitions are served by the channel 0 wakeups
+	run_engine --coalesce 30 --timer-slack 2000
+	RET=$?
+
+	test_assert_eq "${RET}" "${PWM_E_INTR}" "return code (coalesced)"
+	test_assert_range $(stat_value wakeups) 3 5 "wakeups (coalesced)"
+	test_assert_range $(stat_value coalesced) 2 3 "coalesced"
+	test_assert_range $(channel_off 0) 98 125 "channel 0 disable (coalesced)"
+	test_assert_range $(( $(channel_off 1) - $(channel_off 0) )) 0 8 \
+		"channel 1 disable delay (coalesced)"
+
+	[ $(stat_value wakeups) -lt ${WAKEUPS} ] || test_failed "wakeups are not coalesced"
+
+	# Both channels are disabled on exit
+	test_assert_eq "$(awk '$1 == "S" { s[$3] = $4 } END {
+		print s["pwmchip0/pwm0"] s["pwmchip0/pwm1"] }' ${PWM_FAKE_LOG})" \
+		"00" "disabled on exit"
+
+	test_passed
+}
+
+. ${PWM_TEST_ROOT}/pwm-test-common.sh.inc
@@ -0,0 +1,72 @@
+#!/bin/sh
+#
+# SPDX-License-Identifier: WTFPL
+# SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+#
+# Timing test (run serially)
+#
+
+function do_test {
+	local CHIP_DIR
+	local SYSFS
+	local ENABLE
+	local PERIOD
+	local DUTY_CYCLE
+	local RET
+	local D1
+	local D2
+	local DMS
+
+	CHIP_DIR=${SYSFS_PWM_ROOT}/$(printf ${SYSFS_PWM_CHIP_FOLDER_FMT} ${DEFAULT_PWM_CHIP})
+	SYSFS=${CHIP_DIR}/$(printf ${SYSFS_PWM_CH_FOLDER_FMT} ${DEFAULT_PWM_CHANNEL})
+	mkdir -p ${CHIP_DIR}
+	touch ${CHIP_DIR}/export
+
+	# Channel folder and control files appear with delays. Files
+	# are written aside and moved, so they never appear empty.
+	(
+		sleep 0.2
+		mkdir -p ${SYSFS}
+		echo -n "0" > ${CHIP_DIR}/enable.tmp
+		echo -n "0" > ${CHIP_DIR}/duty_cycle.tmp
+		echo -n "0" > ${CHIP_DIR}/period.tmp
+		mv ${CHIP_DIR}/enable.tmp ${SYSFS}/${SYSFS_PWM_FILE_ENABLE}
+		mv ${CHIP_DIR}/duty_cycle.tmp ${SYSFS}/${SYSFS_PWM_FILE_DUTY_CYCLE}
+		sleep 0.1
+		mv ${CHIP_DIR}/period.tmp ${SYSFS}/${SYSFS_PWM_FILE_PERIOD}
+	) &
+
+	D1=$(date "+%s %N")
+	${PWM_TEST_BIN} -d 10 --export-timeout=2000
+	RET=$?
+	D2=$(date "+%s %N")
+	wait
+
+	DMS=$(date_diff_ms ${D2} ${D1})
+
+	test_assert_eq "${RET}" "${PWM_E_OK}" "return code"
+	test_assert_range ${DMS} 310 500 "execution duration"
+	test_assert_eq "$(cat ${CHIP_DIR}/export)" "${DEFAULT_PWM_CHANNEL}" "export data check"
+
+	test_sysfs_read ${SYSFS} ENABLE PERIOD DUTY_CYCLE
+
+	test_assert_eq "${ENABLE}" "10" "enable data check"
+	test_assert_eq "${PERIOD}" "1000000" "period data check"
+
+	# Channel never appears
+	rm -rf ${SYSFS}
+
+	D1=$(date "+%s %N")
+	${PWM_TEST_BIN} -d 10 --export-timeout=200
+	RET=$?
+	D2=$(date "+%s %N")
+
+	DMS=$(date_diff_ms ${D2} ${D1})
+
+	test_assert_eq "${RET}" "${PWM_E_NO_CHANNEL}" "return code"
+	test_assert_range ${DMS} 200 300 "timeout duration"
+
+	test_passed
+}
+
+. ${PWM_TEST_ROOT}/pwm-test-common.sh.inc
@@ -0,0 +1,55 @@
+#!/bin/sh
+#
+# SPDX-License-Identifier: WTFPL
+# SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+#
+# Timing test (run serially)
+#
+
+function do_test {
+	local SYSFS
+	local RET
+	local WAVE
+
+	test_sysfs_create ${DEFAULT_PWM_CHIP} ${DEFAULT_PWM_CHANNEL} SYSFS
+
+	# Fake device rejects what the kernel rejects (dd is used
+	# as it calls write() directly, unlike shell and stdio)
+	echo 1 | LD_PRELOAD="${PWM_FAKE_LIB}" PWM_FAKE_LOG="${PWM_FAKE_LOG}" \
+		dd of=${SYSFS}/${SYSFS_PWM_FILE_ENABLE} status=none 2>/dev/null \
+		&& test_failed "enabled with zero period"
+
+	echo 100 | LD_PRELOAD="${PWM_FAKE_LIB}" PWM_FAKE_LOG="${PWM_FAKE_LOG}" \
+		dd of=${SYSFS}/${SYSFS_PWM_FILE_DUTY_CYCLE} status=none 2>/dev/null \
+		&& test_failed "duty cycle greater than period accepted"
+
+	test_assert_eq "$(test_fake_errors)" "2" "rejected writes"
+	rm -f "${PWM_FAKE_LOG}"
+
+	# Frequency changes of the enabled PWM in both directions
+	test_fake_run -s "F1000D100k f3000k f500"
+	RET=$?
+
+	test_assert_eq "${RET}" "${PWM_E_OK}" "return code"
+	test_assert_eq "$(test_fake_errors)" "0" "rejected writes"
+
+	# Active output segments
+	WAVE=($(test_fake_waveform | awk '$2 != 0'))
+
+	test_assert_eq "${#WAVE[@]}" "6" "waveform length"
+	test_assert_eq "${WAVE[1]}" "1000000" "1st period"
+	test_assert_eq "${WAVE[3]}" "333333" "2nd period"
+	test_assert_eq "${WAVE[5]}" "2000000" "3rd period"
+	test_assert_range ${WAVE[2]} 100 120 "2nd period start"
+	test_assert_range ${WAVE[4]} 200 230 "3rd period start"
+
+	# Output is disabled at the end
+	WAVE=($(test_fake_waveform | tail -n 1))
+
+	test_assert_eq "${WAVE[1]}" "0" "disabled"
+	test_assert_range ${WAVE[0]} 300 340 "disable time"
+
+	test_passed
+}
+
+. ${PWM_TEST_ROOT}/pwm-test-common.sh.inc
@@ -0,0 +1,67 @@
+#!/bin/sh
+#
+# SPDX-License-Identifier: WTFPL
+# SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+#
+
+#
+# $1 - sysfs control dir
+# $2 - enable
+# $3 - period
+# $4 - duty_cycle
+#
+function set_state {
+	echo -n "$2" > $1/${SYSFS_PWM_FILE_ENABLE}
+	echo -n "$3" > $1/${SYSFS_PWM_FILE_PERIOD}
+	echo -n "$4" > $1/${SYSFS_PWM_FILE_DUTY_CYCLE}
+}
+
+function do_test {
+	local SYSFS
+	local RET
+
+	test_sysfs_create ${DEFAULT_PWM_CHIP} ${DEFAULT_PWM_CHANNEL} SYSFS
+
+	# Running channel with the duty cycle greater than the new period
+	set_state ${SYSFS} 1 1000000 800000
+
+	test_fake_run --fast-start -f 5000 -d 10
+	RET=$?
+
+	test_assert_eq "${RET}" "${PWM_E_OK}" "return code"
+	test_assert_eq "$(test_fake_errors)" "0" "rejected writes"
+	test_assert_eq "$(grep '^W' ${PWM_FAKE_LOG} | \
+		awk '{ printf("%s=%s ", $4, $5) }')" \
+		"duty_cycle=100000 period=200000 enable=1 enable=0 " "writes"
+
+	# Only the enable attribute is touched by the disable-only script
+	rm -f "${PWM_FAKE_LOG}"
+	set_state ${SYSFS} 1 1000000 500000
+
+	test_fake_run --fast-start -s "f0"
+	RET=$?
+
+	test_assert_eq "${RET}" "${PWM_E_OK}" "return code (disable)"
+
+	test_assert_eq "$(grep '^W' ${PWM_FAKE_LOG} | \
+		awk '{ printf("%s=%s ", $4, $5) }')" "enable=0 " "writes (disable)"
+
+	# Polarity is read before the change
+	rm -f "${PWM_FAKE_LOG}"
+	set_state ${SYSFS} 0 1000000 500000
+
+	test_fake_run --fast-start --polarity inversed -d 10
+	RET=$?
+
+	test_assert_eq "${RET}" "${PWM_E_OK}" "return code (polarity)"
+	test_assert_eq "$(cat ${SYSFS}/${SYSFS_PWM_FILE_POLARITY})" "inversed" "polarity"
+	test_assert_eq "$(test_fake_errors)" "0" "rejected writes (polarity)"
+
+	# Missing channel is reported as without fast start
+	${PWM_TEST_BIN} --fast-start -c 1 -d 10
+	test_assert_eq "$?" "${PWM_E_NO_CHANNEL}" "return code (no channel)"
+
+	test_passed
+}
+
+. ${PWM_TEST_ROOT}/pwm-test-common.sh.inc
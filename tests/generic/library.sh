@@ -0,0 +1,138 @@
+#!/bin/sh
+#
+# SPDX-License-Identifier: WTFPL
+# SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+#
+# Test libpwm shared library: SONAME, exported symbols against
+# the version script, linking of the consumer with the installed
+# library through the pkg-config file
+#
+
+#
+# Print exported symbols patterns of the version script as regexps
+#
+function map_patterns {
+	awk '/global:/ { g = 1; next } /local:/ { g = 0 }
+		g { gsub(/[;[:space:]]/, ""); if ($0 != "") print }' \
+		"${PWM_LIB_MAP}" | sed 's/\*/.*/g'
+}
+
+#
+# Print functions declared in the installed headers
+#
+function api_functions {
+	local HEADER
+
+	for HEADER in $(awk '/^set\(LIB_HEADERS/ { h = 1; next }
+			h && /\)/ { h = 0 } h { print $1 }' \
+			"${PWM_TEST_ROOT}/../CMakeLists.txt"); do
+		sed -n 's/^[A-Za-z_][A-Za-z0-9_ ]*[ *]\(pwm_[a-z0-9_]*\)(.*/\1/p' \
+			"${PWM_TEST_ROOT}/../${HEADER}"
+	done
+}
+
+function do_test {
+	local DESTDIR="$(realpath "${PWM_TEST_DIR}")/destdir"
+	local APP="${PWM_TEST_DIR}/app"
+	local SYMBOLS
+	local SYMBOL
+	local NAME
+	local NODE
+	local PC
+	local LIBDIR
+	local SYSFS
+
+	[ -f "${PWM_LIB_FILE}" ] || test_failed "shared library is not built"
+
+	NODE="$(awk '/{/ { print $1; exit }' "${PWM_LIB_MAP}")"
+
+	test_assert_eq \
+		"$(readelf -d "${PWM_LIB_FILE}" | sed -n 's/.*(SONAME).*\[\(.*\)\]/\1/p')" \
+		"libpwm.so.${PWM_LIB_SOVERSION}" "SONAME"
+
+	# Real file name has the same ABI version as the SONAME
+	case "$(basename "$(readlink -f "${PWM_LIB_FILE}")")" in
+		libpwm.so.${PWM_LIB_SOVERSION}.*) ;;
+		*) test_failed "library file version does not match SONAME" ;;
+	esac
+
+	# Only the symbols of the version script are exported
+	SYMBOLS="$(nm -D --defined-only "${PWM_LIB_FILE}" | awk '{ print $3 }')"
+
+	for SYMBOL in ${SYMBOLS}; do
+		[ "${SYMBOL}" = "${NODE}" ] && continue
+
+		NAME="${SYMBOL%@@${NODE}}"
+		[ "${NAME}" != "${SYMBOL}" ] || \
+			test_failed "symbol '${SYMBOL}' is not in version node ${NODE}"
+
+		echo "${NAME}" | grep -qxf <(map_patterns) || \
+			test_failed "symbol '${NAME}' is not in the version script"
+	done
+
+	# All functions of the installed headers are exported
+	for NAME in $(api_functions); do
+		echo "${SYMBOLS}" | grep -qx "${NAME}@@${NODE}" || \
+			test_failed "function '${NAME}' is not exported"
+	done
+
+	test_assert_range $(api_functions | wc -l) 50 1000 "API functions count"
+
+	# Test driver is linked with the shared library
+	readelf -d "${PWM_DRIVER_BIN}" | \
+		grep -q "NEEDED.*\[libpwm.so.${PWM_LIB_SOVERSION}\]" || \
+		test_failed "test driver is not linked with libpwm.so"
+
+	test_sysfs_create ${DEFAULT_PWM_CHIP} ${DEFAULT_PWM_CHANNEL} SYSFS
+	${PWM_DRIVER_BIN} bench -n 10 "F1000d0" > /dev/null
+	test_assert_eq "$?" "0" "test driver return code"
+
+	# Consumer is built with the installed headers, library and
+	# pkg-config file
+	if ! command -v pkg-config > /dev/null; then
+		echo "pkg-config is not found, consumer build is skipped"
+		test_passed
+	fi
+
+	DESTDIR="${DESTDIR}" ${PWM_CMAKE} --install "${PWM_BUILD_DIR}" \
+		> /dev/null || test_failed "install failed"
+
+	PC="$(find "${DESTDIR}" -name libpwm.pc)"
+	[ -f "${PC}" ] || test_failed "pkg-config file is not installed"
+
+	export PKG_CONFIG_PATH="$(dirname "${PC}")"
+	export PKG_CONFIG_LIBDIR="${PKG_CONFIG_PATH}"
+	export PKG_CONFIG_SYSROOT_DIR="${DESTDIR}"
+
+	test_assert_eq "$(pkg-config --modversion libpwm)" "${PWM_VERSION}" \
+		"pkg-config version"
+
+	cat > "${APP}.c" <<-EOF
+		#include <stdio.h>
+		#include <pwm.h>
+		#include <pwm_worker.h>
+
+		int main(void)
+		{
+		    printf("%s\n", pwm_strstatus(PWM_E_NO_CHIP));
+		    return 0;
+		}
+	EOF
+
+	${PWM_CC} "${APP}.c" -o "${APP}" $(pkg-config --cflags --libs libpwm) || \
+		test_failed "consumer build failed"
+
+	LIBDIR="$(pkg-config --libs-only-L libpwm | xargs)"
+	LIBDIR="${LIBDIR#-L}"
+
+	test_assert_eq "$(LD_LIBRARY_PATH="${LIBDIR}" "${APP}")" \
+		"PWM chip is not available" "consumer output"
+
+	readelf -d "${APP}" | \
+		grep -q "NEEDED.*\[libpwm.so.${PWM_LIB_SOVERSION}\]" || \
+		test_failed "consumer is not linked with libpwm.so"
+
+	test_passed
+}
+
+. ${PWM_TEST_ROOT}/pwm-test-common.sh.inc
@@ -0,0 +1,47 @@
+#!/bin/sh
+#
+# SPDX-License-Identifier: WTFPL
+# SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+#
+
+function do_test {
+	local RET
+	local SYSFS
+	local STDOUT
+	local DEVICES
+	local I
+
+	test_sysfs_create_chip 0 2 "ff680000.pwm" "buzzer"
+	test_sysfs_create_chip 10 4 "i2c-1/1-0040"
+	test_sysfs_create_chip 2 1 "ff690000.pwm"
+	test_sysfs_create 0 1 SYSFS
+	test_sysfs_create 10 0 SYSFS
+	test_sysfs_create 10 3 SYSFS
+
+	DEVICES="$(cd ${SYSFS_PWM_ROOT}/devices && pwd -P)"
+
+	STDOUT=$(${PWM_TEST_BIN} --list)
+	RET=$?
+
+	test_assert_eq "${RET}" "${PWM_E_OK}" "return code"
+	test_assert_eq "${STDOUT}" "$(printf "%s\n%s\n%s" \
+		"pwmchip0 npwm=2 exported=1 device=${DEVICES}/ff680000.pwm label=buzzer" \
+		"pwmchip2 npwm=1 exported=- device=${DEVICES}/ff690000.pwm label=-" \
+		"pwmchip10 npwm=4 exported=0,3 device=${DEVICES}/i2c-1/1-0040 label=-")" \
+		"stdout contents"
+
+	# Scan storage is grown while reading the sysfs root
+	for I in $(seq 20 39); do
+		test_sysfs_create_chip ${I} 1 "pwm${I}"
+	done
+
+	STDOUT=$(${PWM_TEST_BIN} --list)
+	test_assert_eq "$?" "${PWM_E_OK}" "return code (many chips)"
+	test_assert_eq "$(echo "${STDOUT}" | awk '{ print $1 }' | xargs)" \
+		"pwmchip0 pwmchip2 pwmchip10 $(seq -f 'pwmchip%g' -s ' ' 20 39)" \
+		"chips order (many chips)"
+
+	test_passed
+}
+
+. ${PWM_TEST_ROOT}/pwm-test-common.sh.inc
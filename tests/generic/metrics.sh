@@ -0,0 +1,90 @@
+#!/bin/sh
+#
+# SPDX-License-Identifier: WTFPL
+# SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+#
+# Test metrics export
+#
+# Timing test (run serially)
+#
+
+#
+# Print metric value from the metrics file
+#
+# $1 - metrics file
+# $2 - metric name with labels
+#
+function metric {
+	awk -v m="$2" '$1 == m { print $2 }' "$1"
+}
+
+function do_test {
+	local METRICS="${PWM_TEST_DIR}/pwm.prom"
+	local SHM="${PWM_TEST_DIR}/pwm.shm"
+	local SYSFS
+	local PID
+	local RET
+
+	test_sysfs_create ${DEFAULT_PWM_CHIP} ${DEFAULT_PWM_CHANNEL} SYSFS
+
+	# Metrics are saved on exit
+	test_fake_run -s "F1000D20k f3000" --metrics "${METRICS}"
+	RET=$?
+
+	test_assert_eq "${RET}" "${PWM_E_OK}" "return code"
+	[ -f "${METRICS}" ] || test_failed "metrics file is not created"
+
+	test_assert_eq "$(metric ${METRICS} 'pwm_scripts_total{status="0"}')" \
+		"1" "completed scripts"
+	test_assert_eq "$(metric ${METRICS} 'pwm_writes_total{attr="enable"}')" \
+		"2" "enable writes"
+	test_assert_eq "$(metric ${METRICS} 'pwm_writes_total{attr="period"}')" \
+		"2" "period writes"
+	test_assert_eq "$(metric ${METRICS} 'pwm_writes_total{attr="duty_cycle"}')" \
+		"2" "duty cycle writes"
+	test_assert_eq "$(grep -c '^pwm_write_errors_total' ${METRICS})" \
+		"0" "write errors"
+	test_assert_eq "$(metric ${METRICS} 'pwm_sleep_lateness_seconds_count')" \
+		"2" "sleeps"
+	test_assert_eq "$(metric ${METRICS} 'pwm_sleep_lateness_seconds_bucket{le="+Inf"}')" \
+		"2" "sleeps in +Inf bucket"
+
+	# Write errors are counted by errno (duty cycle found
+	# at start is greater than the new period)
+	echo 5000000 > ${SYSFS}/${SYSFS_PWM_FILE_DUTY_CYCLE}
+
+	test_fake_run -s "F1000D10" --metrics "${METRICS}" 2>/dev/null
+	RET=$?
+
+	test_assert_eq "${RET}" "${PWM_E_IO}" "return code (write error)"
+	test_assert_eq "$(metric ${METRICS} 'pwm_scripts_total{status="'${PWM_E_IO}'"}')" \
+		"1" "failed scripts"
+	test_assert_eq "$(metric ${METRICS} 'pwm_write_errors_total{errno="22"}')" \
+		"1" "EINVAL write errors"
+
+	# Metrics are saved periodically and kept in the shared memory
+	rm -f "${METRICS}"
+	echo 0 > ${SYSFS}/${SYSFS_PWM_FILE_DUTY_CYCLE}
+
+	LD_PRELOAD="${PWM_FAKE_LIB}" PWM_FAKE_LOG="${PWM_FAKE_LOG}" \
+		${PWM_TEST_BIN} --engine "0:0:F100D50 D50w0" --metrics "${METRICS}" \
+			--metrics-interval 100 --metrics-shm "${SHM}" &
+	PID=$!
+	sleep 0.5
+
+	[ -f "${METRICS}" ] || test_failed "metrics file is not updated"
+	test_assert_eq "$(od -A n -N 8 -t x8 ${SHM} | tr -d ' ')" \
+		"005254454d4d5750" "shared memory magic"
+
+	kill -INT ${PID}
+	wait ${PID}
+	RET=$?
+
+	test_assert_eq "${RET}" "${PWM_E_INTR}" "return code (interrupted)"
+	test_assert_range "$(metric ${METRICS} 'pwm_engine_wakeups_total')" \
+		5 20 "engine wakeups"
+
+	test_passed
+}
+
+. ${PWM_TEST_ROOT}/pwm-test-common.sh.inc
@@ -0,0 +1,88 @@
+#!/bin/sh
+#
+# SPDX-License-Identifier: WTFPL
+# SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+#
+
+#
+# $1 - chip name
+# $2 - expected return code
+# $3 - sysfs control dir (must be written if return code is PWM_E_OK)
+#
+function name_test() {
+	local RET
+	local ENABLE
+	local PERIOD
+	local DUTY_CYCLE
+
+	${PWM_TEST_BIN} --name="$1" -k
+	RET=$?
+
+	test_assert_eq "${RET}" "$2" "return code for '$1'"
+
+	if [ "$2" = "${PWM_E_OK}" ]; then
+		test_sysfs_read $3 ENABLE PERIOD DUTY_CYCLE
+		test_assert_eq "${ENABLE}" "1" "enable data check for '$1'"
+		echo -n "0" > $3/${SYSFS_PWM_FILE_ENABLE}
+	fi
+}
+
+function do_test {
+	local SYSFS0
+	local SYSFS1
+	local SYSFS3
+	local SYSFS5
+
+	test_sysfs_create_chip 0 1 "ff680000.pwm"
+	test_sysfs_create_chip 3 1 "i2c-1/1-0040" "backlight"
+	test_sysfs_create 0 0 SYSFS0
+	test_sysfs_create 3 0 SYSFS3
+
+	name_test "backlight"            "${PWM_E_OK}" ${SYSFS3}
+	name_test "ff680000.pwm"         "${PWM_E_OK}" ${SYSFS0}
+	name_test "i2c-1/1-0040"         "${PWM_E_OK}" ${SYSFS3}
+	name_test "0040"                 "${PWM_E_NO_CHIP}"
+	name_test "unknown"              "${PWM_E_NO_CHIP}"
+
+	[ -f "${PWM_INDEX_FILE}" ] || test_failed "index file is not created"
+
+	# Valid cached entry must be used without index rebuild
+	local INODE="$(stat -c %i "${PWM_INDEX_FILE}")"
+
+	name_test "backlight"            "${PWM_E_OK}" ${SYSFS3}
+	name_test "ff680000.pwm"         "${PWM_E_OK}" ${SYSFS0}
+
+	test_assert_eq "$(stat -c %i "${PWM_INDEX_FILE}")" "${INODE}" \
+		"index file is not rebuilt"
+
+	# Changed chip must not be served from the index
+	mkdir -p ${SYSFS_PWM_ROOT}/devices/ff690000.pwm
+	ln -sfn "../devices/ff690000.pwm" \
+		${SYSFS_PWM_ROOT}/$(printf ${SYSFS_PWM_CHIP_FOLDER_FMT} 0)/device
+
+	name_test "ff680000.pwm"         "${PWM_E_NO_CHIP}"
+	name_test "ff690000.pwm"         "${PWM_E_OK}" ${SYSFS0}
+
+	# New chip must be found
+	test_sysfs_create_chip 1 1 "ff6a0000.pwm"
+	test_sysfs_create 1 0 SYSFS1
+
+	name_test "ff6a0000.pwm"         "${PWM_E_OK}" ${SYSFS1}
+
+	# Index built for another sysfs root must not be used
+	SYSFS_PWM_ROOT="${PWM_TEST_DIR}/pwmroot2"
+	export PWM_SYSFS_ROOT="${SYSFS_PWM_ROOT}"
+
+	test_sysfs_create_chip 5 1 "i2c-1/1-0040" "backlight"
+	test_sysfs_create 5 0 SYSFS5
+
+	name_test "backlight"            "${PWM_E_OK}" ${SYSFS5}
+	name_test "ff680000.pwm"         "${PWM_E_NO_CHIP}"
+
+	test_assert_eq "$(head -n 1 "${PWM_INDEX_FILE}")" \
+		"pwm-index 2 ${SYSFS_PWM_ROOT}" "index file header"
+
+	test_passed
+}
+
+. ${PWM_TEST_ROOT}/pwm-test-common.sh.inc
@@ -0,0 +1,122 @@
+#!/bin/sh
+#
+# SPDX-License-Identifier: WTFPL
+# SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+#
+# Test zero-heap build (all dynamic storage is in the static arena,
+# heap usage of the process is counted with the LD_PRELOAD shim)
+#
+
+#
+# Print value of the arena statistics field
+#
+# $1 - field name
+#
+function arena_stat {
+	tr ' ' '\n' < "${PWM_TEST_DIR}/stats" | sed -n "s/^$1=//p"
+}
+
+#
+# Print value of the heap usage counter (see fake/pwm-heap.c)
+#
+# $1 - counter name
+#
+function heap_stat {
+	tr ' ' '\n' < "${PWM_TEST_DIR}/heap" | sed -n "s/^$1=//p"
+}
+
+#
+# Run zero-heap binary with the fake PWM device emulation,
+# heap usage is counted to the ${PWM_TEST_DIR}/heap file
+#
+# $@ - binary arguments
+#
+function noheap_run {
+	rm -f "${PWM_TEST_DIR}/heap"
+
+	LD_PRELOAD="${PWM_FAKE_LIB} ${PWM_HEAP_LIB}" PWM_FAKE_LOG="${PWM_FAKE_LOG}" \
+		PWM_HEAP_LOG="${PWM_TEST_DIR}/heap" ${PWM_TEST_NOHEAP_BIN} "$@"
+}
+
+function do_test {
+	local CONFIG="${PWM_TEST_DIR}/channels.conf"
+	local SYSFS
+	local ENABLE
+	local PERIOD
+	local DUTY_CYCLE
+	local RET
+
+	[ -x "${PWM_TEST_NOHEAP_BIN}" ] || test_failed "zero-heap binary is not built"
+
+	# Allocation functions are not linked at all
+	if command -v nm > /dev/null; then
+		test_assert_eq "$(nm -u ${PWM_TEST_NOHEAP_BIN} | \
+			grep -cE ' (malloc|calloc|realloc|free|strdup|getline|scandir)(@|$)')" \
+			"0" "heap functions"
+	fi
+
+	test_sysfs_create ${DEFAULT_PWM_CHIP} ${DEFAULT_PWM_CHANNEL} SYSFS
+
+	# Script compilation and execution make no heap allocations,
+	# including the allocations inside the C library
+	noheap_run -s "F1000D10 f2000 g500-1000/100"
+	RET=$?
+
+	test_assert_eq "${RET}" "${PWM_E_OK}" "return code (heap)"
+	test_assert_eq "$(heap_stat allocs)" "0" "heap allocations"
+
+	# Arena memory is released on exit, high-water mark is reported
+	noheap_run -s "F1000D10 f2000 g500-1000/100" --stats \
+		> "${PWM_TEST_DIR}/stats"
+	RET=$?
+
+	test_assert_eq "${RET}" "${PWM_E_OK}" "return code"
+	test_assert_eq "$(arena_stat arena_used)" "0" "used arena"
+	test_assert_eq "$(arena_stat arena_failures)" "0" "arena failures"
+	test_assert_range "$(arena_stat arena_high_water)" 1 \
+		"$(arena_stat arena_size)" "arena high-water mark"
+
+	# Arena exhaustion is reported at compile stage before any PWM changes
+	rm -f "${PWM_FAKE_LOG}"
+
+	noheap_run -s "F1000D10 g100-2000/100000" --stats \
+		> "${PWM_TEST_DIR}/stats" 2> "${PWM_TEST_DIR}/stderr"
+	RET=$?
+
+	test_assert_eq "${RET}" "${PWM_E_NO_MEMORY}" "return code (exhausted)"
+	test_assert_eq "$(grep -c 'Arena capacity is exceeded' ${PWM_TEST_DIR}/stderr)" \
+		"1" "exhaustion error"
+	test_assert_eq "$(arena_stat arena_failures)" "1" "arena failures (exhausted)"
+	test_assert_eq "$(arena_stat arena_used)" "0" "used arena (exhausted)"
+
+	test_assert_eq "$(cat ${PWM_FAKE_LOG} 2> /dev/null | grep -c '^W')" "0" \
+		"writes (exhausted)"
+
+	# Chip lookup and bulk configuration use the arena too
+	echo "0:${DEFAULT_PWM_CHANNEL} frequency=1000 duty=25" > "${CONFIG}"
+
+	noheap_run --apply "${CONFIG}" --stats > "${PWM_TEST_DIR}/stats"
+	RET=$?
+
+	test_assert_eq "${RET}" "${PWM_E_OK}" "return code (apply)"
+	test_assert_eq "$(arena_stat arena_used)" "0" "used arena (apply)"
+
+	# Only the stdout buffer of the C library is left in the heap
+	# (the configuration file stream is freed)
+	test_assert_range "$(heap_stat leaked)" 0 1 "heap blocks (apply)"
+
+	test_sysfs_read ${SYSFS} ENABLE PERIOD DUTY_CYCLE
+	test_assert_eq "${PERIOD}" "1000000" "period (apply)"
+	test_assert_eq "${DUTY_CYCLE}" "250000" "duty cycle (apply)"
+
+	# Patterns are compiled on the host
+	echo "beep F1000D10" | ${PWM_TEST_NOHEAP_BIN} \
+		--compile "${PWM_TEST_DIR}/patterns.bin" 2> /dev/null
+	RET=$?
+
+	test_assert_eq "${RET}" "${PWM_E_NOT_SUPPORTED}" "return code (compile)"
+
+	test_passed
+}
+
+. ${PWM_TEST_ROOT}/pwm-test-common.sh.inc
@@ -0,0 +1,83 @@
+#!/bin/sh
+#
+# SPDX-License-Identifier: WTFPL
+# SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+#
+
+function do_test {
+	local RET
+	local SYSFS
+	local WAVE
+	local EXPECTED
+	local LIB="${PWM_TEST_DIR}/patterns.bin"
+
+	test_sysfs_create ${DEFAULT_PWM_CHIP} ${DEFAULT_PWM_CHANNEL} SYSFS
+
+	# Patterns libraries are compiled on the host in the zero-heap build
+	if [ "${PWM_TEST_NO_HEAP}" = "1" ]; then
+		echo "beep F2000D20" | ${PWM_TEST_BIN} --compile "${LIB}"
+		test_assert_eq "$?" "${PWM_E_NOT_SUPPORTED}" "return code (zero-heap compile)"
+		test_passed
+	fi
+
+	${PWM_TEST_BIN} --compile "${LIB}" <<-PATTERNS
+		# Test patterns
+		beep   F2000D20w25k fw75k fn30
+
+		sweep  u10 g1000-2000/50
+		tune   melody:t:d=16,o=5,b=240:c,e
+	PATTERNS
+	RET=$?
+
+	test_assert_eq "${RET}" "${PWM_E_OK}" "return code (compile)"
+	[ -f "${LIB}" ] || test_failed "patterns library is not created"
+
+	# Magic and little-endian format version
+	test_assert_eq "$(head -c 7 "${LIB}")" "PWMPATT" "magic"
+	test_assert_eq "$(od -A n -t u1 -j 8 -N 4 "${LIB}" | tr -s ' ')" \
+		" 1 0 0 0" "version"
+
+	# Pattern gives the same waveform as the script
+	test_fake_run -s "F2000D20w25k fw75k fn30"
+	test_assert_eq "$?" "${PWM_E_OK}" "return code (script)"
+	EXPECTED="$(test_fake_waveform | awk '{ print $2, $3 }')"
+
+	rm -f "${PWM_FAKE_LOG}"
+	test_fake_run --pattern-file "${LIB}" --pattern beep
+	test_assert_eq "$?" "${PWM_E_OK}" "return code (pattern)"
+	test_assert_eq "$(test_fake_waveform | awk '{ print $2, $3 }')" \
+		"${EXPECTED}" "pattern waveform"
+
+	rm -f "${PWM_FAKE_LOG}"
+	test_fake_run --pattern-file "${LIB}" --pattern tune
+	test_assert_eq "$?" "${PWM_E_OK}" "return code (melody pattern)"
+
+	WAVE=($(test_fake_waveform | awk '$2 != 0'))
+	test_assert_eq "${WAVE[1]}" "1911128" "C5 period"
+	test_assert_eq "${WAVE[3]}" "1516863" "E5 period"
+
+	${PWM_TEST_BIN} --pattern-file "${LIB}" --pattern sweep
+	test_assert_eq "$?" "${PWM_E_OK}" "return code (sweep pattern)"
+
+	${PWM_TEST_BIN} --pattern-file "${LIB}" --pattern unknown
+	test_assert_eq "$?" "${PWM_E_NO_PATTERN}" "return code (unknown pattern)"
+
+	${PWM_TEST_BIN} --pattern-file "${LIB}.none" --pattern beep
+	test_assert_eq "$?" "${PWM_E_IO}" "return code (no library)"
+
+	# Corrupted library
+	printf 'XXXXXXXX' | dd of="${LIB}" conv=notrunc 2> /dev/null
+	${PWM_TEST_BIN} --pattern-file "${LIB}" --pattern beep
+	test_assert_eq "$?" "${PWM_E_FAILED}" "return code (invalid magic)"
+
+	# Duplicate names and syntax errors are rejected
+	printf 'a f\na F100\n' | ${PWM_TEST_BIN} --compile "${LIB}"
+	test_assert_eq "$?" "${PWM_E_FAILED}" "return code (duplicate name)"
+
+	printf 'a f\nb x\n' | ${PWM_TEST_BIN} --compile "${LIB}"
+	test_assert_eq "$?" "${PWM_E_FAILED}" "return code (syntax error)"
+
+	test_passed
+}
+
+. ${PWM_TEST_ROOT}/pwm-test-common.sh.inc
@@ -0,0 +1,116 @@
+#!/bin/sh
+#
+# SPDX-License-Identifier: WTFPL
+# SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+#
+# Test priority preemption in the background worker. Requests
+# are "<at_ms>:<priority>:<flags>:<script>", flags are 'n'
+# (preempt instantly) and 'r' (resume after preemption).
+#
+# Timing test (run serially)
+#
+
+function driver_run {
+	local SYSFS
+
+	test_sysfs_create ${DEFAULT_PWM_CHIP} ${DEFAULT_PWM_CHANNEL} SYSFS
+	rm -f "${PWM_FAKE_LOG}"
+
+	LD_PRELOAD="${PWM_FAKE_LIB}" PWM_FAKE_LOG="${PWM_FAKE_LOG}" \
+		${PWM_DRIVER_BIN} preempt "$@"
+}
+
+#
+# Print played frequencies (0 while the output is inactive)
+#
+function frequencies {
+	test_fake_waveform | awk '{ print $2 ? int(1e9 / $2 + 0.5) : 0 }' | xargs
+}
+
+#
+# Print times of the waveform changes
+#
+function times {
+	test_fake_waveform | awk '{ print $1 }' | xargs
+}
+
+function do_test {
+	local REPORT
+	local WAVE
+
+	[ -f "${PWM_DRIVER_BIN}" ] || test_failed "test driver is not built"
+
+	# Instant preemption, preempted script is resumed for
+	# the remaining 200 ms of its command
+	REPORT="$(driver_run 0:1:r:F1000d300 100:5:n:F2000d100)"
+	test_assert_eq "$?" "0" "driver return code (instant)"
+	test_assert_eq "${REPORT}" \
+		"executed=2 discarded=0 failed=0 preempted=1 resumed=1" \
+		"report (instant)"
+	test_assert_eq "$(frequencies)" "0 1000 2000 0 1000 0" "waveform (instant)"
+
+	WAVE=($(times))
+	test_assert_range ${WAVE[2]} 95 125 "preemption (instant)"
+	test_assert_range ${WAVE[4]} 195 225 "resume (instant)"
+	test_assert_range $((WAVE[5] - WAVE[4])) 195 225 "resumed duration (instant)"
+
+	# Preemption at the deadline of the current command, preempted
+	# script is resumed from the next command
+	REPORT="$(driver_run "0:1:r:F1000d100 F1500d100" 50:5:-:F2000d100)"
+	test_assert_eq "$?" "0" "driver return code (deadline)"
+	test_assert_eq "${REPORT}" \
+		"executed=2 discarded=0 failed=0 preempted=1 resumed=1" \
+		"report (deadline)"
+	test_assert_eq "$(frequencies)" "0 1000 2000 0 1500 0" "waveform (deadline)"
+
+	WAVE=($(times))
+	test_assert_range ${WAVE[2]} 95 125 "preemption (deadline)"
+	test_assert_range ${WAVE[4]} 195 225 "resume (deadline)"
+	test_assert_range $((WAVE[5] - WAVE[4])) 95 125 "resumed duration (deadline)"
+
+	# Preempted script without resume flag is discarded
+	REPORT="$(driver_run 0:1:-:F1000d300 100:5:n:F2000d100)"
+	test_assert_eq "$?" "0" "driver return code (discard)"
+	test_assert_eq "${REPORT}" \
+		"executed=1 discarded=1 failed=0 preempted=1 resumed=0" \
+		"report (discard)"
+	test_assert_eq "$(frequencies)" "0 1000 2000 0" "waveform (discard)"
+
+	# Suspended scripts limit (PWM_WORKER_SUSPEND_MAX = 4): the
+	# lowest-priority script is discarded when the 6th script
+	# preempts the 5th one, others are resumed in priority order
+	# for the remaining 90 ms of their commands
+	REPORT="$(driver_run \
+		0:1:rn:F1000d100  10:2:rn:F2000d100 20:3:rn:F3000d100 \
+		30:4:rn:F4000d100 40:5:rn:F5000d100 50:6:rn:F6000d100)"
+	test_assert_eq "$?" "0" "driver return code (limit)"
+	test_assert_eq "${REPORT}" \
+		"executed=5 discarded=1 failed=0 preempted=5 resumed=4" \
+		"report (limit)"
+	test_assert_eq "$(frequencies)" \
+		"0 1000 2000 3000 4000 5000 6000 0 5000 0 4000 0 3000 0 2000 0" \
+		"waveform (limit)"
+
+	WAVE=($(times))
+	test_assert_range ${WAVE[7]} 145 175 "preempting script end (limit)"
+	test_assert_range $((WAVE[9] - WAVE[8])) 85 115 "resumed duration (limit)"
+	test_assert_range $((WAVE[15] - WAVE[14])) 85 115 "last resumed duration (limit)"
+
+	# Script waited by the pending request is replaced by the
+	# invalid one, pending request is started at once
+	REPORT="$(driver_run 0:1:-:F1000d300 50:5:-:F2000d100 100:1:-:F1000x)"
+	test_assert_eq "$?" "0" "driver return code (failed replace)"
+	test_assert_eq "${REPORT}" \
+		"executed=1 discarded=1 failed=1 preempted=0 resumed=0" \
+		"report (failed replace)"
+	test_assert_eq "$(frequencies)" "0 1000 0 2000 0" "waveform (failed replace)"
+
+	WAVE=($(times))
+	test_assert_range ${WAVE[3]} 95 125 "pending start (failed replace)"
+
+	test_assert_eq "$(test_fake_errors)" "0" "rejected writes"
+
+	test_passed
+}
+
+. ${PWM_TEST_ROOT}/pwm-test-common.sh.inc
@@ -0,0 +1,90 @@
+#!/bin/sh
+#
+# SPDX-License-Identifier: WTFPL
+# SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+#
+
+#
+# $1 - sysfs control dir
+# $2 - enable
+# $3 - period
+# $4 - duty_cycle
+#
+function set_state {
+	echo -n "$2" > $1/${SYSFS_PWM_FILE_ENABLE}
+	echo -n "$3" > $1/${SYSFS_PWM_FILE_PERIOD}
+	echo -n "$4" > $1/${SYSFS_PWM_FILE_DUTY_CYCLE}
+}
+
+#
+# $1 - sysfs control dir
+#
+function get_state {
+	echo $(cat $1/${SYSFS_PWM_FILE_ENABLE} \
+	           $1/${SYSFS_PWM_FILE_PERIOD} \
+	           $1/${SYSFS_PWM_FILE_DUTY_CYCLE})
+}
+
+function do_test {
+	local CHIP_DIR
+	local SYSFS
+	local RET
+	local PID
+
+	test_sysfs_create ${DEFAULT_PWM_CHIP} ${DEFAULT_PWM_CHANNEL} SYSFS
+
+	# Running channel (e.g. fan) with short period is restored
+	set_state ${SYSFS} 1 40000 12000
+
+	test_fake_run --restore -d 20
+	RET=$?
+
+	test_assert_eq "${RET}" "${PWM_E_OK}" "return code"
+	test_assert_eq "$(test_fake_errors)" "0" "rejected writes"
+	test_assert_eq "$(get_state ${SYSFS})" "1 40000 12000" "restored state"
+
+	# Script disables PWM, then only 3 writes are needed to restore it
+	test_assert_eq "$(grep '^W' ${PWM_FAKE_LOG} | tail -n 4 | \
+		awk '{ printf("%s=%s ", $4, $5) }')" \
+		"enable=0 duty_cycle=12000 period=40000 enable=1 " "restore writes"
+
+	# Disabled channel with long period is restored on SIGTERM
+	rm -f ${PWM_FAKE_LOG}
+	set_state ${SYSFS} 0 5000000 1000000
+
+	LD_PRELOAD="${PWM_FAKE_LIB}" PWM_FAKE_LOG="${PWM_FAKE_LOG}" \
+		${PWM_TEST_BIN} --restore -f 3000 -d 2000 &
+	PID=$!
+	sleep 0.2
+	test_assert_eq "$(get_state ${SYSFS})" "1 333333 166667" "running state"
+
+	kill -TERM ${PID}
+	wait ${PID}
+	RET=$?
+
+	test_assert_eq "${RET}" "${PWM_E_INTR}" "return code (SIGTERM)"
+	test_assert_eq "$(test_fake_errors)" "0" "rejected writes (SIGTERM)"
+	test_assert_eq "$(get_state ${SYSFS})" "0 5000000 1000000" "restored state (SIGTERM)"
+
+	# Channel exported by the tool is unexported
+	CHIP_DIR=${SYSFS_PWM_ROOT}/$(printf ${SYSFS_PWM_CHIP_FOLDER_FMT} 1)
+	test_sysfs_create 1 ${DEFAULT_PWM_CHANNEL} SYSFS
+	mv ${SYSFS} ${SYSFS}.unexported
+	touch ${CHIP_DIR}/export ${CHIP_DIR}/unexport
+
+	(
+		sleep 0.1
+		mv ${SYSFS}.unexported ${SYSFS}
+	) &
+
+	${PWM_TEST_BIN} -p 1 --restore -d 10
+	RET=$?
+	wait
+
+	test_assert_eq "${RET}" "${PWM_E_OK}" "return code (exported)"
+	test_assert_eq "$(cat ${CHIP_DIR}/unexport)" "${DEFAULT_PWM_CHANNEL}" "unexport data check"
+
+	test_passed
+}
+
+. ${PWM_TEST_ROOT}/pwm-test-common.sh.inc
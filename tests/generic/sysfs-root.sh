@@ -0,0 +1,39 @@
+#!/bin/sh
+#
+# SPDX-License-Identifier: WTFPL
+# SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+#
+
+function do_test {
+	local SYSFS
+	local ENABLE
+	local PERIOD
+	local DUTY_CYCLE
+	local RET
+
+	# Create sysfs root + chip folder + channel folder
+	test_sysfs_create ${DEFAULT_PWM_CHIP} ${DEFAULT_PWM_CHANNEL} SYSFS
+
+	# Environment variable points to the missing root
+	PWM_SYSFS_ROOT="${PWM_TEST_DIR}/missing" ${PWM_TEST_BIN} -d 10
+	RET=$?
+
+	test_assert_eq "${RET}" "${PWM_E_NO_SYSFS}" "return code (environment)"
+
+	# Option overrides environment variable
+	PWM_SYSFS_ROOT="${PWM_TEST_DIR}/missing" ${PWM_TEST_BIN} -d 10 \
+		--sysfs-root "${SYSFS_PWM_ROOT}"
+	RET=$?
+
+	test_assert_eq "${RET}" "${PWM_E_OK}" "return code (option)"
+
+	test_sysfs_read ${SYSFS} ENABLE PERIOD DUTY_CYCLE
+
+	test_assert_eq "${ENABLE}" "10" "enable data check"
+	test_assert_eq "${PERIOD}" "1000000" "period data check"
+	test_assert_eq "${DUTY_CYCLE}" "500000" "duty_cycle data check"
+
+	test_passed
+}
+
+. ${PWM_TEST_ROOT}/pwm-test-common.sh.inc
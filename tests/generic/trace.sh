@@ -0,0 +1,56 @@
+#!/bin/sh
+#
+# SPDX-License-Identifier: WTFPL
+# SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+#
+
+function do_test {
+	local RET
+	local SYSFS
+	local PID
+	local TRACE="${PWM_TEST_DIR}/trace.json"
+
+	# Create sysfs root + chip folder + channel folder
+	test_sysfs_create ${DEFAULT_PWM_CHIP} ${DEFAULT_PWM_CHANNEL} SYSFS
+
+	${PWM_TEST_BIN} -s "F1000D20k f3000" --trace "${TRACE}"
+	RET=$?
+
+	test_assert_eq "${RET}" "${PWM_E_OK}" "return code"
+	[ -f "${TRACE}" ] || test_failed "trace file is not created"
+
+	test_assert_eq "$(grep -c '"cat":"fetch"' ${TRACE})" "2" "fetch events"
+	test_assert_eq "$(grep -c '"cat":"sleep"' ${TRACE})" "2" "sleep events"
+	test_assert_eq "$(grep -c '"cat":"write"' ${TRACE})" "6" "write events"
+	test_assert_eq "$(grep -c '"name":"write period".*"value":333333,"error":0' ${TRACE})" \
+		"1" "period write event"
+
+	# Trace is saved when execution is interrupted
+	rm -f "${TRACE}"
+
+	${PWM_TEST_BIN} -d 1000 --trace "${TRACE}" &
+	PID=$!
+	sleep 0.2
+	kill -INT ${PID}
+	wait ${PID}
+	RET=$?
+
+	test_assert_eq "${RET}" "${PWM_E_INTR}" "return code (interrupted)"
+	test_assert_eq "$(grep -c '"name":"signal 2"' ${TRACE})" "1" "signal event"
+
+	# Trace buffer of the zero-heap build is sized to the arena
+	rm -f "${TRACE}"
+
+	${PWM_TEST_NOHEAP_BIN} -s "F1000D20k f3000" --trace "${TRACE}"
+	test_assert_eq "$?" "${PWM_E_OK}" "return code (zero-heap)"
+	test_assert_eq "$(grep -c '"cat":"write"' ${TRACE})" "6" "write events (zero-heap)"
+
+	if command -v python3 > /dev/null; then
+		python3 -c "import json, sys; json.load(open(sys.argv[1]))" "${TRACE}" \
+			|| test_failed "invalid trace file"
+	fi
+
+	test_passed
+}
+
+. ${PWM_TEST_ROOT}/pwm-test-common.sh.inc
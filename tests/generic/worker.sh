@@ -0,0 +1,126 @@
+#!/bin/sh
+#
+# SPDX-License-Identifier: WTFPL
+# SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+#
+# Test background worker requests queue: overflow policies,
+# wraparound and concurrent producers. Request N plays the
+# frequency of 1000 + N Hz, delivery order is taken from
+# the fake PWM device log. Programs storage of the worker
+# is tested with the scripts finishing in any order on two
+# channels.
+#
+# Timing test (run serially)
+#
+
+#
+# $1 - driver mode
+# $@ - mode arguments
+#
+function driver_run_mode {
+	local SYSFS
+
+	test_sysfs_create ${DEFAULT_PWM_CHIP} ${DEFAULT_PWM_CHANNEL} SYSFS
+	rm -f "${PWM_FAKE_LOG}"
+
+	LD_PRELOAD="${PWM_FAKE_LIB}" PWM_FAKE_LOG="${PWM_FAKE_LOG}" \
+		${PWM_DRIVER_BIN} "$@"
+}
+
+function driver_run {
+	driver_run_mode worker "$@"
+}
+
+#
+# Print numbers of the delivered requests in order of delivery
+#
+function delivered {
+	test_fake_waveform | awk '$2 { print int(1e9 / $2 + 0.5) - 1000 }'
+}
+
+#
+# Print report field value
+#
+# $1 - report line
+# $2 - field name
+#
+function report_field {
+	echo "$1" | tr ' ' '\n' | awk -F= -v k=$2 '$1 == k { print $2 }'
+}
+
+function do_test {
+	local REPORT
+
+	[ -f "${PWM_DRIVER_BIN}" ] || test_failed "test driver is not built"
+
+	# Drop: requests submitted to the full queue are rejected
+	REPORT="$(driver_run -o drop -q 4 -n 10 -d 100)"
+	test_assert_eq "$?" "0" "driver return code (drop)"
+	test_assert_eq "$(report_field "${REPORT}" enqueued)" "4" "enqueued (drop)"
+	test_assert_eq "$(report_field "${REPORT}" full)" "6" "rejected (drop)"
+	test_assert_eq "$(report_field "${REPORT}" dropped)" "6" "dropped (drop)"
+	test_assert_eq "$(report_field "${REPORT}" depth_max)" "4" "depth (drop)"
+	test_assert_eq "$(delivered | xargs)" "0 1 2 3" "delivered (drop)"
+
+	# Replace: oldest queued requests are dropped
+	REPORT="$(driver_run -o replace -q 4 -n 10 -d 100)"
+	test_assert_eq "$?" "0" "driver return code (replace)"
+	test_assert_eq "$(report_field "${REPORT}" enqueued)" "10" "enqueued (replace)"
+	test_assert_eq "$(report_field "${REPORT}" full)" "0" "rejected (replace)"
+	test_assert_eq "$(report_field "${REPORT}" dropped)" "6" "dropped (replace)"
+	test_assert_eq "$(report_field "${REPORT}" depth_max)" "4" "depth (replace)"
+	test_assert_eq "$(delivered | xargs)" "6 7 8 9" "delivered (replace)"
+
+	# Block: producer waits for the worker start
+	REPORT="$(driver_run -o block -q 4 -n 10 -d 100)"
+	test_assert_eq "$?" "0" "driver return code (block)"
+	test_assert_eq "$(report_field "${REPORT}" enqueued)" "10" "enqueued (block)"
+	test_assert_eq "$(report_field "${REPORT}" dropped)" "0" "dropped (block)"
+	test_assert_range $(report_field "${REPORT}" enqueue_ms_max) 90 1000 \
+		"blocked time (block)"
+	test_assert_eq "$(delivered | xargs)" "$(seq 0 9 | xargs)" "delivered (block)"
+
+	# Wraparound: queue positions wrap around the slots many times
+	REPORT="$(driver_run -o block -q 4 -n 64)"
+	test_assert_eq "$?" "0" "driver return code (wraparound)"
+	test_assert_eq "$(report_field "${REPORT}" enqueued)" "64" "enqueued (wraparound)"
+	test_assert_eq "$(report_field "${REPORT}" dropped)" "0" "dropped (wraparound)"
+	test_assert_range $(report_field "${REPORT}" depth_max) 1 4 "depth (wraparound)"
+	test_assert_eq "$(delivered | xargs)" "$(seq 0 63 | xargs)" \
+		"delivered (wraparound)"
+
+	# Concurrent producers: all requests are delivered once,
+	# requests of each producer are delivered in order
+	REPORT="$(driver_run -o block -q 8 -p 4 -n 64)"
+	test_assert_eq "$?" "0" "driver return code (producers)"
+	test_assert_eq "$(report_field "${REPORT}" enqueued)" "256" "enqueued (producers)"
+	test_assert_eq "$(report_field "${REPORT}" dropped)" "0" "dropped (producers)"
+	test_assert_eq "$(report_field "${REPORT}" failed)" "0" "failed (producers)"
+	test_assert_eq "$(delivered | awk '{
+		p = int($1 / 64)
+		if (($1 in seen) || ((p in last) && ($1 < last[p])))
+			bad++
+		seen[$1]
+		last[p] = $1
+		n++
+	} END { print n, bad + 0 }')" "256 0" "delivered (producers)"
+
+	test_assert_eq "$(test_fake_errors)" "0" "rejected writes"
+
+	# Two channels: memory of the finished scripts is released in
+	# any order, 1000 scripts are compiled into 4096 bytes storage
+	test_sysfs_create ${DEFAULT_PWM_CHIP} 1 SYSFS
+	REPORT="$(driver_run_mode channels -n 1000 -a 4096)"
+	test_assert_eq "$?" "0" "driver return code (channels)"
+	test_assert_eq "$(report_field "${REPORT}" failed)" "0" "failed (channels)"
+	test_assert_eq "$(( $(report_field "${REPORT}" executed) + \
+		$(report_field "${REPORT}" discarded) ))" "1000" "finished (channels)"
+	test_assert_range $(report_field "${REPORT}" executed) 2 1000 \
+		"executed (channels)"
+
+	test_assert_eq "$(test_fake_errors)" "0" "rejected writes (channels)"
+
+	test_passed
+}
+
+. ${PWM_TEST_ROOT}/pwm-test-common.sh.inc
@@ -3,6 +3,8 @@
 # SPDX-License-Identifier: WTFPL
 # SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
 #
+# Timing test (run serially)
+#
 
 function do_test {
 	local RET
@@ -30,9 +32,9 @@ function do_test {
 
 	test_sysfs_read ${SYSFS} ENABLE PERIOD DUTY_CYCLE
 
-	local EXP_ENABLE="10010010"
-	local EXP_PERIOD="100000010000001000000"
-	local EXP_DUTY_CYCLE="50000005000000500000"
+	local EXP_ENABLE="101010"
+	local EXP_PERIOD="1000000"
+	local EXP_DUTY_CYCLE="500000"
 
 	test_assert_eq "${ENABLE}" "${EXP_ENABLE}" "enable data check"
 	test_assert_eq "${PERIOD}" "${EXP_PERIOD}" "period data check"
@@ -3,6 +3,8 @@
 # SPDX-License-Identifier: WTFPL
 # SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
 #
+# Timing test (run serially)
+#
 
 function do_test {
 	local RET
@@ -34,9 +36,9 @@ function do_test {
 
 	test_sysfs_read ${SYSFS} ENABLE PERIOD DUTY_CYCLE
 
-	local EXP_ENABLE="1001101001100101010"
-	local EXP_PERIOD="10000001000000100000010000001000000833333833333833333833333"
-	local EXP_DUTY_CYCLE="50000005000000500000050000005000000416667041666704166670416667"
+	local EXP_ENABLE="10101010101010"
+	local EXP_PERIOD="1000000833333"
+	local EXP_DUTY_CYCLE="500000416667"
 
 	test_assert_eq "${ENABLE}" "${EXP_ENABLE}" "enable data check"
 	test_assert_eq "${PERIOD}" "${EXP_PERIOD}" "period data check"
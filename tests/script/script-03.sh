@@ -5,6 +5,8 @@
 #
 # Test long durations (exceeding 2^32 in nanoseconds) in script
 #
+# Timing test (run serially)
+#
 
 function do_test {
 	local RET
@@ -34,9 +36,9 @@ function do_test {
 
 	test_sysfs_read ${SYSFS} ENABLE PERIOD DUTY_CYCLE
 
-	local EXP_ENABLE="10010010010010010"
-	local EXP_PERIOD="100000010000001000000500000500000500000"
-	local EXP_DUTY_CYCLE="50000005000000500000025000002500000250000"
+	local EXP_ENABLE="101010101010"
+	local EXP_PERIOD="1000000500000"
+	local EXP_DUTY_CYCLE="500000250000"
 
 	test_assert_eq "${ENABLE}" "${EXP_ENABLE}" "enable data check"
 	test_assert_eq "${PERIOD}" "${EXP_PERIOD}" "period data check"
@@ -0,0 +1,91 @@
+#!/bin/sh
+#
+# SPDX-License-Identifier: WTFPL
+# SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+#
+# Test frequency sweeps (linear up, exponential down)
+#
+# Timing test (run serially)
+#
+
+function do_test {
+	local RET
+	local SYSFS
+	local WAVE
+	local I
+
+	test_sysfs_create ${DEFAULT_PWM_CHIP} ${DEFAULT_PWM_CHANNEL} SYSFS
+
+	# Invalid operands are reported with own status
+	${PWM_TEST_BIN} --script="f1000 g1000" 2> ${PWM_TEST_DIR}/stderr
+	test_assert_eq "$?" "${PWM_E_INVALID_FREQ}" "return code (no sweep end)"
+	grep -q "Invalid sweep frequency: 'g' at position 7" ${PWM_TEST_DIR}/stderr || \
+		test_failed "sweep operand error is not reported"
+
+	${PWM_TEST_BIN} --script="G0-1000/100"
+	test_assert_eq "$?" "${PWM_E_INVALID_FREQ}" "return code (zero frequency)"
+
+	${PWM_TEST_BIN} --script="ux g1000-2000/100"
+	test_assert_eq "$?" "${PWM_E_INVALID_DURATION}" "return code (no interval)"
+
+	${PWM_TEST_BIN} --script="x"
+	test_assert_eq "$?" "${PWM_E_FAILED}" "return code (unknown command)"
+
+	# Number of the steps is limited (PWM_PROGRAM_STEPS_MAX)
+	${PWM_TEST_BIN} --script="u1 g1000-2000/4294967295" 2> ${PWM_TEST_DIR}/stderr
+	test_assert_eq "$?" "${PWM_E_INVALID_DURATION}" "return code (too many steps)"
+	grep -q "Too many sweep or fade steps" ${PWM_TEST_DIR}/stderr || \
+		test_failed "too many steps are not reported"
+
+	# Arena of the zero-heap build is exhausted before the limit
+	${PWM_TEST_BIN} --script="u1 g1000-2000/40000 g2000-1000/40000"
+	RET=$?
+
+	if [ "${PWM_TEST_NO_HEAP}" = "1" ]; then
+		test_assert_eq "${RET}" "${PWM_E_NO_MEMORY}" "return code (too many program steps)"
+	else
+		test_assert_eq "${RET}" "${PWM_E_INVALID_DURATION}" "return code (too many program steps)"
+	fi
+
+	# 10 steps in each sweep, 2000 Hz steps of both sweeps are joined
+	test_fake_run --script="u10 g1000-2000/100k G2000-1000/100"
+	RET=$?
+
+	test_assert_eq "${RET}" "${PWM_E_OK}" "return code"
+	test_assert_eq "$(test_fake_errors)" "0" "rejected writes"
+
+	# PWM is enabled once and is kept enabled between the steps
+	test_assert_eq "$(awk '$1 == "W" && $4 == "enable"' ${PWM_FAKE_LOG} | wc -l)" \
+		"2" "enable writes"
+
+	WAVE=($(test_fake_waveform | awk '$2 != 0 { print $2 }'))
+
+	test_assert_eq "${#WAVE[@]}" "19" "number of steps"
+	test_assert_eq "${WAVE[0]}" "1000000" "start period"
+	test_assert_eq "${WAVE[9]}" "500000" "middle period"
+	test_assert_eq "${WAVE[18]}" "1000000" "end period"
+
+	for I in $(seq 1 9); do
+		[ ${WAVE[$I]} -lt ${WAVE[$((I - 1))]} ] || \
+			test_failed "linear sweep step ${I} is not monotonic"
+	done
+
+	for I in $(seq 10 18); do
+		[ ${WAVE[$I]} -gt ${WAVE[$((I - 1))]} ] || \
+			test_failed "exponential sweep step ${I} is not monotonic"
+	done
+
+	# Equal frequency ratio between the exponential sweep steps
+	# (2000 * 0.5^(5/9) = 1361 Hz)
+	test_assert_eq "${WAVE[14]}" "734754" "exponential sweep step"
+
+	# Output is disabled after the total duration of the steps
+	WAVE=($(test_fake_waveform | tail -n 1))
+
+	test_assert_eq "${WAVE[1]}" "0" "disabled"
+	test_assert_range ${WAVE[0]} 190 240 "disable time"
+
+	test_passed
+}
+
+. ${PWM_TEST_ROOT}/pwm-test-common.sh.inc
@@ -0,0 +1,92 @@
+#!/bin/sh
+#
+# SPDX-License-Identifier: WTFPL
+# SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+#
+# Test duty cycle, polarity and fade operations
+#
+
+function fake_writes {
+	echo $(awk '$1 == "W" { print $4 "=" $5 }' ${PWM_FAKE_LOG})
+}
+
+function do_test {
+	local RET
+	local SYSFS
+	local WAVE
+	local I
+
+	test_sysfs_create ${DEFAULT_PWM_CHIP} ${DEFAULT_PWM_CHANNEL} SYSFS
+
+	${PWM_TEST_BIN} --script="f1000w101" 2> ${PWM_TEST_DIR}/stderr
+	test_assert_eq "$?" "${PWM_E_INVALID_DUTY}" "return code (invalid percentage)"
+	grep -q "Invalid duty cycle: 'w' at position 6" ${PWM_TEST_DIR}/stderr || \
+		test_failed "invalid percentage is not reported"
+
+	${PWM_TEST_BIN} --script="f1000n2000000"
+	test_assert_eq "$?" "${PWM_E_INVALID_DUTY}" "return code (duty above period)"
+
+	# Duty cycle only changes cost a single write
+	test_sysfs_create ${DEFAULT_PWM_CHIP} ${DEFAULT_PWM_CHANNEL} SYSFS
+	rm -f "${PWM_FAKE_LOG}"
+
+	test_fake_run --script="F1000D20w25k fw75k fn100000"
+	test_assert_eq "$?" "${PWM_E_OK}" "return code"
+	test_assert_eq "$(test_fake_errors)" "0" "rejected writes"
+	test_assert_eq "$(fake_writes)" \
+		"period=1000000 duty_cycle=250000 enable=1 duty_cycle=750000 duty_cycle=100000 enable=0" \
+		"duty cycle writes"
+
+	# Polarity is changed while disabled
+	test_sysfs_create ${DEFAULT_PWM_CHIP} ${DEFAULT_PWM_CHANNEL} SYSFS
+	rm -f "${PWM_FAKE_LOG}"
+
+	test_fake_run --script="F1000D20k i1f i0"
+	test_assert_eq "$?" "${PWM_E_OK}" "return code"
+	test_assert_eq "$(test_fake_errors)" "0" "rejected writes"
+	test_assert_eq "$(fake_writes)" \
+		"period=1000000 duty_cycle=500000 enable=1 enable=0 polarity=1 enable=1 enable=0 polarity=0" \
+		"polarity writes"
+
+	# Fade is expanded into 10 duty cycle steps
+	test_sysfs_create ${DEFAULT_PWM_CHIP} ${DEFAULT_PWM_CHANNEL} SYSFS
+	rm -f "${PWM_FAKE_LOG}"
+
+	test_fake_run --script="F1000u10w0-100/100"
+	test_assert_eq "$?" "${PWM_E_OK}" "return code"
+	test_assert_eq "$(test_fake_errors)" "0" "rejected writes"
+
+	WAVE=($(awk '$1 == "W" && $4 == "duty_cycle" { print $5 }' ${PWM_FAKE_LOG}))
+
+	test_assert_eq "${#WAVE[@]}" "9" "fade duty cycle writes"
+	test_assert_eq "${WAVE[0]}" "111111" "fade 2nd step"
+	test_assert_eq "${WAVE[8]}" "1000000" "fade last step"
+
+	for I in $(seq 1 8); do
+		[ ${WAVE[$I]} -gt ${WAVE[$((I - 1))]} ] || \
+			test_failed "fade step ${I} is not monotonic"
+	done
+
+	test_assert_eq "$(awk '$1 == "W" && $4 != "duty_cycle"' ${PWM_FAKE_LOG} | wc -l)" \
+		"3" "fade other writes"
+
+	# Tool options, polarity is restored on exit
+	test_sysfs_create ${DEFAULT_PWM_CHIP} ${DEFAULT_PWM_CHANNEL} SYSFS
+	rm -f "${PWM_FAKE_LOG}"
+
+	test_fake_run -f 2000 -d 10 --duty 10 --polarity inversed --restore
+	test_assert_eq "$?" "${PWM_E_OK}" "return code"
+	test_assert_eq "$(test_fake_errors)" "0" "rejected writes"
+
+	WAVE=($(awk '$1 == "S" && $4 == 1' ${PWM_FAKE_LOG} | tail -n 1))
+
+	test_assert_eq "${WAVE[4]} ${WAVE[5]} ${WAVE[6]}" "500000 50000 1" "output state"
+
+	WAVE=($(awk '$1 == "S"' ${PWM_FAKE_LOG} | tail -n 1))
+
+	test_assert_eq "${WAVE[6]}" "0" "restored polarity"
+
+	test_passed
+}
+
+. ${PWM_TEST_ROOT}/pwm-test-common.sh.inc
@@ -0,0 +1,74 @@
+#!/bin/sh
+#
+# SPDX-License-Identifier: WTFPL
+# SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+#
+# Test RTTTL melodies
+#
+# Timing test (run serially)
+#
+
+function do_test {
+	local RET
+	local SYSFS
+	local WAVE
+	local NOTES
+	local I
+
+	test_sysfs_create ${DEFAULT_PWM_CHIP} ${DEFAULT_PWM_CHANNEL} SYSFS
+
+	${PWM_TEST_BIN} --melody="t:d=3,o=5,b=240:c"
+	test_assert_eq "$?" "${PWM_E_FAILED}" "return code (invalid duration)"
+
+	${PWM_TEST_BIN} --melody="t:d=4,o=5,b=240:c,x"
+	test_assert_eq "$?" "${PWM_E_FAILED}" "return code (invalid note)"
+
+	${PWM_TEST_BIN} --melody="t:d=4,o=5,b=240 c"
+	test_assert_eq "$?" "${PWM_E_FAILED}" "return code (no notes section)"
+
+	# Whole note is 1000 ms, the rest is 250 ms
+	test_fake_run --melody="t:d=4,o=5,b=240:c,8e.,p,2a4,c#6"
+	RET=$?
+
+	test_assert_eq "${RET}" "${PWM_E_OK}" "return code"
+	test_assert_eq "$(test_fake_errors)" "0" "rejected writes"
+
+	# Active output segments
+	WAVE=($(test_fake_waveform | awk '$2 != 0'))
+
+	test_assert_eq "${#WAVE[@]}" "8" "waveform length"
+	test_assert_eq "${WAVE[1]}" "1911128" "C5 period"
+	test_assert_eq "${WAVE[3]}" "1516863" "E5 period"
+	test_assert_eq "${WAVE[5]}" "2272727" "A4 period"
+	test_assert_eq "${WAVE[7]}" "901932" "C#6 period"
+	test_assert_range ${WAVE[2]} 250 270 "E5 start"
+	test_assert_range ${WAVE[4]} 687 710 "A4 start (after rest)"
+	test_assert_range ${WAVE[6]} 1187 1210 "C#6 start"
+
+	WAVE=($(test_fake_waveform | tail -n 1))
+
+	test_assert_eq "${WAVE[1]}" "0" "disabled"
+	test_assert_range ${WAVE[0]} 1437 1460 "melody duration"
+
+	# 60 notes of 8.33 ms: note durations are not rounded separately
+	rm -f "${PWM_FAKE_LOG}"
+
+	NOTES="32c,32d"
+	for I in $(seq 2 30); do
+		NOTES="${NOTES},32c,32d"
+	done
+
+	test_fake_run --melody="t:o=5,b=900:${NOTES}"
+	RET=$?
+
+	test_assert_eq "${RET}" "${PWM_E_OK}" "return code"
+
+	WAVE=($(test_fake_waveform | tail -n 1))
+
+	test_assert_eq "${WAVE[1]}" "0" "disabled"
+	test_assert_range ${WAVE[0]} 497 530 "long melody duration"
+
+	test_passed
+}
+
+. ${PWM_TEST_ROOT}/pwm-test-common.sh.inc
@@ -0,0 +1,131 @@
+#!/bin/sh
+#
+# SPDX-License-Identifier: WTFPL
+# SPDX-FileCopyrightText: 2021 Anton Kikin <a.kikin@tano-systems.com>
+#
+# Test deadline overrun policies. Commands are scheduled at 0, 50,
+# 100, 150 and 200 ms, the first write of the second command
+# (4th write) stalls for 120 ms, so the command 3 is started at least
+# 70 ms late. Delays are only bounded from below by the stall, the
+# stall is checked to be counted once by comparing the drift with the
+# maximum delay.
+#
+# Timing test (run serially)
+#
+
+SCRIPT="F1000D50k F2000k F1000k F2000k F1000"
+TOLERANCE="--overrun-tolerance=10000"
+
+#
+# $1 - overrun policy
+# $2 - script (optional)
+#
+function run_stalled {
+	local SYSFS
+
+	# Same writes are made from the initial state
+	test_sysfs_create ${DEFAULT_PWM_CHIP} ${DEFAULT_PWM_CHANNEL} SYSFS
+	rm -f "${PWM_FAKE_LOG}"
+
+	PWM_FAKE_STALL="4:120" test_fake_run --stats ${TOLERANCE} --overrun=$1 -s "${2:-${SCRIPT}}"
+}
+
+#
+# Print stats field value
+#
+# $1 - stats line
+# $2 - field name
+#
+function stats_field {
+	echo "$1" | tr ' ' '\n' | awk -F= -v k=$2 '$1 == k { print $2 }'
+}
+
+#
+# Check drift of the execution with a single stall
+#
+# $1 - stats line
+# $2 - minimum delay caused by the stall (us)
+# $3 - description
+#
+function assert_drift {
+	local DRIFT=$(stats_field "$1" drift_us)
+
+	test_assert_ge "${DRIFT}" "$2" "drift ($3)"
+	test_assert_eq "${DRIFT}" "$(stats_field "$1" max_delay_us)" "drift = max delay ($3)"
+}
+
+function do_test {
+	local RET
+	local SYSFS
+	local STATS
+	local WAVE
+
+	test_sysfs_create ${DEFAULT_PWM_CHIP} ${DEFAULT_PWM_CHANNEL} SYSFS
+
+	# No stalls, no misses
+	STATS=$(test_fake_run --stats ${TOLERANCE} -s "${SCRIPT}")
+	test_assert_eq "$?" "${PWM_E_OK}" "return code"
+	test_assert_eq "$(stats_field "${STATS}" missed)" "0" "missed"
+
+	# Catch up: commands 3 and 4 are late and shortened, the stall
+	# is counted once
+	STATS=$(run_stalled catch-up)
+	test_assert_eq "$?" "${PWM_E_OK}" "return code (catch-up)"
+	test_assert_eq "$(stats_field "${STATS}" missed)" "2" "missed (catch-up)"
+	test_assert_eq "$(stats_field "${STATS}" skipped)" "0" "skipped (catch-up)"
+	assert_drift "${STATS}" 70000 "catch-up"
+
+	WAVE=($(test_fake_waveform | tail -n 1))
+	test_assert_range ${WAVE[0]} 248 275 "duration (catch-up)"
+
+	# Skip: command 3 is over before it is started, only the delay
+	# of the command 4 is counted
+	STATS=$(run_stalled skip)
+	test_assert_eq "$?" "${PWM_E_OK}" "return code (skip)"
+	test_assert_eq "$(stats_field "${STATS}" missed)" "2" "missed (skip)"
+	test_assert_eq "$(stats_field "${STATS}" skipped)" "1" "skipped (skip)"
+	assert_drift "${STATS}" 20000 "skip"
+
+	WAVE=($(test_fake_waveform | awk '{ print $2 }'))
+	test_assert_eq "${WAVE[*]}" "0 1000000 500000 1000000 0" "waveform (skip)"
+
+	WAVE=($(test_fake_waveform | tail -n 1))
+	test_assert_range ${WAVE[0]} 248 275 "duration (skip)"
+
+	# Skip: late command with zero duration is applied, the next
+	# command is over and is skipped
+	STATS=$(run_stalled skip "F1000D50k F2000k F3000d0k F1000k F2000k F1000")
+	test_assert_eq "$?" "${PWM_E_OK}" "return code (skip zero duration)"
+	test_assert_range $(stats_field "${STATS}" missed) 3 4 "missed (skip zero duration)"
+	test_assert_eq "$(stats_field "${STATS}" skipped)" "1" "skipped (skip zero duration)"
+	assert_drift "${STATS}" 70000 "skip zero duration"
+
+	WAVE=($(test_fake_waveform | awk '{ print $2 }'))
+	test_assert_eq "${WAVE[*]}" "0 1000000 500000 333333 500000 1000000 0" \
+		"waveform (skip zero duration)"
+
+	# Stretch: timeline is shifted by the delay of the command 3
+	STATS=$(run_stalled stretch)
+	test_assert_eq "$?" "${PWM_E_OK}" "return code (stretch)"
+	test_assert_eq "$(stats_field "${STATS}" missed)" "1" "missed (stretch)"
+	assert_drift "${STATS}" 70000 "stretch"
+
+	WAVE=($(test_fake_waveform | tail -n 1))
+	test_assert_range ${WAVE[0]} 318 345 "duration (stretch)"
+
+	# Abort: execution is stopped at the command 3, PWM is disabled
+	STATS=$(run_stalled abort)
+	test_assert_eq "$?" "${PWM_E_OVERRUN}" "return code (abort)"
+	test_assert_eq "$(stats_field "${STATS}" missed)" "1" "missed (abort)"
+
+	WAVE=($(test_fake_waveform | tail -n 1))
+	test_assert_eq "${WAVE[1]}" "0" "disabled (abort)"
+	test_assert_range ${WAVE[0]} 165 200 "duration (abort)"
+
+	${PWM_TEST_BIN} --overrun=never -s "${SCRIPT}"
+	test_assert_eq "$?" "22" "return code (invalid policy)"
+
+	test_passed
+}
+
+. ${PWM_TEST_ROOT}/pwm-test-common.sh.inc